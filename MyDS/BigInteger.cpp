@@ -2,10 +2,43 @@
 // Created by Zhengyi on 2020/11/17.
 //
 
+#include <random>
 #include "BigInteger.h"
 
+using namespace bigInteger;
+
+// Multiplies with every fast path switched off, then with NTT forced,
+// then on a thread pool, from outside it and from one of its tasks, and
+// compares all against the default dispatch.
+bool checkMultiplication(const BigInteger &x, const BigInteger &y, ThreadPool &pool) {
+    BigInteger::Thresholds &t = BigInteger::multiplyThresholds();
+    BigInteger::Thresholds saved = t;
+    BigInteger fast = x * y, fastSquare = x * x;
+    t.karatsuba = t.toom3 = t.ntt = size_t(-1);
+    BigInteger schoolbook = x * y, schoolbookSquare = x * x;
+    t = saved;
+    t.ntt = 1;
+    BigInteger ntt = x * y, nttSquare = x * x;
+    t = saved;
+    BigInteger::Parallel &policy = BigInteger::parallelPolicy();
+    BigInteger::Parallel single = policy;
+    policy.pool = &pool;
+    policy.cutoff = 1;
+    BigInteger parallel = x * y, parallelSquare = x * x;
+    t.ntt = 1;
+    std::future<BigInteger> nested = pool.submit([&x, &y] { return x * y; });
+    BigInteger nestedSquare = x * x, nestedNtt = nested.get();
+    t = saved;
+    policy = single;
+    return fast == schoolbook && ntt == schoolbook && parallel == schoolbook &&
+           nestedNtt == schoolbook && fastSquare == schoolbookSquare &&
+           nttSquare == schoolbookSquare && parallelSquare == schoolbookSquare &&
+           nestedSquare == schoolbookSquare;
+}
+
 int main() {
     using namespace std;
+    using namespace bigInteger;
     auto t = BigInteger("99");
     auto b = BigInteger("-98");
     (t + b).show(std::cout) << '\n';
@@ -17,8 +50,46 @@ int main() {
     cout << "\n";
     (BigInteger("99") / BigInteger("99")).show(std::cout);
     cout << "\n";
+    BigInteger quotient, remainder;
+    BigInteger("-102935483").divMod(BigInteger("99"), quotient, remainder);
+    cout << quotient << " " << remainder << "\n";
 
     (BigInteger("99") ^ BigInteger("99")).show(std::cout);
     cout << "\n";
+    cout << (BigInteger(-3).pow(41) == (BigInteger(-3) ^ BigInteger(41))) << " "
+         << BigInteger(2).modPow(BigInteger("1000000000000000003"), BigInteger(998244353))
+         << "\n";
+    // Crossing the int64 range in both directions.
+    BigInteger max("9223372036854775807"), min("-9223372036854775808");
+    cout << (max + BigInteger(1)) << " " << (min - BigInteger(1)) << " " << -min << " "
+         << (max + BigInteger(1) - BigInteger(1) == max) << " " << min / BigInteger(-1) << "\n";
+    BigInteger sum;
+    for (int i = 0; i < 100; ++i) {
+        sum += max;
+        sum -= BigInteger(i);
+    }
+    sum *= BigInteger(-3);
+    sum /= BigInteger(7);
+    cout << sum << "\n";
+    const char *text = "-12345678901234567890123 trailing";
+    BigInteger parsed(text, 24);
+    char buffer[32];
+    cout << string(buffer, parsed.format(buffer)) << " " << parsed.length() << "\n";
+
+    ThreadPool pool(4);
+    std::mt19937 gen(2020);
+    int passed = 0, total = 0;
+    for (int digits : {1, 9, 10, 500, 5000, 40000}) {
+        for (int rep = 0; rep < 3; ++rep) {
+            string a(1 + gen() % digits, '0'), b(1 + gen() % digits, '0');
+            for (auto &c : a) c = char('0' + gen() % 10);
+            for (auto &c : b) c = char('0' + gen() % 10);
+            if (rep == 2)
+                a = b = string(digits, '9');    // every carry at its largest
+            passed += checkMultiplication(BigInteger(a), -BigInteger(b), pool);
+            ++total;
+        }
+    }
+    cout << passed << " / " << total << " multiplications agree with schoolbook\n";
     return 0;
 }
@@ -6,8 +6,13 @@
 #define DATASTRUCTURE_BIGINTEGER_H
 
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
 #include <exception>
+#include <functional>
 #include <iostream>
+#include "ThreadPool.h"
 
 namespace bigInteger {
 
@@ -28,14 +33,20 @@ namespace bigInteger {
     class BigInteger {
     public:
 
-        BigInteger() : value("0"), negative(false) {}
+        BigInteger() = default;
 
-        explicit BigInteger(int i);
+        explicit BigInteger(int64_t i);
 
         explicit BigInteger(const string &s);
 
+        // Parses the first count chars of s, which need no terminator.
+        BigInteger(const char *s, size_t count);
+
         BigInteger(const BigInteger &bi);
 
+        // Leaves bi zero.
+        BigInteger(BigInteger &&bi) _NOEXCEPT;
+
         ~BigInteger() = default;
 
         // Unary operator
@@ -47,10 +58,36 @@ namespace bigInteger {
 
         std::ostream &show(std::ostream &os) const;
 
+        // Number of chars format writes, sign included.
+        size_t length() const;
+
+        // Stores the value in word if it fits in an int64_t.
+        bool toWord(int64_t &word) const {
+            word = small;
+            return !big;
+        }
+
+        // Writes the decimal form, without terminator, into buffer, which
+        // must hold length() chars. Returns the number of chars written.
+        size_t format(char *buffer) const;
+
         int compare(const BigInteger &bi) const;
 
         BigInteger &operator=(const BigInteger &bi);
 
+        BigInteger &operator=(BigInteger &&bi) _NOEXCEPT;
+
+        // In place, reusing this value's limbs: += and -= only allocate
+        // when the result outgrows their capacity.
+        BigInteger &operator+=(const BigInteger &bi);
+
+        BigInteger &operator-=(const BigInteger &bi);
+
+        BigInteger &operator*=(const BigInteger &bi);
+
+        // Throws DivideByZero exception
+        BigInteger &operator/=(const BigInteger &bi);
+
         BigInteger operator+(const BigInteger &bi) const;
 
         BigInteger operator-(const BigInteger &bi) const;
@@ -65,174 +102,1121 @@ namespace bigInteger {
 
         bool operator==(const BigInteger &bi) const;
 
+        // Truncating division giving both results in one pass: quotient
+        // rounds toward zero, remainder takes the sign of *this.
+        // Throws DivideByZero exception
+        void divMod(const BigInteger &bi, BigInteger &quotient, BigInteger &remainder) const;
+
+        // Power with a machine-word exponent; pow(0) is 1.
+        BigInteger pow(uint64_t exponent) const;
+
+        // Same value as (*this ^ exp) % mod, without building the power.
+        // Throws DivideByZero exception
+        BigInteger modPow(const BigInteger &exp, const BigInteger &mod) const;
+
+        // Operand sizes, in limbs, from which multiplication switches to
+        // Karatsuba, Toom-3 and NTT. Exposed for tuning and for tests that
+        // check the fast paths against schoolbook multiplication.
+        struct Thresholds {
+            size_t karatsuba;
+            size_t toom3;
+            size_t ntt;
+        };
+
+        static Thresholds &multiplyThresholds() {
+            static Thresholds thresholds = {64, 300, 2500};
+            return thresholds;
+        }
+
+        // With a pool set, multiplications whose smaller operand has at
+        // least cutoff limbs run their Karatsuba/Toom-3 sub-products, their
+        // three NTT primes and slices of every NTT pass as pool tasks. Tasks
+        // fork again down to about log2(pool size) levels, on pool threads
+        // too, and wait through ThreadPool::wait. Set it up before
+        // multiplying; no pool means single-threaded.
+        struct Parallel {
+            ThreadPool *pool;
+            size_t cutoff;
+        };
+
+        static Parallel &parallelPolicy() {
+            static Parallel policy = {nullptr, 1000};
+            return policy;
+        }
+
 
     protected:
-        string value;
+        // Base 10^9 limbs, least significant first, without leading zero
+        // limbs. Zero has no limbs and is never negative.
+        typedef std::vector<uint32_t> Limbs;
+        static constexpr uint32_t Base = 1000000000;
+        static constexpr int BaseDigits = 9;
+
+        // Values that fit in int64_t are kept inline in small, with big
+        // false and no limbs. Only values outside that range use limbs and
+        // negative, so every value has exactly one representation.
+        Limbs limbs;
         bool negative = false;
+        int64_t small = 0;
+        bool big = false;
 
         int compareAbs(const BigInteger &bi) const;
-    };
+        bool isZero() const { return !big && small == 0; }
+        bool isNegative() const { return big ? negative : small < 0; }
+        uint64_t smallAbs() const { return small < 0 ? 0 - uint64_t(small) : uint64_t(small); }
+        // The magnitude as limbs; small values are spelled out in scratch.
+        const Limbs &mag(Limbs &scratch) const;
+        // Takes limbs as the magnitude and demotes the value to small
+        // when it fits; limbs keeps its capacity either way.
+        void normalize(bool isNeg);
+        // Same, taking the magnitude from m (left empty).
+        void setMag(Limbs &m, bool isNeg);
+        // *this += bi, or -= when subtract is set.
+        void addSigned(const BigInteger &bi, bool subtract);
+        static void toLimbs(uint64_t u, Limbs &r);
 
-    BigInteger::BigInteger(int i) {
-        if (i < 0) {
-            value = std::to_string(-i);
-            negative = true;
-        } else {
-            value = std::to_string(i);
-            negative = false;
+        static void trim(Limbs &a);
+        static int compareMag(const Limbs &a, const Limbs &b);
+        static int compareMag(const Limbs &a, uint64_t u);
+        static void addSmall(Limbs &a, uint64_t u);
+        // Requires a >= u.
+        static void subSmall(Limbs &a, uint64_t u);
+        static void addMag(const Limbs &a, const Limbs &b, Limbs &r);
+        // Requires a >= b.
+        static void subMag(const Limbs &a, const Limbs &b, Limbs &r);
+        // Squares when a and b are the same object.
+        static void mulMag(const Limbs &a, const Limbs &b, Limbs &r);
+        static uint32_t divSmall(Limbs &a, uint32_t d);
+        static void mulSmall(Limbs &a, uint32_t m);
+        static void divMag(const Limbs &a, const Limbs &b, Limbs &q, Limbs &r);
+
+        // Divisors and quotients shorter than this, in limbs, use Knuth's
+        // algorithm D; longer ones recurse (Burnikel-Ziegler).
+        static constexpr size_t DivideThreshold = 60;
+
+        static void divKnuth(const Limbs &a, const Limbs &b, Limbs &q, Limbs &r);
+        static void div2n1n(const Limbs &a, const Limbs &b, size_t n, Limbs &q, Limbs &r);
+        static void div3n2n(const Limbs &a12, const Limbs &a3, const Limbs &b,
+                            const Limbs &b1, const Limbs &b2, size_t n,
+                            Limbs &q, Limbs &r);
+
+        typedef std::vector<uint8_t> Bits;      // least significant first
+        static void bitsOf(const Limbs &a, Bits &bits);
+        template<class Multiply>
+        static void slidingWindowPow(const Limbs &x, const Bits &bits,
+                                     Multiply multiply, Limbs &r);
+        class Barrett;
+
+        static void mulRec(const Limbs &a, const Limbs &b, Limbs &r, bool square);
+        static void schoolbookMul(const Limbs &a, const Limbs &b, Limbs &r);
+        static void schoolbookSquare(const Limbs &a, Limbs &r);
+        static void karatsuba(const Limbs &a, const Limbs &b, Limbs &r, bool square);
+        static void toom3(const Limbs &a, const Limbs &b, Limbs &r, bool square);
+        static void nttMul(const Limbs &a, const Limbs &b, Limbs &r, bool square);
+        // In-place iterative transform over Z/p, a.size() a power of two.
+        static void ntt(std::vector<uint32_t> &a, bool invert, uint32_t p);
+        static BigInteger signedProduct(const BigInteger &x, const BigInteger &y, bool square);
+        // Runs every job, forking per parallelPolicy for operands of size
+        // limbs; the calling thread takes the last job itself.
+        static void runAll(std::function<void()> jobs[], int count, size_t size);
+        // How many runAll calls enclose the running job.
+        static int &forkDepth() {
+            static thread_local int depth = 0;
+            return depth;
         }
-    }
+        static Limbs slice(const Limbs &a, size_t from, size_t length);
+        // r += a * Base^shift
+        static void addShifted(Limbs &r, const Limbs &a, size_t shift);
+    };
 
-    BigInteger::BigInteger(const string &s) {
-        negative = false;
+    BigInteger::BigInteger(int64_t i) : small(i) {}
+
+    BigInteger::BigInteger(const string &s) : BigInteger(s.data(), s.length()) {}
+
+    BigInteger::BigInteger(const char *s, size_t count) {
+        bool isNeg = false;
         unsigned long begPos = 0;
-        if (s.empty()) {
-            value = "0";
-            negative = false;
+        if (count == 0) {
             return;
         }
         if (s[0] == '-') {
-            negative = true;
+            isNeg = true;
             begPos = 1;
         }
-        for (auto &c : s.substr(begPos)) {
-            if (c > '9' || c < '0') {
+        if (begPos == count) {
+            throw ParseError();
+        }
+        for (unsigned long i = begPos; i < count; ++i) {
+            if (s[i] > '9' || s[i] < '0') {
                 throw ParseError();
             }
         }
-        value = s.substr(begPos);
+        // Up to 18 digits always fit in int64_t.
+        if (count - begPos <= 18) {
+            for (unsigned long i = begPos; i < count; ++i) {
+                small = small * 10 + (s[i] - '0');
+            }
+            if (isNeg)
+                small = -small;
+            return;
+        }
+        // Nine digits per limb, starting from the least significant end.
+        Limbs m;
+        m.reserve((count - begPos) / BaseDigits + 1);
+        for (long end = long(count); end > long(begPos); end -= BaseDigits) {
+            long beg = std::max(long(begPos), end - BaseDigits);
+            uint32_t limb = 0;
+            for (long i = beg; i < end; ++i) {
+                limb = limb * 10 + (s[i] - '0');
+            }
+            m.push_back(limb);
+        }
+        trim(m);
+        setMag(m, isNeg);
     }
 
-    BigInteger::BigInteger(const BigInteger &bi) {
-        negative = bi.negative;
-        value = bi.value;
+    BigInteger::BigInteger(const BigInteger &bi) :
+            limbs(bi.limbs), negative(bi.negative), small(bi.small), big(bi.big) {}
+
+    BigInteger::BigInteger(BigInteger &&bi) _NOEXCEPT :
+            limbs(std::move(bi.limbs)), negative(bi.negative), small(bi.small), big(bi.big) {
+        bi.limbs.clear();
+        bi.negative = false;
+        bi.small = 0;
+        bi.big = false;
     }
 
     BigInteger &BigInteger::operator=(const BigInteger &bi) {
         if (&bi == this)
             return *this;
         negative = bi.negative;
-        value = bi.value;
+        small = bi.small;
+        big = bi.big;
+        if (big)
+            limbs = bi.limbs;
+        else
+            limbs.clear();
+        return *this;
+    }
+
+    BigInteger &BigInteger::operator=(BigInteger &&bi) _NOEXCEPT {
+        if (&bi == this)
+            return *this;
+        // bi takes the old buffer, so neither side gives up its capacity.
+        limbs.swap(bi.limbs);
+        negative = bi.negative;
+        small = bi.small;
+        big = bi.big;
+        bi.limbs.clear();
+        bi.negative = false;
+        bi.small = 0;
+        bi.big = false;
         return *this;
     }
 
+    void BigInteger::toLimbs(uint64_t u, Limbs &r) {
+        r.clear();
+        while (u) {
+            r.push_back(uint32_t(u % Base));
+            u /= Base;
+        }
+    }
+
+    const BigInteger::Limbs &BigInteger::mag(Limbs &scratch) const {
+        if (big)
+            return limbs;
+        toLimbs(smallAbs(), scratch);
+        return scratch;
+    }
+
+    void BigInteger::normalize(bool isNeg) {
+        // Three limbs with a top limb of at most 9 stay below 10^19 < 2^64.
+        if (limbs.size() < 3 || (limbs.size() == 3 && limbs[2] <= 9)) {
+            uint64_t u = 0;
+            for (size_t i = limbs.size(); i > 0; --i) {
+                u = u * Base + limbs[i - 1];
+            }
+            const uint64_t limit = uint64_t(INT64_MAX) + (isNeg ? 1 : 0);
+            if (u <= limit) {
+                small = isNeg ? int64_t(0 - u) : int64_t(u);
+                big = false;
+                negative = false;
+                limbs.clear();
+                return;
+            }
+        }
+        negative = isNeg;
+        small = 0;
+        big = true;
+    }
+
+    void BigInteger::setMag(Limbs &m, bool isNeg) {
+        limbs.swap(m);
+        m.clear();
+        normalize(isNeg);
+    }
+
+    void BigInteger::trim(Limbs &a) {
+        while (!a.empty() && a.back() == 0) {
+            a.pop_back();
+        }
+    }
+
+    int BigInteger::compareMag(const Limbs &a, const Limbs &b) {
+        if (a.size() != b.size())
+            return a.size() < b.size() ? -1 : 1;
+        for (size_t i = a.size(); i > 0; --i) {
+            if (a[i - 1] != b[i - 1])
+                return a[i - 1] < b[i - 1] ? -1 : 1;
+        }
+        return 0;
+    }
+
+    int BigInteger::compareMag(const Limbs &a, uint64_t u) {
+        uint32_t b[3];
+        size_t n = 0;
+        for (; u; u /= Base) {
+            b[n++] = uint32_t(u % Base);
+        }
+        if (a.size() != n)
+            return a.size() < n ? -1 : 1;
+        for (size_t i = n; i > 0; --i) {
+            if (a[i - 1] != b[i - 1])
+                return a[i - 1] < b[i - 1] ? -1 : 1;
+        }
+        return 0;
+    }
+
+    void BigInteger::addSmall(Limbs &a, uint64_t u) {
+        for (size_t i = 0; u; ++i) {
+            if (i == a.size())
+                a.push_back(0);
+            uint64_t sum = a[i] + u % Base;
+            u /= Base;
+            if (sum >= Base) {
+                sum -= Base;
+                ++u;
+            }
+            a[i] = uint32_t(sum);
+        }
+    }
+
+    void BigInteger::subSmall(Limbs &a, uint64_t u) {
+        for (size_t i = 0; u; ++i) {
+            uint32_t sub = uint32_t(u % Base);
+            u /= Base;
+            if (a[i] < sub) {
+                a[i] = a[i] + Base - sub;
+                ++u;
+            } else {
+                a[i] -= sub;
+            }
+        }
+        trim(a);
+    }
+
+    // Both work in place: r may be a or b.
+    void BigInteger::addMag(const Limbs &a, const Limbs &b, Limbs &r) {
+        const Limbs &longer = a.size() >= b.size() ? a : b;
+        const Limbs &shorter = a.size() >= b.size() ? b : a;
+        // Sizes are taken first, r may be resizing one of the operands.
+        size_t n = longer.size(), m = shorter.size();
+        r.resize(n + 1);
+        uint32_t carry = 0;
+        for (size_t i = 0; i < n; ++i) {
+            uint32_t sum = longer[i] + carry + (i < m ? shorter[i] : 0);
+            carry = sum >= Base;
+            r[i] = carry ? sum - Base : sum;
+        }
+        r[n] = carry;
+        trim(r);
+    }
+
+    void BigInteger::subMag(const Limbs &a, const Limbs &b, Limbs &r) {
+        size_t m = b.size();
+        r.resize(a.size());
+        uint32_t borrow = 0;
+        for (size_t i = 0; i < a.size(); ++i) {
+            uint32_t sub = borrow + (i < m ? b[i] : 0);
+            borrow = a[i] < sub;
+            r[i] = borrow ? a[i] + Base - sub : a[i] - sub;
+        }
+        trim(r);
+    }
+
+    // Three NTT-friendly primes; their product (about 2^86) bounds every
+    // convolution coefficient, n * (Base - 1)^2, for n below 2^26.
+    static const uint32_t NttPrimes[3] = {998244353, 167772161, 469762049};
+    static const uint32_t NttRoot = 3;          // primitive root of all three
+    static const size_t NttMaxLength = size_t(1) << 23;
+
+    static uint32_t powMod(uint32_t b, uint64_t e, uint32_t p) {
+        uint64_t result = 1, base = b;
+        while (e) {
+            if (e & 1)
+                result = result * base % p;
+            base = base * base % p;
+            e >>= 1;
+        }
+        return uint32_t(result);
+    }
+
+    void BigInteger::ntt(std::vector<uint32_t> &a, bool invert, uint32_t p) {
+        size_t n = a.size();
+        for (size_t i = 1, j = 0; i < n; ++i) {
+            size_t bit = n >> 1;
+            for (; j & bit; bit >>= 1) {
+                j ^= bit;
+            }
+            j ^= bit;
+            if (i < j)
+                std::swap(a[i], a[j]);
+        }
+        // roots[half + k] is the k-th power of the len-th root of unity,
+        // len = 2 half; each level is every other root of the one above.
+        // quotients[i] = floor(roots[i] 2^32 / p) turns y roots[i] % p into
+        // two multiplications (Shoup), as p is only known at run time.
+        std::vector<uint32_t> roots(n), quotients(n);
+        if (n >= 2) {
+            uint32_t w = powMod(NttRoot, (p - 1) / n, p);
+            if (invert)
+                w = powMod(w, p - 2, p);
+            roots[n / 2] = 1;
+            for (size_t k = n / 2 + 1; k < n; ++k) {
+                roots[k] = uint32_t(uint64_t(roots[k - 1]) * w % p);
+            }
+            for (size_t k = n / 2; k < n; ++k) {
+                quotients[k] = uint32_t((uint64_t(roots[k]) << 32) / p);
+            }
+            for (size_t k = n / 2 - 1; k > 0; --k) {
+                roots[k] = roots[2 * k];
+                quotients[k] = quotients[2 * k];
+            }
+        }
+        const Parallel &policy = parallelPolicy();
+        const int parts = policy.pool ? int(std::min(policy.pool->size(), 8u)) : 1;
+        std::vector<std::function<void()> > slices(parts);
+        for (size_t half = 1; half < n; half <<= 1) {
+            // Butterfly t pairs i and i + half, k = t % half and i the
+            // k-th element of block t / half; slices take n / 2 / parts each.
+            auto butterflies = [&a, &roots, &quotients, half, p](size_t from, size_t to) {
+                while (from < to) {
+                    size_t k = from & (half - 1), run = std::min(to - from, half - k);
+                    uint32_t *x = &a[2 * from - k], *y = x + half;
+                    const uint32_t *w = &roots[half + k], *q = &quotients[half + k];
+                    for (size_t j = 0; j < run; ++j) {
+                        // y w - floor(y q / 2^32) p lies in [0, 2p)
+                        uint32_t v = y[j] * w[j] - uint32_t(uint64_t(y[j]) * q[j] >> 32) * p;
+                        v = v >= p ? v - p : v;
+                        uint32_t sum = x[j] + v, difference = x[j] + p - v;
+                        x[j] = sum >= p ? sum - p : sum;
+                        y[j] = difference >= p ? difference - p : difference;
+                    }
+                    from += run;
+                }
+            };
+            for (int j = 0; j < parts; ++j) {
+                size_t from = n / 2 * j / parts, to = n / 2 * (j + 1) / parts;
+                slices[j] = [&butterflies, from, to] { butterflies(from, to); };
+            }
+            runAll(slices.data(), parts, n);
+        }
+        if (invert) {
+            uint32_t inv = powMod(uint32_t(n % p), p - 2, p);
+            uint32_t quotient = uint32_t((uint64_t(inv) << 32) / p);
+            for (size_t i = 0; i < n; ++i) {
+                uint32_t v = a[i] * inv - uint32_t(uint64_t(a[i]) * quotient >> 32) * p;
+                a[i] = v >= p ? v - p : v;
+            }
+        }
+    }
+
+    void BigInteger::mulMag(const Limbs &a, const Limbs &b, Limbs &r) {
+        Limbs result;
+        mulRec(a, b, result, &a == &b);
+        r.swap(result);
+    }
+
+    void BigInteger::mulRec(const Limbs &a, const Limbs &b, Limbs &r, bool square) {
+        if (a.size() < b.size()) {
+            mulRec(b, a, r, false);
+            return;
+        }
+        size_t n = a.size(), m = b.size();
+        const Thresholds &t = multiplyThresholds();
+        if (m == 0) {
+            r.clear();
+        } else if (m >= t.ntt && n + m <= NttMaxLength) {
+            nttMul(a, b, r, square);
+        } else if (m < t.karatsuba) {
+            if (square)
+                schoolbookSquare(a, r);
+            else
+                schoolbookMul(a, b, r);
+        } else if (2 * m <= n) {
+            // Lopsided: multiply b by one m-limb piece of a at a time.
+            r.assign(n + m, 0);
+            Limbs product;
+            for (size_t from = 0; from < n; from += m) {
+                mulRec(slice(a, from, m), b, product, false);
+                addShifted(r, product, from);
+            }
+            trim(r);
+        } else if (m < t.toom3) {
+            karatsuba(a, b, r, square);
+        } else {
+            toom3(a, b, r, square);
+        }
+    }
+
+    BigInteger::Limbs BigInteger::slice(const Limbs &a, size_t from, size_t length) {
+        if (from >= a.size())
+            return Limbs();
+        Limbs part(a.begin() + from, a.begin() + std::min(a.size(), from + length));
+        trim(part);
+        return part;
+    }
+
+    void BigInteger::addShifted(Limbs &r, const Limbs &a, size_t shift) {
+        if (r.size() < shift + a.size() + 1)
+            r.resize(shift + a.size() + 1, 0);
+        uint32_t carry = 0;
+        size_t i = 0;
+        for (; i < a.size() || carry; ++i) {
+            if (shift + i == r.size())
+                r.push_back(0);
+            uint32_t sum = r[shift + i] + carry + (i < a.size() ? a[i] : 0);
+            carry = sum >= Base;
+            r[shift + i] = carry ? sum - Base : sum;
+        }
+        trim(r);
+    }
+
+    // Products are summed in 64-bit columns and carried every few rows,
+    // instead of carrying after every single product.
+    void BigInteger::schoolbookMul(const Limbs &a, const Limbs &b, Limbs &r) {
+        const size_t RowsPerCarry = 16;     // 16 * (Base - 1)^2 + Base < 2^64
+        std::vector<uint64_t> acc(a.size() + b.size(), 0);
+        for (size_t i = 0; i < a.size(); ++i) {
+            uint64_t x = a[i];
+            for (size_t j = 0; j < b.size(); ++j) {
+                acc[i + j] += x * b[j];
+            }
+            if ((i + 1) % RowsPerCarry == 0 || i + 1 == a.size()) {
+                uint64_t carry = 0;
+                for (size_t k = 0; k < acc.size(); ++k) {
+                    acc[k] += carry;
+                    carry = acc[k] / Base;
+                    acc[k] %= Base;
+                }
+            }
+        }
+        r.assign(acc.begin(), acc.end());
+        trim(r);
+    }
+
+    // Every cross product is computed once and doubled.
+    void BigInteger::schoolbookSquare(const Limbs &a, Limbs &r) {
+        const size_t RowsPerCarry = 8;      // 8 * 2 * (Base - 1)^2 + Base < 2^64
+        std::vector<uint64_t> acc(2 * a.size(), 0);
+        for (size_t i = 0; i < a.size(); ++i) {
+            uint64_t x = a[i];
+            acc[2 * i] += x * x;
+            uint64_t twice = 2 * x;
+            for (size_t j = i + 1; j < a.size(); ++j) {
+                acc[i + j] += twice * a[j];
+            }
+            if ((i + 1) % RowsPerCarry == 0 || i + 1 == a.size()) {
+                uint64_t carry = 0;
+                for (size_t k = 0; k < acc.size(); ++k) {
+                    acc[k] += carry;
+                    carry = acc[k] / Base;
+                    acc[k] %= Base;
+                }
+            }
+        }
+        r.assign(acc.begin(), acc.end());
+        trim(r);
+    }
+
+    // (a1 B + a0)(b1 B + b0) with three half-size products,
+    // z1 = (a0 + a1)(b0 + b1) - z0 - z2.
+    void BigInteger::karatsuba(const Limbs &a, const Limbs &b, Limbs &r, bool square) {
+        size_t k = a.size() / 2;
+        Limbs a0 = slice(a, 0, k), a1 = slice(a, k, a.size());
+        Limbs b0, b1, z0, z1, z2, sumA, sumB;
+        addMag(a0, a1, sumA);
+        if (!square) {
+            b0 = slice(b, 0, k);
+            b1 = slice(b, k, b.size());
+            addMag(b0, b1, sumB);
+        }
+        // Squares pass the same limbs twice.
+        const Limbs &c0 = square ? a0 : b0, &c1 = square ? a1 : b1;
+        const Limbs &sumC = square ? sumA : sumB;
+        std::function<void()> jobs[3] = {
+                [&] { mulRec(a0, c0, z0, square); },
+                [&] { mulRec(a1, c1, z2, square); },
+                [&] { mulRec(sumA, sumC, z1, square); }
+        };
+        runAll(jobs, 3, b.size());
+        subMag(z1, z0, z1);
+        subMag(z1, z2, z1);
+        r.assign(a.size() + b.size() + 1, 0);
+        addShifted(r, z0, 0);
+        addShifted(r, z1, k);
+        addShifted(r, z2, 2 * k);
+        trim(r);
+    }
+
+    BigInteger BigInteger::signedProduct(const BigInteger &x, const BigInteger &y, bool square) {
+        BigInteger result;
+        Limbs sx, sy, r;
+        const Limbs &a = x.mag(sx);
+        mulRec(a, square ? a : y.mag(sy), r, square);
+        result.setMag(r, !square && x.isNegative() != y.isNegative());
+        return result;
+    }
+
+    void BigInteger::runAll(std::function<void()> jobs[], int count, size_t size) {
+        const Parallel &policy = parallelPolicy();
+        // Each level multiplies the tasks by count, so 1 + log2(pool size)
+        // levels are enough to keep every thread busy.
+        int budget = 1;
+        for (unsigned n = policy.pool ? policy.pool->size() : 0; n > 1; n >>= 1) {
+            ++budget;
+        }
+        if (!policy.pool || size < policy.cutoff || forkDepth() >= budget) {
+            for (int i = 0; i < count; ++i) {
+                jobs[i]();
+            }
+            return;
+        }
+        // Runs a job one level deeper, on whichever thread takes it.
+        struct Level {
+            int saved;
+            explicit Level(int depth) : saved(forkDepth()) { forkDepth() = depth; }
+            ~Level() { forkDepth() = saved; }
+        };
+        const int depth = forkDepth() + 1;
+        std::vector<std::future<void> > pending;
+        for (int i = 0; i + 1 < count; ++i) {
+            std::function<void()> &job = jobs[i];
+            pending.push_back(policy.pool->submit([&job, depth] {
+                Level level(depth);
+                job();
+            }));
+        }
+        // The jobs refer to the caller's locals: wait for all of them
+        // even if one throws.
+        std::exception_ptr error;
+        try {
+            Level level(depth);
+            jobs[count - 1]();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        for (size_t i = 0; i < pending.size(); ++i) {
+            try {
+                policy.pool->wait(pending[i]);
+            } catch (...) {
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    // Toom-Cook 3-way: evaluate both operands at 0, 1, -1, -2 and infinity,
+    // multiply pointwise and interpolate (Bodrato's sequence).
+    void BigInteger::toom3(const Limbs &a, const Limbs &b, Limbs &r, bool square) {
+        size_t k = (a.size() + 2) / 3;
+        BigInteger x[3], y[3];
+        for (int i = 0; i < 3; ++i) {
+            Limbs part = slice(a, i * k, k);
+            x[i].setMag(part, false);
+            part = slice(b, i * k, k);
+            y[i].setMag(part, false);
+        }
+        auto evaluate = [](const BigInteger p[3], BigInteger &one, BigInteger &minusOne,
+                           BigInteger &minusTwo) {
+            BigInteger even = p[0] + p[2];
+            one = even + p[1];
+            minusOne = even - p[1];
+            minusTwo = minusOne + p[2];
+            minusTwo = minusTwo + minusTwo - p[0];
+        };
+        BigInteger x1, xm1, xm2, y1, ym1, ym2;
+        evaluate(x, x1, xm1, xm2);
+        if (!square)
+            evaluate(y, y1, ym1, ym2);
+
+        BigInteger r0, r1, rm1, rm2, rInf;
+        std::function<void()> jobs[5] = {
+                [&] { r0 = signedProduct(x[0], y[0], square); },
+                [&] { r1 = signedProduct(x1, y1, square); },
+                [&] { rm1 = signedProduct(xm1, ym1, square); },
+                [&] { rm2 = signedProduct(xm2, ym2, square); },
+                [&] { rInf = signedProduct(x[2], y[2], square); }
+        };
+        runAll(jobs, 5, b.size());
+
+        auto divideExact = [](BigInteger &v, uint32_t d) {
+            Limbs scratch;
+            Limbs m = v.mag(scratch);
+            divSmall(m, d);
+            v.setMag(m, v.isNegative());
+        };
+        BigInteger r3 = rm2 - r1;
+        divideExact(r3, 3);
+        BigInteger r1h = r1 - rm1;
+        divideExact(r1h, 2);
+        BigInteger r2 = rm1 - r0;
+        r3 = r2 - r3;
+        divideExact(r3, 2);
+        r3 = r3 + rInf + rInf;
+        r2 = r2 + r1h - rInf;
+        r1 = r1h - r3;
+
+        Limbs scratch;
+        r.assign(a.size() + b.size() + 1, 0);
+        addShifted(r, r0.mag(scratch), 0);
+        addShifted(r, r1.mag(scratch), k);
+        addShifted(r, r2.mag(scratch), 2 * k);
+        addShifted(r, r3.mag(scratch), 3 * k);
+        addShifted(r, rInf.mag(scratch), 4 * k);
+        trim(r);
+    }
+
+    // Convolves the limbs modulo each prime, rebuilds the exact coefficients
+    // with the Chinese remainder theorem (Garner) and carries in base 10^9.
+    void BigInteger::nttMul(const Limbs &a, const Limbs &b, Limbs &r, bool square) {
+        size_t need = a.size() + b.size() - 1, n = 1;
+        while (n < need) {
+            n <<= 1;
+        }
+        std::vector<uint32_t> conv[3];
+        auto convolve = [&](int k) {
+            uint32_t p = NttPrimes[k];
+            std::vector<uint32_t> fa(n, 0);
+            for (size_t i = 0; i < a.size(); ++i) {
+                fa[i] = a[i] % p;
+            }
+            ntt(fa, false, p);
+            if (square) {
+                for (size_t i = 0; i < n; ++i) {
+                    fa[i] = uint32_t(uint64_t(fa[i]) * fa[i] % p);
+                }
+            } else {
+                std::vector<uint32_t> fb(n, 0);
+                for (size_t i = 0; i < b.size(); ++i) {
+                    fb[i] = b[i] % p;
+                }
+                ntt(fb, false, p);
+                for (size_t i = 0; i < n; ++i) {
+                    fa[i] = uint32_t(uint64_t(fa[i]) * fb[i] % p);
+                }
+            }
+            ntt(fa, true, p);
+            conv[k].swap(fa);
+        };
+        std::function<void()> jobs[3] = {
+                [&] { convolve(0); }, [&] { convolve(1); }, [&] { convolve(2); }
+        };
+        runAll(jobs, 3, b.size());
+
+        const uint64_t p0 = NttPrimes[0], p1 = NttPrimes[1], p2 = NttPrimes[2];
+        const uint64_t inv01 = powMod(uint32_t(p0 % p1), p1 - 2, uint32_t(p1));
+        const uint64_t inv02 = powMod(uint32_t(p0 % p2), p2 - 2, uint32_t(p2));
+        const uint64_t inv12 = powMod(uint32_t(p1 % p2), p2 - 2, uint32_t(p2));
+        r.assign(need + 3, 0);
+        unsigned __int128 carry = 0;
+        for (size_t i = 0; i < need; ++i) {
+            uint64_t x0 = conv[0][i];
+            uint64_t x1 = (conv[1][i] + p1 - x0 % p1) % p1 * inv01 % p1;
+            uint64_t x2 = (conv[2][i] + p2 - x0 % p2) % p2 * inv02 % p2;
+            x2 = (x2 + p2 - x1 % p2) % p2 * inv12 % p2;
+            unsigned __int128 value = x0 + (unsigned __int128) x1 * p0 +
+                                      (unsigned __int128) x2 * p0 * p1 + carry;
+            r[i] = uint32_t(value % Base);
+            carry = value / Base;
+        }
+        for (size_t i = need; carry; ++i) {
+            r[i] = uint32_t(carry % Base);
+            carry /= Base;
+        }
+        trim(r);
+    }
+
+    // a /= d, returns a % d.
+    uint32_t BigInteger::divSmall(Limbs &a, uint32_t d) {
+        uint64_t rem = 0;
+        for (size_t i = a.size(); i > 0; --i) {
+            uint64_t cur = a[i - 1] + rem * Base;
+            a[i - 1] = uint32_t(cur / d);
+            rem = cur % d;
+        }
+        trim(a);
+        return uint32_t(rem);
+    }
+
+    void BigInteger::mulSmall(Limbs &a, uint32_t m) {
+        uint64_t carry = 0;
+        for (size_t i = 0; i < a.size(); ++i) {
+            uint64_t cur = uint64_t(a[i]) * m + carry;
+            a[i] = uint32_t(cur % Base);
+            carry = cur / Base;
+        }
+        if (carry)
+            a.push_back(uint32_t(carry));
+        trim(a);
+    }
+
+    void BigInteger::divMag(const Limbs &a, const Limbs &b, Limbs &q, Limbs &r) {
+        if (compareMag(a, b) < 0) {
+            Limbs rem = a;
+            q.clear();
+            r.swap(rem);
+            return;
+        }
+        size_t n = b.size();
+        if (n < DivideThreshold || a.size() - n < DivideThreshold) {
+            divKnuth(a, b, q, r);
+            return;
+        }
+        // Scale so the top limb of the divisor is at least Base / 2, then
+        // feed the dividend to div2n1n n limbs at a time, top first.
+        uint32_t d = Base / (b.back() + 1);
+        Limbs u = a, v = b, quotient, digit, rem, chunk;
+        mulSmall(u, d);
+        mulSmall(v, d);
+        size_t chunks = (u.size() + n - 1) / n;
+        quotient.assign(chunks * n + 1, 0);
+        for (size_t k = chunks; k > 0; --k) {
+            chunk = slice(u, (k - 1) * n, n);
+            rem.insert(rem.begin(), n, 0);
+            addShifted(rem, chunk, 0);
+            div2n1n(rem, v, n, digit, rem);
+            addShifted(quotient, digit, (k - 1) * n);
+        }
+        trim(quotient);
+        divSmall(rem, d);
+        q.swap(quotient);
+        r.swap(rem);
+    }
+
+    // Knuth, TAOCP vol. 2, 4.3.1, algorithm D.
+    void BigInteger::divKnuth(const Limbs &a, const Limbs &b, Limbs &q, Limbs &r) {
+        if (compareMag(a, b) < 0) {
+            Limbs rem = a;
+            q.clear();
+            r.swap(rem);
+            return;
+        }
+        if (b.size() == 1) {
+            Limbs quotient = a;
+            uint32_t rem = divSmall(quotient, b[0]);
+            q.swap(quotient);
+            r.clear();
+            if (rem)
+                r.push_back(rem);
+            return;
+        }
+        size_t n = b.size(), m = a.size() - n;
+        uint32_t d = Base / (b.back() + 1);
+        Limbs u = a, v = b, quotient(m + 1, 0);
+        mulSmall(u, d);
+        mulSmall(v, d);
+        u.resize(a.size() + 1, 0);
+        const uint64_t vTop = v[n - 1], vNext = v[n - 2];
+        for (size_t j = m + 1; j-- > 0;) {
+            uint64_t num = uint64_t(u[j + n]) * Base + u[j + n - 1];
+            uint64_t qhat = num / vTop, rhat = num % vTop;
+            while (qhat >= Base || qhat * vNext > rhat * Base + u[j + n - 2]) {
+                --qhat;
+                rhat += vTop;
+                if (rhat >= Base)
+                    break;
+            }
+            // u[j .. j+n] -= qhat * v
+            uint64_t carry = 0;
+            int64_t borrow = 0;
+            for (size_t i = 0; i < n; ++i) {
+                uint64_t product = qhat * v[i] + carry;
+                carry = product / Base;
+                int64_t t = int64_t(u[i + j]) - int64_t(product % Base) - borrow;
+                borrow = t < 0;
+                u[i + j] = uint32_t(t < 0 ? t + Base : t);
+            }
+            int64_t top = int64_t(u[j + n]) - int64_t(carry) - borrow;
+            if (top < 0) {
+                // qhat was one too large: add v back.
+                u[j + n] = uint32_t(top + Base);
+                --qhat;
+                uint32_t c = 0;
+                for (size_t i = 0; i < n; ++i) {
+                    uint32_t sum = u[i + j] + v[i] + c;
+                    c = sum >= Base;
+                    u[i + j] = c ? sum - Base : sum;
+                }
+                u[j + n] = (u[j + n] + c) % Base;
+            } else {
+                u[j + n] = uint32_t(top);
+            }
+            quotient[j] = uint32_t(qhat);
+        }
+        trim(quotient);
+        u.resize(n);
+        trim(u);
+        divSmall(u, d);
+        q.swap(quotient);
+        r.swap(u);
+    }
+
+    // a < b * Base^n, b has n limbs and a normalised top limb.
+    void BigInteger::div2n1n(const Limbs &a, const Limbs &b, size_t n, Limbs &q, Limbs &r) {
+        if (a.size() <= n + DivideThreshold) {
+            divKnuth(a, b, q, r);
+            return;
+        }
+        Limbs u = a, v = b;
+        bool pad = n & 1;
+        if (pad) {
+            // Shifting by a whole limb keeps the divisor normalised.
+            u.insert(u.begin(), 0);
+            v.insert(v.begin(), 0);
+            ++n;
+        }
+        size_t half = n / 2;
+        Limbs b1 = slice(v, half, half), b2 = slice(v, 0, half);
+        Limbs q1, q2, rem;
+        div3n2n(slice(u, n, u.size()), slice(u, half, half), v, b1, b2, half, q1, rem);
+        div3n2n(rem, slice(u, 0, half), v, b1, b2, half, q2, rem);
+        if (pad && !rem.empty())
+            rem.erase(rem.begin());
+        q.assign(n + 1, 0);
+        addShifted(q, q1, half);
+        addShifted(q, q2, 0);
+        trim(q);
+        r.swap(rem);
+    }
+
+    // Divides [a12, a3] (a3 has n limbs) by b = [b1, b2]; the quotient
+    // fits in n limbs.
+    void BigInteger::div3n2n(const Limbs &a12, const Limbs &a3, const Limbs &b,
+                             const Limbs &b1, const Limbs &b2, size_t n,
+                             Limbs &q, Limbs &r) {
+        Limbs quotient, rem;
+        if (compareMag(slice(a12, n, a12.size()), b1) == 0) {
+            // Quotient would be Base^n or more: take Base^n - 1.
+            quotient.assign(n, Base - 1);
+            Limbs shifted(n, 0);
+            shifted.insert(shifted.end(), b1.begin(), b1.end());
+            addMag(a12, b1, rem);
+            subMag(rem, shifted, rem);
+        } else {
+            div2n1n(a12, b1, n, quotient, rem);
+        }
+        // rem * Base^n + a3 - quotient * b2, fixed up while negative.
+        rem.insert(rem.begin(), n, 0);
+        addShifted(rem, a3, 0);
+        Limbs product;
+        mulMag(quotient, b2, product);
+        const Limbs one(1, 1);
+        while (compareMag(rem, product) < 0) {
+            subMag(quotient, one, quotient);
+            addMag(rem, b, rem);
+        }
+        subMag(rem, product, rem);
+        q.swap(quotient);
+        r.swap(rem);
+    }
+
     int BigInteger::compare(const BigInteger &bi) const {
+        if (!big && !bi.big)
+            return (small > bi.small) - (small < bi.small);
+        // A big value lies beyond every small one.
+        if (!bi.big)
+            return negative ? -1 : 1;
+        if (!big)
+            return bi.negative ? 1 : -1;
         if (negative && !bi.negative)
             return -1;
         if (bi.negative && !negative)
             return 1;
 
-        int result = 0;
-        if (value.length() < bi.value.length()) {
-            result = -1;
-        } else if (value.length() > bi.value.length()) {
-            result = 1;
-        } else {
-            result = value.compare(bi.value);
-        }
+        int result = compareMag(limbs, bi.limbs);
         if (negative)
             result = -result;
         return result;
     }
 
     BigInteger BigInteger::absolute() const {
-        if (negative)
+        if (isNegative())
             return -*this;
         return *this;
     }
 
     int BigInteger::compareAbs(const BigInteger &bi) const {
-        return this->absolute().compare(bi.absolute());
+        if (!big && !bi.big) {
+            uint64_t a = smallAbs(), b = bi.smallAbs();
+            return (a > b) - (a < b);
+        }
+        if (!bi.big)
+            return compareMag(limbs, bi.smallAbs());
+        if (!big)
+            return -compareMag(bi.limbs, smallAbs());
+        return compareMag(limbs, bi.limbs);
     }
 
-    BigInteger BigInteger::operator+(const BigInteger &bi) const {
-        // TODO 大数加法
-        using std::reverse;
-        BigInteger result;
-        string lhs = value, rhs = bi.value;
-        reverse(lhs.begin(), lhs.end());
-        reverse(rhs.begin(), rhs.end());
-        if (this->negative == bi.negative) {
-            // Adding
-            result.value = "";
-            unsigned long length = std::min(lhs.length(), rhs.length());
-            int i = 0;
-            for (; i < length; i++) {
-                // Roughly adding each digit, not caring carrying.
-                result.value.push_back(lhs[i] - '0' + rhs[i]);
-            }
-
-            if (length < lhs.length()) {
-                result.value += lhs.substr(i);
-            } else if (length < rhs.length()) {
-                result.value += rhs.substr(i);
-            }
-
-            int carry = 0;
-            for (auto &c : result.value) {
-                int temp = c + carry - '0';
-                carry = temp / 10;
-                temp %= 10;
-                c = temp + '0';
-            }
-            if (carry != 0) {
-                result.value.push_back('1');
-            }
-            result.negative = negative;
+    void BigInteger::addSigned(const BigInteger &bi, bool subtract) {
+        bool aNeg = isNegative(), bNeg = bi.isNegative() != subtract;
+        if (!bi.big) {
+            // Read before limbs changes: bi may be *this.
+            uint64_t u = bi.smallAbs();
+            if (!big)
+                toLimbs(smallAbs(), limbs);
+            // Two small values only get here when they overflow, which
+            // needs equal signs, so a subtraction always has a big *this
+            // and |*this| >= u.
+            if (aNeg == bNeg)
+                addSmall(limbs, u);
+            else
+                subSmall(limbs, u);
+            normalize(aNeg);
+            return;
+        }
+        if (!big)
+            toLimbs(smallAbs(), limbs);
+        if (aNeg == bNeg) {
+            addMag(limbs, bi.limbs, limbs);
+            normalize(aNeg);
+            return;
+        }
+        int flag = compareMag(limbs, bi.limbs);
+        if (flag < 0) {
+            subMag(bi.limbs, limbs, limbs);
+            normalize(bNeg);
+        } else if (flag > 0) {
+            subMag(limbs, bi.limbs, limbs);
+            normalize(aNeg);
         } else {
-            // Subtracting
+            limbs.clear();
+            normalize(false);
+        }
+    }
 
-            int flag = compareAbs(bi);
-            if (flag == -1) {
-                return bi + *this;
-            } else if (!flag) {
-                return BigInteger("0");
-            } else {
-                result.value = "";
-                unsigned long length = std::min(lhs.length(), rhs.length());
-                int i = 0;
-                for (; i < length; ++i) {
-                    // Roughly subtracting each digit, not caring carrying.
-                    result.value.push_back(lhs[i] - (rhs[i] - '0'));
-                }
+    BigInteger &BigInteger::operator+=(const BigInteger &bi) {
+        int64_t sum;
+        if (!big && !bi.big && !__builtin_add_overflow(small, bi.small, &sum))
+            small = sum;
+        else
+            addSigned(bi, false);
+        return *this;
+    }
 
-                if (i < lhs.length()) {
-                    result.value += lhs.substr(i);
-                }
-//            std::cout << result.value << std::endl;
-                int carry = 0;
-                for (auto &c : result.value) {
-                    int temp = c - carry - '0';
-                    carry = (temp < 0);
-                    temp = carry * 10 + temp;
-                    c = temp + '0';
-                }
-                result.negative = negative;
-            }
-        }
-        reverse(result.value.begin(), result.value.end());
-        auto valid = result.value.find_first_not_of('0');
-        if (valid == string::npos) {
-            return BigInteger("0");
-        }
-        result.value = result.value.substr(valid);
+    BigInteger &BigInteger::operator-=(const BigInteger &bi) {
+        int64_t difference;
+        if (!big && !bi.big && !__builtin_sub_overflow(small, bi.small, &difference))
+            small = difference;
+        else
+            addSigned(bi, true);
+        return *this;
+    }
+
+    BigInteger &BigInteger::operator*=(const BigInteger &bi) {
+        int64_t product;
+        if (!big && !bi.big && !__builtin_mul_overflow(small, bi.small, &product))
+            small = product;
+        else
+            *this = *this * bi;
+        return *this;
+    }
+
+    BigInteger &BigInteger::operator/=(const BigInteger &bi) {
+        if (!big && !bi.big && bi.small != 0 && !(small == INT64_MIN && bi.small == -1))
+            small /= bi.small;
+        else
+            *this = *this / bi;
+        return *this;
+    }
+
+    BigInteger BigInteger::operator+(const BigInteger &bi) const {
+        BigInteger result(*this);
+        result += bi;
         return result;
     }
 
     std::ostream &BigInteger::show(std::ostream &os) const {
-        if (negative)
-            os << '-';
-        os << value;
+        if (!big)
+            return os << small;
+        string digits(length(), '0');
+        format(&digits[0]);
+        os << digits;
         return os;
     }
 
+    size_t BigInteger::length() const {
+        size_t n = isNegative() ? 1 : 0;
+        if (!big) {
+            uint64_t u = smallAbs();
+            do {
+                ++n;
+                u /= 10;
+            } while (u);
+            return n;
+        }
+        n += (limbs.size() - 1) * BaseDigits;
+        for (uint32_t top = limbs.back(); top; top /= 10) {
+            ++n;
+        }
+        return n;
+    }
+
+    // Base 10^9 limbs are already decimal: every limb but the top one is
+    // exactly nine digits, filled in from the end of the buffer.
+    size_t BigInteger::format(char *buffer) const {
+        size_t n = length();
+        char *p = buffer + n;
+        if (!big) {
+            uint64_t u = smallAbs();
+            do {
+                *--p = char('0' + u % 10);
+                u /= 10;
+            } while (u);
+        } else {
+            for (size_t i = 0; i + 1 < limbs.size(); ++i) {
+                uint32_t limb = limbs[i];
+                for (int j = 0; j < BaseDigits; ++j) {
+                    *--p = char('0' + limb % 10);
+                    limb /= 10;
+                }
+            }
+            for (uint32_t top = limbs.back(); top; top /= 10) {
+                *--p = char('0' + top % 10);
+            }
+        }
+        if (isNegative())
+            *--p = '-';
+        return n;
+    }
+
     BigInteger BigInteger::operator-(const BigInteger &bi) const {
-        return (*this + (-bi));
+        BigInteger result(*this);
+        result -= bi;
+        return result;
     }
 
     BigInteger BigInteger::operator-() const {
-        auto ret = BigInteger(*this);
-        ret.negative = !negative;
+        BigInteger ret;
+        if (!big && small != INT64_MIN) {
+            ret.small = -small;
+            return ret;
+        }
+        Limbs scratch;
+        Limbs m = mag(scratch);
+        ret.setMag(m, !isNegative());
         return ret;
     }
 
@@ -241,114 +1225,229 @@ namespace bigInteger {
     }
 
     BigInteger BigInteger::operator*(const BigInteger &bi) const {
-        using std::reverse;
-        if (this->value == "0" || bi.value == "0") {
-            return BigInteger("0");
+        BigInteger result;
+        if (!big && !bi.big && !__builtin_mul_overflow(small, bi.small, &result.small))
+            return result;
+        Limbs sa, sb, r;
+        const Limbs &a = mag(sa);
+        // Passing the same limbs twice lets mulMag square.
+        mulMag(a, &bi == this ? a : bi.mag(sb), r);
+        result.setMag(r, isNegative() != bi.isNegative());
+        return result;
+    }
+
+    void BigInteger::divMod(const BigInteger &bi, BigInteger &quotient,
+                            BigInteger &remainder) const {
+        if (bi.isZero()) {
+            throw DivideByZero();
         }
-        BigInteger result = BigInteger();
-        if (this->negative != bi.negative) {
-            result.negative = true;
-        }
-        string lhs = value, rhs = bi.value;
-        reverse(lhs.begin(), lhs.end());
-        reverse(rhs.begin(), rhs.end());
-        result.value.resize(lhs.length() + rhs.length(), '0');
-
-        // Loop for multiplying
-        for (int i = 0; i < lhs.length(); i++) {
-            for (int j = 0; j < rhs.length(); j++) {
-                int temp = (result.value[i + j] - '0') +
-                           (lhs[i] - '0') * (rhs[j] - '0');
-                int carry = temp / 10;
-                result.value[i + j] = temp % 10 + '0';
-                // Adding carrying to every digit
-                for (int higherDigits = i + j + 1;
-                     carry != 0 && higherDigits < result.value.length();
-                     higherDigits++) {
-                    int renewal = result.value[higherDigits] - '0' + carry;
-                    carry = renewal / 10;
-                    result.value[higherDigits] = renewal % 10 + '0';
-                }
-            }
+        // INT64_MIN / -1 is the one small quotient that does not fit.
+        if (!big && !bi.big && !(small == INT64_MIN && bi.small == -1)) {
+            int64_t q = small / bi.small, r = small % bi.small;
+            quotient = BigInteger();
+            quotient.small = q;
+            remainder = BigInteger();
+            remainder.small = r;
+            return;
         }
-
-        reverse(result.value.begin(), result.value.end());
-        result.value = result.value.substr(result.value.find_first_not_of('0'));
-        return result;
+        bool qNegative = isNegative() ^ bi.isNegative(), rNegative = isNegative();
+        Limbs sa, sb, q, r;
+        divMag(mag(sa), bi.mag(sb), q, r);
+        quotient.setMag(q, qNegative);
+        remainder.setMag(r, rNegative);
     }
 
 // Throws DivideByZero exception
     BigInteger BigInteger::operator/(const BigInteger &bi) const {
-        if (bi.value == "0") {
-            throw DivideByZero();
-        }
+        BigInteger quotient, remainder;
+        divMod(bi, quotient, remainder);
+        return quotient;
+    }
 
-        // Integer division, return 0 if |*this| < |bi|
-        int cmp = this->compareAbs(bi);
-        if (cmp == -1) {
-            return BigInteger("0");
+// Throws DivideByZero exception
+    BigInteger BigInteger::operator%(const BigInteger &bi) const {
+        BigInteger quotient, remainder;
+        divMod(bi, quotient, remainder);
+        return remainder;
+    }
+
+    void BigInteger::bitsOf(const Limbs &a, Bits &bits) {
+        const uint32_t Chunk = 1u << 30;
+        Limbs rest = a;
+        bits.clear();
+        while (!rest.empty()) {
+            uint32_t low = divSmall(rest, Chunk);
+            for (int i = 0; i < 30; ++i) {
+                bits.push_back((low >> i) & 1u);
+            }
         }
+        while (!bits.empty() && bits.back() == 0) {
+            bits.pop_back();
+        }
+    }
 
-        BigInteger result("0");
-        if (cmp == 0) {
-            result = BigInteger("1");
-        } else {
-            BigInteger absLhs(this->absolute()), absRhs(bi.absolute());
-            const BigInteger kTen("10");
-            for (int loopCount = int(value.length() - bi.value.length());
-                 loopCount >= 0;
-                 --loopCount) {
-                BigInteger temp(absRhs);
-                for (int i = 0; i < loopCount; ++i) {
-                    temp = temp * kTen;
-                }
+    // Left-to-right sliding window: the exponent is read in windows of up
+    // to w bits ending in a one, each costing one multiplication by a
+    // precomputed odd power. multiply(a, b, r) may reduce its result.
+    template<class Multiply>
+    void BigInteger::slidingWindowPow(const Limbs &x, const Bits &bits,
+                                      Multiply multiply, Limbs &r) {
+        if (bits.empty()) {
+            r.assign(1, 1);
+            return;
+        }
+        int w = bits.size() > 640 ? 6 : bits.size() > 240 ? 5 :
+                bits.size() > 80 ? 4 : bits.size() > 24 ? 3 : bits.size() > 6 ? 2 : 1;
+        std::vector<Limbs> odd(size_t(1) << (w - 1));
+        odd[0] = x;
+        if (odd.size() > 1) {
+            Limbs square;
+            multiply(x, x, square);
+            for (size_t k = 1; k < odd.size(); ++k) {
+                multiply(odd[k - 1], square, odd[k]);
+            }
+        }
 
-                int divider = 0;
-                while (absLhs.compareAbs(temp) >= 0) {
-                    absLhs = absLhs - temp;
-                    ++divider;
+        Limbs result;
+        bool started = false;
+        long i = long(bits.size()) - 1;
+        while (i >= 0) {
+            if (!bits[i]) {
+                multiply(result, result, result);
+                --i;
+                continue;
+            }
+            long j = std::max(i - w + 1, 0L);
+            while (!bits[j]) {
+                ++j;
+            }
+            uint32_t window = 0;
+            for (long k = i; k >= j; --k) {
+                window = window << 1 | bits[k];
+            }
+            if (started) {
+                for (long k = i; k >= j; --k) {
+                    multiply(result, result, result);
                 }
-                result = result * kTen + BigInteger(divider);
+                multiply(result, odd[window >> 1], result);
+            } else {
+                result = odd[window >> 1];
+                started = true;
             }
+            i = j - 1;
         }
-        result.negative = negative ^ bi.negative;
-        return result;
+        r.swap(result);
     }
 
-// Throws DivideByZero exception
-    BigInteger BigInteger::operator%(const BigInteger &bi) const {
-        BigInteger divider = *this / bi;
-        return (*this - divider * bi);
+    // Barrett reduction modulo m with mu = floor(Base^2k / m), k limbs in m:
+    // reduces anything below Base^2k with two multiplications.
+    class BigInteger::Barrett {
+    public:
+        explicit Barrett(const Limbs &modulus) : m(modulus), k(modulus.size()) {
+            Limbs power(2 * k + 1, 0), rem;
+            power.back() = 1;
+            divMag(power, m, mu, rem);
+        }
+
+        void reduce(Limbs &x) const {
+            if (compareMag(x, m) < 0)
+                return;
+            Limbs q, product;
+            mulMag(slice(x, k - 1, x.size()), mu, q);
+            mulMag(slice(q, k + 1, q.size()), m, product);
+            subMag(x, product, x);
+            while (compareMag(x, m) >= 0) {
+                subMag(x, m, x);
+            }
+        }
+
+        void multiply(const Limbs &a, const Limbs &b, Limbs &r) const {
+            mulMag(a, b, r);
+            reduce(r);
+        }
+
+    private:
+        Limbs m, mu;
+        size_t k;
+    };
+
+    BigInteger BigInteger::pow(uint64_t exponent) const {
+        Bits bits;
+        for (; exponent; exponent >>= 1) {
+            bits.push_back(exponent & 1u);
+        }
+        BigInteger result;
+        bool odd = !bits.empty() && bits[0];
+        Limbs scratch, r;
+        slidingWindowPow(mag(scratch), bits, [](const Limbs &a, const Limbs &b, Limbs &r) {
+            mulMag(a, b, r);
+        }, r);
+        trim(r);
+        result.setMag(r, isNegative() && odd);
+        return result;
     }
 
     BigInteger BigInteger::operator^(const BigInteger &bi) const {
-        BigInteger kZero("0");
-        int powZero = bi.compare(kZero);
-        int thisIsZero = compare(kZero);
-        if (thisIsZero == 0) {
-            if (powZero <= 0) {
+        if (isZero()) {
+            if (bi.isNegative() || bi.isZero()) {
                 throw DivideByZero();
             } else {
                 return BigInteger("0");
             }
-        } else if (powZero == 0) {
+        } else if (bi.isZero()) {
             return BigInteger("1");
-        } else if (powZero < 0) {
+        } else if (bi.isNegative()) {
             std::cerr
                     << "Warning: Integer to negative power always evaluate to zero\n";
             return BigInteger("0");
         }
 
-        BigInteger result("1");
-        BigInteger lhs = *this, rhs = bi;
-        while (rhs.compare(kZero) > 0) {
-            bool isOdd = (unsigned) (rhs.value.back() - '0') & 1u;
-            if (isOdd) {
-                result = result * lhs;
+        Bits bits;
+        Limbs scratch, r;
+        bitsOf(bi.mag(scratch), bits);
+        BigInteger result;
+        slidingWindowPow(mag(scratch), bits, [](const Limbs &a, const Limbs &b, Limbs &r) {
+            mulMag(a, b, r);
+        }, r);
+        result.setMag(r, isNegative() && bits[0]);
+        return result;
+    }
+
+    BigInteger BigInteger::modPow(const BigInteger &exp, const BigInteger &mod) const {
+        if (isZero() && (exp.isNegative() || exp.isZero())) {
+            throw DivideByZero();
+        }
+        if (mod.isZero()) {
+            throw DivideByZero();
+        }
+        if (exp.isNegative()) {
+            std::cerr
+                    << "Warning: Integer to negative power always evaluate to zero\n";
+            return BigInteger("0");
+        }
+        BigInteger result;
+        if (!big && !exp.big && !mod.big) {
+            uint64_t m = mod.smallAbs(), b = smallAbs() % m, r = 1 % m;
+            for (uint64_t e = exp.smallAbs(); e; e >>= 1) {
+                if (e & 1u)
+                    r = uint64_t((unsigned __int128) r * b % m);
+                b = uint64_t((unsigned __int128) b * b % m);
             }
-            lhs = lhs * lhs;
-            rhs = rhs / BigInteger("2");
+            result.small = int64_t(r);
+            return (isNegative() && (exp.small & 1)) ? -result : result;
         }
+        Limbs sa, sm, base, quotient, r;
+        const Limbs &m = mod.mag(sm);
+        divMag(mag(sa), m, quotient, base);
+        Barrett barrett(m);
+        Bits bits;
+        bitsOf(exp.mag(sa), bits);
+        slidingWindowPow(base, bits, [&barrett](const Limbs &a, const Limbs &b, Limbs &r) {
+            barrett.multiply(a, b, r);
+        }, r);
+        barrett.reduce(r);
+        trim(r);
+        result.setMag(r, isNegative() && !bits.empty() && bits[0]);
         return result;
     }
 
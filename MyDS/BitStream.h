@@ -0,0 +1,138 @@
+//
+// Created by Zhengyi on 2020/12/16.
+//
+
+#ifndef DATASTRUCTURE_BITSTREAM_H
+#define DATASTRUCTURE_BITSTREAM_H
+
+#include <cstring>
+#include <cstdint>
+
+/// Writes bit fields most significant bit first into a growing byte buffer.
+/// Bits gather in a 64-bit word, which is stored eight bytes at a time.
+class BitWriter {
+public:
+    BitWriter() : buffer(new unsigned char[InitSize]), used(0),
+                  capacity(InitSize), bits(0), count(0) { }
+    ~BitWriter() { delete[] buffer; }
+    BitWriter(const BitWriter &) = delete;
+    BitWriter &operator=(const BitWriter &) = delete;
+
+    // n <= 32
+    void write(uint32_t value, int n);
+    // Pads the last byte with zeros; call before reading data().
+    void finish();
+    void clear() { used = 0; bits = 0; count = 0; }
+
+    const unsigned char *data() const { return buffer; }
+    size_t size() const { return used; }
+
+private:
+    static constexpr size_t InitSize = 1 << 12;
+    unsigned char *buffer;
+    size_t used;
+    size_t capacity;
+    uint64_t bits;      // pending bits, right aligned
+    int count;
+
+    void reserve(size_t n);
+    void flushWord();
+};
+
+/// Reads what BitWriter wrote. Past the end it yields zero bits.
+class BitReader {
+public:
+    BitReader(const unsigned char *begin, size_t n) :
+            p(begin), end(begin + n), window(0), avail(0) { }
+
+    // Tops up the window to at least 56 bits.
+    void refill();
+    // n in 1..32, window must hold n bits (see refill).
+    uint32_t peek(int n) const { return uint32_t(window >> (64 - n)); }
+    void consume(int n) { window <<= n; avail -= n; }
+    uint32_t read(int n);
+    int available() const { return avail; }
+
+private:
+    const unsigned char *p;
+    const unsigned char *end;
+    uint64_t window;    // unread bits, left aligned
+    int avail;
+};
+
+inline void BitWriter::reserve(size_t n) {
+    if (used + n <= capacity)
+        return;
+    while (used + n > capacity) {
+        capacity *= 2;
+    }
+    auto temp = new unsigned char[capacity];
+    std::memcpy(temp, buffer, used);
+    delete[] buffer;
+    buffer = temp;
+}
+
+inline void BitWriter::flushWord() {
+    reserve(8);
+    for (int i = 0; i < 8; ++i) {
+        buffer[used + i] = (unsigned char) (bits >> (56 - 8 * i));
+    }
+    used += 8;
+}
+
+inline void BitWriter::write(uint32_t value, int n) {
+    if (count + n < 64) {
+        bits = (bits << n) | value;
+        count += n;
+        return;
+    }
+    int first = 64 - count;
+    int rest = n - first;
+    bits = (bits << first) | (uint64_t(value) >> rest);
+    flushWord();
+    bits = rest ? (value & ((1u << rest) - 1)) : 0;
+    count = rest;
+}
+
+inline void BitWriter::finish() {
+    reserve(8);
+    while (count >= 8) {
+        count -= 8;
+        buffer[used++] = (unsigned char) (bits >> count);
+    }
+    if (count > 0)
+        buffer[used++] = (unsigned char) (bits << (8 - count));
+    bits = 0;
+    count = 0;
+}
+
+inline void BitReader::refill() {
+    if (end - p >= 8) {
+        uint64_t word = 0;
+        for (int i = 0; i < 8; ++i) {
+            word = (word << 8) | p[i];
+        }
+        // Bits past avail may be loaded already; ORing them again is harmless.
+        window |= word >> avail;
+        int take = (63 - avail) >> 3;
+        p += take;
+        avail += take * 8;
+    } else {
+        while (avail <= 56 && p < end) {
+            window |= uint64_t(*p++) << (56 - avail);
+            avail += 8;
+        }
+        if (p == end && avail <= 56)
+            avail = 64;         // zeros from here on
+    }
+}
+
+inline uint32_t BitReader::read(int n) {
+    if (avail < n)
+        refill();
+    uint32_t v = peek(n);
+    consume(n);
+    return v;
+}
+
+#endif //DATASTRUCTURE_BITSTREAM_H
@@ -0,0 +1,87 @@
+//
+// Created by Zhengyi on 2020/12/18.
+//
+
+#ifndef DATASTRUCTURE_BUFFEREDWRITER_H
+#define DATASTRUCTURE_BUFFEREDWRITER_H
+
+#include <cstring>
+#include <string>
+#include <iostream>
+
+/// Collects output in a fixed buffer and hands it to the stream in big
+/// chunks, so printing millions of short lines does not flush per line.
+class BufferedWriter {
+public:
+    explicit BufferedWriter(std::ostream &o) : os(o), used(0) { }
+    ~BufferedWriter() { flush(); }
+
+    BufferedWriter(const BufferedWriter &) = delete;
+    BufferedWriter &operator=(const BufferedWriter &) = delete;
+
+    void write(const char *s, size_t n);
+    void put(char c);
+    void flush();
+
+    BufferedWriter &operator<<(char c) { put(c); return *this; }
+    BufferedWriter &operator<<(const char *s) { write(s, std::strlen(s)); return *this; }
+    BufferedWriter &operator<<(const std::string &s) { write(s.data(), s.length()); return *this; }
+    BufferedWriter &operator<<(long long i);
+    BufferedWriter &operator<<(int i) { return *this << (long long) i; }
+
+    // Anything else is printed by the stream itself, after what we hold.
+    template<class T>
+    BufferedWriter &operator<<(const T &t) {
+        flush();
+        os << t;
+        return *this;
+    }
+
+private:
+    static constexpr size_t BufferSize = 1 << 16;
+    std::ostream &os;
+    size_t used;
+    char buffer[BufferSize];
+};
+
+inline void BufferedWriter::write(const char *s, size_t n) {
+    if (used + n > BufferSize) {
+        flush();
+        if (n > BufferSize) {
+            os.write(s, n);
+            return;
+        }
+    }
+    std::memcpy(buffer + used, s, n);
+    used += n;
+}
+
+inline void BufferedWriter::put(char c) {
+    if (used == BufferSize)
+        flush();
+    buffer[used++] = c;
+}
+
+inline void BufferedWriter::flush() {
+    if (used > 0) {
+        os.write(buffer, used);
+        used = 0;
+    }
+}
+
+inline BufferedWriter &BufferedWriter::operator<<(long long i) {
+    char digits[24];
+    int n = 0;
+    unsigned long long u = i < 0 ? 0ull - (unsigned long long) i : i;
+    do {
+        digits[n++] = char('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (i < 0)
+        put('-');
+    while (n > 0)
+        put(digits[--n]);
+    return *this;
+}
+
+#endif //DATASTRUCTURE_BUFFEREDWRITER_H
@@ -0,0 +1,53 @@
+//
+// Created by Zhengyi on 2020/12/22.
+//
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "HuffmanCompressor.h"
+
+// HuffmanCompressor c|d <input> <output> works on files,
+// without arguments a generated log is packed and checked.
+int main(int argc, char *argv[]) {
+    ThreadPool pool;
+    if (argc == 4) {
+        std::ifstream in(argv[2], std::ios::binary);
+        std::ofstream out(argv[3], std::ios::binary);
+        HuffmanCompressor compressor(pool);
+        if (std::strcmp(argv[1], "c") == 0)
+            compressor.compress(in, out);
+        else
+            compressor.decompress(in, out);
+        return 0;
+    }
+
+    std::ostringstream log;
+    for (int i = 0; i < 200000; ++i) {
+        log << "2020-12-22 10:" << i % 60 << ":" << i % 7 << " INFO worker-"
+            << i % 13 << " handled request " << i * 7919 % 100003 << "\n";
+    }
+    std::string text = log.str();
+
+    std::istringstream in(text);
+    std::stringstream packed;
+    HuffmanCompressor compressor(pool, 1 << 16);
+    compressor.compress(in, packed);
+    std::cout << text.size() << " bytes -> " << packed.str().size()
+              << " bytes on " << pool.size() << " threads" << std::endl;
+
+    std::ostringstream back;
+    compressor.decompress(packed, back);
+    std::cout << (back.str() == text ? "ok" : "MISMATCH") << std::endl;
+
+    // Random access: decode only the block holding one position.
+    HuffmanArchive archive(packed);
+    uint64_t position = text.size() / 2;
+    Bytes block;
+    archive.readBlock(archive.blockOf(position), block);
+    uint64_t start = archive.blockOf(position) * archive.blockSize();
+    bool same = std::memcmp(block.data(), text.data() + start, block.size()) == 0;
+    std::cout << archive.blockCount() << " blocks, block "
+              << archive.blockOf(position) << (same ? " ok" : " MISMATCH") << std::endl;
+}
@@ -0,0 +1,317 @@
+//
+// Created by Zhengyi on 2020/12/22.
+//
+
+#ifndef DATASTRUCTURE_HUFFMANCOMPRESSOR_H
+#define DATASTRUCTURE_HUFFMANCOMPRESSOR_H
+
+#include <cstring>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "HuffmanTree.h"
+#include "ThreadPool.h"
+
+/*
+ * Container layout, all integers little endian:
+ *   "MHUF" u32 blockSize
+ *   block*             u8 mode, u32 rawSize, then
+ *                        mode 0: rawSize stored bytes
+ *                        mode 1: 128 bytes of 4 bit code lengths,
+ *                                u32 payloadSize, payload
+ *   index              per block: u64 offset, u32 packedSize, u32 rawSize
+ *   u64 indexOffset, u64 blockCount, "MHUF"
+ * Every block but the last holds exactly blockSize input bytes, so the
+ * block of any input position is position / blockSize.
+ */
+
+typedef std::vector<unsigned char> Bytes;
+
+template<class T>
+inline void storeLittle(Bytes &out, T v) {
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        out.push_back((unsigned char) (v >> (8 * i)));
+    }
+}
+
+template<class T>
+inline T loadLittle(const unsigned char *p) {
+    T v = 0;
+    for (size_t i = sizeof(T); i > 0; --i) {
+        v = (v << 8) | p[i - 1];
+    }
+    return v;
+}
+
+/// Splits a stream into blocks, each with its own code, and packs them on
+/// a thread pool. Only a few blocks per worker are held at any time.
+class HuffmanCompressor {
+public:
+    static constexpr uint32_t DefaultBlockSize = 1 << 20;
+
+    explicit HuffmanCompressor(ThreadPool &p, uint32_t size = DefaultBlockSize);
+
+    void compress(std::istream &in, std::ostream &out);
+    // in must be seekable, see HuffmanArchive.
+    void decompress(std::istream &in, std::ostream &out);
+
+    static void packBlock(const unsigned char *p, size_t n, Bytes &out);
+    static void unpackBlock(const unsigned char *p, size_t n, Bytes &out);
+
+private:
+    ThreadPool &pool;
+    uint32_t blockSize;
+};
+
+/// Reads the index at the end of a container, so any block can be decoded
+/// on its own.
+class HuffmanArchive {
+public:
+    explicit HuffmanArchive(std::istream &i);
+
+    uint64_t blockCount() const { return index.size(); }
+    uint32_t blockSize() const { return block; }
+    uint64_t rawSize() const;
+    uint64_t blockOf(uint64_t position) const { return position / block; }
+
+    void readBlock(uint64_t i, Bytes &out);
+    // Decodes blocks [first, last) on the pool and writes them in order.
+    void extract(ThreadPool &pool, std::ostream &out, uint64_t first, uint64_t last);
+
+private:
+    struct Entry {
+        uint64_t offset;
+        uint32_t packed;
+        uint32_t raw;
+    };
+
+    std::istream &in;
+    std::vector<Entry> index;
+    uint32_t block;
+
+    void load(uint64_t i, Bytes &packed);
+};
+
+inline HuffmanCompressor::HuffmanCompressor(ThreadPool &p, uint32_t size) :
+        pool(p), blockSize(size) {
+    if (blockSize == 0)
+        throw HuffmanTreeException("Block size must be positive.");
+}
+
+inline void HuffmanCompressor::packBlock(const unsigned char *p, size_t n,
+                                         Bytes &out) {
+    // Four tables break the dependency between equal neighbouring bytes.
+    uint32_t counts[4][256] = {{0}};
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        ++counts[0][p[i]];
+        ++counts[1][p[i + 1]];
+        ++counts[2][p[i + 2]];
+        ++counts[3][p[i + 3]];
+    }
+    for (; i < n; ++i) {
+        ++counts[0][p[i]];
+    }
+    uint64_t freq[256];
+    for (int s = 0; s < 256; ++s) {
+        freq[s] = uint64_t(counts[0][s]) + counts[1][s] + counts[2][s] + counts[3][s];
+    }
+
+    HuffmanCode code(freq, 256);
+    uint64_t bits = 0;
+    for (int s = 0; s < 256; ++s) {
+        bits += freq[s] * code.lengthOf(s);
+    }
+
+    size_t start = out.size();
+    bool store = 128 + 4 + (bits + 7) / 8 >= n;
+    out.push_back(store ? 0 : 1);
+    storeLittle<uint32_t>(out, uint32_t(n));
+    if (store) {
+        out.insert(out.end(), p, p + n);
+        return;
+    }
+    for (int s = 0; s < 256; s += 2) {
+        out.push_back((unsigned char) (code.lengthOf(s) << 4 | code.lengthOf(s + 1)));
+    }
+    BitWriter w;
+    code.encode(p, n, w);
+    w.finish();
+    storeLittle<uint32_t>(out, uint32_t(w.size()));
+    out.reserve(start + 1 + 4 + 128 + 4 + w.size());
+    out.insert(out.end(), w.data(), w.data() + w.size());
+}
+
+inline void HuffmanCompressor::unpackBlock(const unsigned char *p, size_t n,
+                                           Bytes &out) {
+    if (n < 5)
+        throw HuffmanTreeException("Corrupt block.");
+    unsigned char mode = p[0];
+    uint32_t raw = loadLittle<uint32_t>(p + 1);
+    p += 5;
+    n -= 5;
+    out.resize(raw);
+    if (mode == 0) {
+        if (n != raw)
+            throw HuffmanTreeException("Corrupt block.");
+        std::memcpy(out.data(), p, raw);
+        return;
+    }
+    if (mode != 1 || n < 128 + 4)
+        throw HuffmanTreeException("Corrupt block.");
+    unsigned char lengths[256];
+    for (int s = 0; s < 256; s += 2) {
+        lengths[s] = p[s / 2] >> 4;
+        lengths[s + 1] = p[s / 2] & 0xf;
+    }
+    uint32_t payload = loadLittle<uint32_t>(p + 128);
+    if (payload != n - 128 - 4)
+        throw HuffmanTreeException("Corrupt block.");
+    HuffmanCode code(lengths, 256);
+    BitReader r(p + 128 + 4, payload);
+    code.decode(r, out.data(), raw);
+}
+
+inline void HuffmanCompressor::compress(std::istream &in, std::ostream &out) {
+    Bytes head;
+    head.insert(head.end(), {'M', 'H', 'U', 'F'});
+    storeLittle<uint32_t>(head, blockSize);
+    out.write((const char *) head.data(), head.size());
+
+    Bytes index;
+    uint64_t offset = head.size();
+    uint64_t blocks = 0;
+    std::deque<std::future<Bytes> > inFlight;
+    std::deque<uint32_t> rawSizes;
+    const size_t window = 2 * pool.size();
+
+    auto writeOldest = [&]() {
+        Bytes packed = inFlight.front().get();
+        inFlight.pop_front();
+        out.write((const char *) packed.data(), packed.size());
+        storeLittle<uint64_t>(index, offset);
+        storeLittle<uint32_t>(index, uint32_t(packed.size()));
+        storeLittle<uint32_t>(index, rawSizes.front());
+        rawSizes.pop_front();
+        offset += packed.size();
+        ++blocks;
+    };
+
+    while (in) {
+        auto raw = std::make_shared<Bytes>(blockSize);
+        in.read((char *) raw->data(), blockSize);
+        size_t n = size_t(in.gcount());
+        if (n == 0)
+            break;
+        raw->resize(n);
+        if (inFlight.size() == window)
+            writeOldest();
+        rawSizes.push_back(uint32_t(n));
+        inFlight.push_back(pool.submit([raw]() {
+            Bytes packed;
+            packBlock(raw->data(), raw->size(), packed);
+            return packed;
+        }));
+    }
+    while (!inFlight.empty())
+        writeOldest();
+
+    Bytes tail;
+    storeLittle<uint64_t>(tail, offset);
+    storeLittle<uint64_t>(tail, blocks);
+    tail.insert(tail.end(), {'M', 'H', 'U', 'F'});
+    out.write((const char *) index.data(), index.size());
+    out.write((const char *) tail.data(), tail.size());
+    out.flush();
+}
+
+inline void HuffmanCompressor::decompress(std::istream &in, std::ostream &out) {
+    HuffmanArchive archive(in);
+    archive.extract(pool, out, 0, archive.blockCount());
+}
+
+inline HuffmanArchive::HuffmanArchive(std::istream &i) : in(i), block(0) {
+    const size_t TailSize = 8 + 8 + 4;
+    unsigned char head[8], tail[TailSize];
+    in.seekg(0, std::ios::end);
+    std::streamoff end = in.tellg();
+    in.seekg(0);
+    if (end < std::streamoff(sizeof(head) + TailSize) ||
+        !in.read((char *) head, sizeof(head)) ||
+        std::memcmp(head, "MHUF", 4) != 0)
+        throw HuffmanTreeException("Not a Huffman container.");
+    block = loadLittle<uint32_t>(head + 4);
+
+    in.seekg(end - std::streamoff(TailSize));
+    in.read((char *) tail, TailSize);
+    uint64_t indexOffset = loadLittle<uint64_t>(tail);
+    uint64_t count = loadLittle<uint64_t>(tail + 8);
+    if (!in || std::memcmp(tail + 16, "MHUF", 4) != 0 ||
+        indexOffset + count * 16 + TailSize != uint64_t(end))
+        throw HuffmanTreeException("Damaged container index.");
+
+    Bytes raw(count * 16);
+    in.seekg(std::streamoff(indexOffset));
+    in.read((char *) raw.data(), raw.size());
+    index.resize(count);
+    for (uint64_t k = 0; k < count; ++k) {
+        const unsigned char *p = raw.data() + 16 * k;
+        index[k] = Entry{loadLittle<uint64_t>(p), loadLittle<uint32_t>(p + 8),
+                         loadLittle<uint32_t>(p + 12)};
+        if (index[k].offset + index[k].packed > indexOffset)
+            throw HuffmanTreeException("Damaged container index.");
+    }
+}
+
+inline uint64_t HuffmanArchive::rawSize() const {
+    uint64_t total = 0;
+    for (size_t k = 0; k < index.size(); ++k) {
+        total += index[k].raw;
+    }
+    return total;
+}
+
+inline void HuffmanArchive::load(uint64_t i, Bytes &packed) {
+    if (i >= index.size())
+        throw HuffmanTreeException("Block out of range.");
+    packed.resize(index[i].packed);
+    in.seekg(std::streamoff(index[i].offset));
+    if (!in.read((char *) packed.data(), packed.size()))
+        throw HuffmanTreeException("Truncated block.");
+}
+
+inline void HuffmanArchive::readBlock(uint64_t i, Bytes &out) {
+    Bytes packed;
+    load(i, packed);
+    HuffmanCompressor::unpackBlock(packed.data(), packed.size(), out);
+}
+
+inline void HuffmanArchive::extract(ThreadPool &pool, std::ostream &out,
+                                    uint64_t first, uint64_t last) {
+    std::deque<std::future<Bytes> > inFlight;
+    const size_t window = 2 * pool.size();
+    auto writeOldest = [&]() {
+        Bytes raw = inFlight.front().get();
+        inFlight.pop_front();
+        out.write((const char *) raw.data(), raw.size());
+    };
+    for (uint64_t i = first; i < last; ++i) {
+        auto packed = std::make_shared<Bytes>();
+        load(i, *packed);
+        if (inFlight.size() == window)
+            writeOldest();
+        inFlight.push_back(pool.submit([packed]() {
+            Bytes raw;
+            HuffmanCompressor::unpackBlock(packed->data(), packed->size(), raw);
+            return raw;
+        }));
+    }
+    while (!inFlight.empty())
+        writeOldest();
+    out.flush();
+}
+
+#endif //DATASTRUCTURE_HUFFMANCOMPRESSOR_H
@@ -2,24 +2,65 @@
 // Created by Zhengyi on 2020/12/15.
 //
 
+#include <cstring>
+#include <iostream>
 #include "HuffmanTree.h"
 
 int main() {
-    MinHeap<int, Less<int> > maxHeap;
     int a[] = {1, 1, 4, 5, 1, 2, 1, 3};
-    for (int i : a) {
-        maxHeap.push(i);
+    HuffmanTree<int> tree(a, 8);
+    std::cout << "cost " << tree.cost() << ", total " << tree.value() << std::endl;
+    int len[8];
+    tree.codeLengths(len);
+    for (int i = 0; i < 8; ++i) {
+        std::cout << a[i] << ":" << len[i] << " ";
     }
-    int cost = 0;
-    for (int j = 0; j < 7; ++j) {
-        int f = maxHeap.peek();
-        maxHeap.pop();
-        int s = maxHeap.peek();
-        maxHeap.pop();
-        int ncost = f + s;
-        cost += ncost;
-        std::cout << f <<" "<<s<<" "<< ncost << std::endl;
-        maxHeap.push(ncost);
+    std::cout << std::endl;
+
+    // Round trip a message through a canonical code.
+    const char *msg = "abracadabra, a huffman code is canonical when its codes "
+                      "follow from the lengths alone";
+    size_t n = std::strlen(msg);
+    uint64_t freq[256] = {0};
+    for (size_t i = 0; i < n; ++i) {
+        ++freq[(unsigned char) msg[i]];
+    }
+    HuffmanCode encoder(freq, 256);
+    BitWriter out;
+    encoder.encode((const unsigned char *) msg, n, out);
+    out.finish();
+    std::cout << n << " bytes -> " << out.size() << " bytes" << std::endl;
+
+    HuffmanCode decoder(encoder.lengths(), 256);
+    BitReader in(out.data(), out.size());
+    auto back = new unsigned char[n + 1];
+    decoder.decode(in, back, n);
+    back[n] = 0;
+    std::cout << back << std::endl;
+    std::cout << (std::memcmp(back, msg, n) == 0 ? "ok" : "MISMATCH") << std::endl;
+    delete[] back;
+
+    // Fibonacci weights give a 40 deep tree; the code must still fit.
+    uint64_t fib[40];
+    fib[0] = fib[1] = 1;
+    for (int i = 2; i < 40; ++i) {
+        fib[i] = fib[i - 1] + fib[i - 2];
+    }
+    HuffmanCode limited(fib, 40);
+    int longest = 0;
+    for (int i = 0; i < 40; ++i) {
+        longest = std::max(longest, limited.lengthOf(i));
+    }
+    std::cout << "longest code " << longest << std::endl;
+    BitWriter w;
+    for (int i = 0; i < 40; ++i) {
+        limited.encode(i, w);
+    }
+    w.finish();
+    BitReader r(w.data(), w.size());
+    bool ok = true;
+    for (int i = 0; i < 40; ++i) {
+        ok = ok && limited.decode(r) == i;
     }
-    std::cout << cost << std::endl;
+    std::cout << (ok ? "ok" : "MISMATCH") << std::endl;
 }
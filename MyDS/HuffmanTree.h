@@ -5,104 +5,322 @@
 #ifndef DATASTRUCTURE_HUFFMANTREE_H
 #define DATASTRUCTURE_HUFFMANTREE_H
 
-#include "MinHeap.h"
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include "Vector.h"
+#include "BitStream.h"
 
-template <class ElemType>
-class HuffmanTree {
-    struct HuffmanTreeNode {
-        typedef HuffmanTreeNode node;
-        ElemType data;
-        HuffmanTreeNode *leftChild, *rightChild, *parent;
-        HuffmanTreeNode() :
-            leftChild(nullptr),
-            rightChild(nullptr),
-            parent(nullptr) { }
-
-        explicit HuffmanTreeNode(const ElemType& d, HuffmanTreeNode* l = nullptr,
-                HuffmanTreeNode* r = nullptr, HuffmanTreeNode* p = nullptr) :
-                    data(d),
-                    leftChild(l),
-                    rightChild(r),
-                    parent(p) { }
-
-        bool operator <(const node& other) const { return data < other.data; }
-        HuffmanTreeNode &operator=(const HuffmanTreeNode& other) {
-            if (&other == this)
-                return *this;
-            leftChild = other.leftChild; rightChild = other.rightChild;
-            parent = other.parent;
-            data = other.data;
-            return *this;
-        }
+class HuffmanTreeException : public std::exception {
+public:
+    explicit HuffmanTreeException(const char* s) : content(s) { }
+    const char *what() const _NOEXCEPT override {
+        return content;
     };
 
+    const char* content;
+};
+
+template <class ElemType>
+class HuffmanTree {
 public:
-    typedef HuffmanTreeNode Node;
+    // All nodes live in one array: the leaves in input order, then the
+    // merged nodes in the order they were made, so the root comes last.
+    struct Node {
+        ElemType weight;
+        int leftChild, rightChild, parent;
+    };
 
-    explicit HuffmanTree(Vector<ElemType> vec);
-    HuffmanTree(ElemType arr[], int n);
-    ~HuffmanTree() = default;
+    explicit HuffmanTree(const Vector<ElemType> &vec);
+    HuffmanTree(const ElemType arr[], int n);
+    ~HuffmanTree() { delete[] nodes; }
+    HuffmanTree(const HuffmanTree &) = delete;
+    HuffmanTree &operator=(const HuffmanTree &) = delete;
 
-    ElemType value() const ;
+    ElemType value() const;
     ElemType cost() const;
 
+    int leafCount() const { return leaves; }
+    int rootIndex() const { return 2 * leaves - 2; }
+    const Node &operator[](int i) const { return nodes[i]; }
+    // Depth of every leaf, i.e. its code length. A lone leaf gets 1.
+    void codeLengths(int lengths[]) const;
+
 private:
-    Node *root;
-    Vector<ElemType> costReg;
-    void merge(Node *n1, Node *n2, Node*& par);
+    Node *nodes;
+    int leaves;
+    void build(const ElemType arr[], int n);
 };
 
+// Two-queue construction: leaves are taken in weight order and merged
+// nodes come out in weight order by themselves, so after sorting (skipped
+// when the input already is) every step is O(1).
 template<class ElemType>
-void HuffmanTree<ElemType>::merge(Node *n1, Node *n2, Node *&par) {
-    par = new Node(n1->data + n2->data, n1, n2);
-    n2->parent = par;
-    n1->parent = par;
+void HuffmanTree<ElemType>::build(const ElemType arr[], int n) {
+    if (n <= 0)
+        throw HuffmanTreeException("Building Huffman tree with no weights.");
+    leaves = n;
+    nodes = new Node[2 * n - 1];
+    auto order = new int[n];
+    bool sorted = true;
+    for (int i = 0; i < n; ++i) {
+        nodes[i] = Node{arr[i], -1, -1, -1};
+        order[i] = i;
+        if (i > 0 && arr[i] < arr[i - 1])
+            sorted = false;
+    }
+    if (!sorted) {
+        std::stable_sort(order, order + n, [arr](int a, int b) {
+            return arr[a] < arr[b];
+        });
+    }
+
+    int leaf = 0, merged = n, next = n;
+    // Ties go to the leaf, which keeps the longest code short.
+    auto takeMin = [&]() -> int {
+        if (leaf < n && (merged == next ||
+                         !(nodes[merged].weight < nodes[order[leaf]].weight)))
+            return order[leaf++];
+        return merged++;
+    };
+    for (; next < 2 * n - 1; ++next) {
+        int first = takeMin();
+        int second = takeMin();
+        nodes[next] = Node{nodes[first].weight + nodes[second].weight,
+                           first, second, -1};
+        nodes[first].parent = next;
+        nodes[second].parent = next;
+    }
+    delete[] order;
 }
 
 template<class ElemType>
-HuffmanTree<ElemType>::HuffmanTree(ElemType *arr, int n) {
-    MinHeap<Node> mh;
-    Node first, second, *parent = nullptr;
-    for (int i = 0; i < n; ++i) {
-        mh.push(Node(arr[i]));
-    }
-    for (int j = 0; j < n-1; ++j) {
-        first = mh.peek();
-        std::cout << "first: " << first.data << "\t";
-        mh.pop();
-        second = mh.peek();
-        std::cout << "second: " << second.data << "\t";
-        mh.pop();
-        merge(&first, &second, parent);
-        mh.push(*parent);
-        costReg.pushBack(parent->data);
-        std::cout << "parent: " << parent->data << "\n";
-        delete parent;
-    }
-
-    root = parent;
+HuffmanTree<ElemType>::HuffmanTree(const ElemType *arr, int n) : nodes(nullptr) {
+    build(arr, n);
 }
 
 template<class ElemType>
-HuffmanTree<ElemType>::HuffmanTree(Vector<ElemType> vec) :
-    HuffmanTree(vec.data, vec.length()) {
-    // empty
+HuffmanTree<ElemType>::HuffmanTree(const Vector<ElemType> &vec) : nodes(nullptr) {
+    int n = vec.length();
+    auto arr = new ElemType[n > 0 ? n : 1];
+    for (int i = 0; i < n; ++i) {
+        arr[i] = vec[i];
+    }
+    try {
+        build(arr, n);
+    } catch (HuffmanTreeException &e) {
+        delete[] arr;
+        throw;
+    }
+    delete[] arr;
 }
 
-
 template<class ElemType>
 ElemType HuffmanTree<ElemType>::value() const {
-    return root->data;
+    return nodes[rootIndex()].weight;
 }
 
 template<class ElemType>
 ElemType HuffmanTree<ElemType>::cost() const {
-    ElemType c;
-    for (int i = 0; i < costReg.length(); ++i) {
-        c = c + costReg[i];
+    ElemType c = ElemType();
+    for (int i = leaves; i <= rootIndex(); ++i) {
+        c = c + nodes[i].weight;
     }
     return c;
 }
 
+template<class ElemType>
+void HuffmanTree<ElemType>::codeLengths(int lengths[]) const {
+    if (leaves == 1) {
+        lengths[0] = 1;
+        return;
+    }
+    // Parents come after their children, so one backward sweep will do.
+    auto depth = new int[2 * leaves - 1];
+    depth[rootIndex()] = 0;
+    for (int i = rootIndex(); i >= leaves; --i) {
+        depth[nodes[i].leftChild] = depth[i] + 1;
+        depth[nodes[i].rightChild] = depth[i] + 1;
+    }
+    for (int i = 0; i < leaves; ++i) {
+        lengths[i] = depth[i];
+    }
+    delete[] depth;
+}
+
+
+/// Canonical Huffman code over symbols 0..n-1, limited to MaxLength bits so
+/// a single lookup table indexed by the next maxLength bits decodes any symbol.
+class HuffmanCode {
+public:
+    static constexpr int MaxLength = 15;
+
+    // Encoder side: symbols with zero frequency get no code.
+    HuffmanCode(const uint64_t freq[], int n);
+    // Decoder side: rebuilds the same code from the stored lengths.
+    HuffmanCode(const unsigned char lengths[], int n);
+    ~HuffmanCode();
+    HuffmanCode(const HuffmanCode &) = delete;
+    HuffmanCode &operator=(const HuffmanCode &) = delete;
+
+    int symbolCount() const { return symbols; }
+    int lengthOf(int s) const { return length[s]; }
+    uint32_t codeOf(int s) const { return code[s]; }
+    const unsigned char *lengths() const { return length; }
+
+    void encode(int s, BitWriter &out) const { out.write(code[s], length[s]); }
+    int decode(BitReader &in) const;
+    void encode(const unsigned char *in, size_t n, BitWriter &out) const;
+    void decode(BitReader &in, unsigned char *out, size_t n) const;
+
+private:
+    int symbols;
+    unsigned char *length;
+    uint32_t *code;
+    int tableBits;
+    uint32_t *table;            // symbol << 8 | length
+
+    void limitLengths(const uint64_t freq[]);
+    void assignCodes();
+};
+
+inline HuffmanCode::HuffmanCode(const uint64_t freq[], int n) :
+        symbols(n), length(new unsigned char[n]), code(new uint32_t[n]),
+        tableBits(0), table(nullptr) {
+    auto used = new int[n];
+    auto weight = new uint64_t[n];
+    int m = 0;
+    for (int i = 0; i < n; ++i) {
+        length[i] = 0;
+        if (freq[i] > 0) {
+            used[m] = i;
+            weight[m++] = freq[i];
+        }
+    }
+    if (m > 0) {
+        HuffmanTree<uint64_t> tree(weight, m);
+        auto depth = new int[m];
+        tree.codeLengths(depth);
+        for (int i = 0; i < m; ++i) {
+            // Clamped here, repaired by limitLengths.
+            length[used[i]] = (unsigned char) std::min(depth[i], MaxLength + 1);
+        }
+        delete[] depth;
+    }
+    delete[] used;
+    delete[] weight;
+    limitLengths(freq);
+    assignCodes();
+}
+
+inline HuffmanCode::HuffmanCode(const unsigned char lengths[], int n) :
+        symbols(n), length(new unsigned char[n]), code(new uint32_t[n]),
+        tableBits(0), table(nullptr) {
+    uint64_t kraft = 0;
+    for (int i = 0; i < n; ++i) {
+        if (lengths[i] > MaxLength)
+            throw HuffmanTreeException("Code length out of range.");
+        length[i] = lengths[i];
+        if (length[i])
+            kraft += uint64_t(1) << (MaxLength - length[i]);
+    }
+    if (kraft > (uint64_t(1) << MaxLength))
+        throw HuffmanTreeException("Code lengths do not form a prefix code.");
+    assignCodes();
+}
+
+inline HuffmanCode::~HuffmanCode() {
+    delete[] length;
+    delete[] code;
+    delete[] table;
+}
+
+// Cut every length to MaxLength, then lengthen the rarest of the longest
+// remaining codes until the Kraft sum fits again.
+inline void HuffmanCode::limitLengths(const uint64_t freq[]) {
+    const uint64_t limit = uint64_t(1) << MaxLength;
+    uint64_t kraft = 0;
+    bool tooLong = false;
+    for (int i = 0; i < symbols; ++i) {
+        if (length[i] > MaxLength) {
+            length[i] = MaxLength;
+            tooLong = true;
+        }
+        if (length[i])
+            kraft += uint64_t(1) << (MaxLength - length[i]);
+    }
+    if (!tooLong)
+        return;
+    while (kraft > limit) {
+        int pick = -1;
+        for (int i = 0; i < symbols; ++i) {
+            if (length[i] == 0 || length[i] == MaxLength)
+                continue;
+            if (pick < 0 || length[i] > length[pick] ||
+                (length[i] == length[pick] && freq[i] < freq[pick]))
+                pick = i;
+        }
+        ++length[pick];
+        kraft -= uint64_t(1) << (MaxLength - length[pick]);
+    }
+}
+
+inline void HuffmanCode::assignCodes() {
+    int count[MaxLength + 1] = {0};
+    uint32_t next[MaxLength + 1];
+    tableBits = 0;
+    for (int i = 0; i < symbols; ++i) {
+        ++count[length[i]];
+        tableBits = std::max(tableBits, int(length[i]));
+    }
+    count[0] = 0;
+    uint32_t c = 0;
+    for (int len = 1; len <= MaxLength; ++len) {
+        c = (c + count[len - 1]) << 1;
+        next[len] = c;
+    }
+    for (int i = 0; i < symbols; ++i) {
+        code[i] = length[i] ? next[length[i]]++ : 0;
+    }
+
+    delete[] table;
+    table = nullptr;
+    if (tableBits == 0)
+        return;
+    table = new uint32_t[size_t(1) << tableBits]();
+    for (int i = 0; i < symbols; ++i) {
+        if (length[i] == 0)
+            continue;
+        int spare = tableBits - length[i];
+        uint32_t base = code[i] << spare;
+        for (uint32_t j = 0; j < (1u << spare); ++j) {
+            table[base + j] = uint32_t(i) << 8 | length[i];
+        }
+    }
+}
+
+inline int HuffmanCode::decode(BitReader &in) const {
+    if (in.available() < tableBits)
+        in.refill();
+    uint32_t entry = table[in.peek(tableBits)];
+    in.consume(entry & 0xff);
+    return int(entry >> 8);
+}
+
+inline void HuffmanCode::encode(const unsigned char *in, size_t n,
+                                BitWriter &out) const {
+    for (size_t i = 0; i < n; ++i) {
+        out.write(code[in[i]], length[in[i]]);
+    }
+}
+
+inline void HuffmanCode::decode(BitReader &in, unsigned char *out,
+                                size_t n) const {
+    if (n > 0 && table == nullptr)
+        throw HuffmanTreeException("Decoding with an empty code.");
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = (unsigned char) decode(in);
+    }
+}
 
 #endif //DATASTRUCTURE_HUFFMANTREE_H
@@ -4,6 +4,13 @@
 
 #include "MultiTree.h"
 
+struct SumAggregate {
+    typedef long long Value;
+    static Value identity() { return 0; }
+    static Value of(int d) { return d; }
+    static Value combine(Value a, Value b) { return a + b; }
+};
+
 int main() {
     MultiTree<int> mt(4);
     MultiTree<int>::Node* n = mt.trivialFind(4);
@@ -16,11 +23,40 @@ int main() {
     MultiTree<int>::insertChild(ci, 693);
     MultiTree<int>::insertSibling(ci, 687);
     mt.show(std::cout);
+    for (MultiTree<int>::PreorderIterator it(mt.getRoot(), true); !it.isEnd(); ++it) {
+        std::cout << it->data << ' ';
+    }
+    std::cout << std::endl;
+    for (MultiTree<int>::PostorderIterator it(mt.getRoot(), true); !it.isEnd(); ++it) {
+        std::cout << it->data << ' ';
+    }
+    std::cout << std::endl;
+    for (MultiTree<int>::LevelOrderIterator it(mt.getRoot(), true); !it.isEnd(); ++it) {
+        std::cout << it->data << ' ';
+    }
+    std::cout << std::endl;
+    mt.enableAncestorIndex();
+    auto deep = mt.trivialFind(693);
+    std::cout << MultiTree<int>::lowestCommonAncestor(deep, mt.trivialFind(687))->data
+              << ' ' << MultiTree<int>::kthAncestor(deep, 1)->data
+              << ' ' << MultiTree<int>::isDescendantOf(deep, sib)
+              << ' ' << MultiTree<int>::isDescendantOf(deep, n) << std::endl;
+    std::cout << MultiTree<int>::descendantCount(sib) << ' '
+              << MultiTree<int>::heightOf(sib) << std::endl;
     Vector<int> temp;
-    MultiTree<int>::dismissSubTree(sib, temp);
+    mt.dismissSubTree(sib, temp);
     std::cout << std::endl;
     temp.show(std::cout);
     std::cout << std::endl;
     mt.show(std::cout);
+
+    MultiTree<int, SumAggregate> sums(1);
+    auto top = sums.getRoot();
+    auto mid = MultiTree<int, SumAggregate>::insertChild(top, 10);
+    MultiTree<int, SumAggregate>::insertChild(mid, 100);
+    MultiTree<int, SumAggregate>::insertChild(top, 1000);
+    std::cout << MultiTree<int, SumAggregate>::summaryOf(top) << ' ';
+    sums.dismissSubTree(mid);
+    std::cout << MultiTree<int, SumAggregate>::summaryOf(top) << std::endl;
     return 0;
 }
\ No newline at end of file
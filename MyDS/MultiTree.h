@@ -8,7 +8,9 @@
 #include <exception>
 #include <stdexcept>
 #include <iostream>
+#include <utility>
 #include "Vector.h"
+#include "BufferedWriter.h"
 
 using std::exception;
 
@@ -22,15 +24,28 @@ public:
     const char* content;
 };
 
+// Summary kept for every subtree besides its size and height. Plug in a
+// commutative monoid: identity(), of(data) and combine(a, b).
 template <class Type>
+struct NoAggregate {
+    struct Value { };
+    static Value identity() { return Value(); }
+    static Value of(const Type &) { return Value(); }
+    static Value combine(const Value &, const Value &) { return Value(); }
+};
+
+template <class Type, class Aggregate = NoAggregate<Type> >
 class MultiTree {
 public:
     struct Node {
         Node(const Type& d, Node* par,
                 Node * child = nullptr, Node * sib = nullptr) :
-            data(d), firstChild(child), sibling(sib), parent(par) {
+            data(d), firstChild(child), sibling(sib), parent(par),
+            depth(-1), jump(nullptr),
+            descendants(0), height(0), summary(Aggregate::of(d)) {
             // Empty
         }
+        ~Node() { delete[] jump; }
         Type data;
         Node * firstChild;
         Node * sibling;
@@ -39,6 +54,77 @@ public:
         Node * insertSibling(const Type &d);
         Node *leftMostOf();
         Node *rightMostOf();
+
+        // Ancestor index, only filled once enabled on the tree:
+        // depth is -1 before that, jump[k] is the 2^k-th ancestor.
+        int depth;
+        Node ** jump;
+        void buildJumps(Node *father);
+
+        // Subtree aggregates, kept up to date on insert and dismiss.
+        int descendants;
+        int height;
+        typename Aggregate::Value summary;
+    };
+
+    // Traversals keep their own stack, so neither deep nor wide families
+    // can overflow the call stack. Constructed with a node, they walk its
+    // subtree; with withSiblings set they also walk the following siblings
+    // (the whole forest when started from the root).
+    class PreorderIterator {
+    public:
+        explicit PreorderIterator(Node *start, bool withSiblings = false);
+        PreorderIterator(const PreorderIterator &) = delete;
+        PreorderIterator &operator=(const PreorderIterator &) = delete;
+
+        Node *operator*() const { return cur; }
+        Node *operator->() const { return cur; }
+        PreorderIterator &operator++();
+        bool isEnd() const { return cur == nullptr; }
+
+    private:
+        Node *cur;
+        Node *top;
+        bool siblings;
+        Vector<Node *> pending;
+    };
+
+    class PostorderIterator {
+    public:
+        explicit PostorderIterator(Node *start, bool withSiblings = false);
+        PostorderIterator(const PostorderIterator &) = delete;
+        PostorderIterator &operator=(const PostorderIterator &) = delete;
+
+        Node *operator*() const { return cur; }
+        Node *operator->() const { return cur; }
+        PostorderIterator &operator++();
+        bool isEnd() const { return cur == nullptr; }
+
+    private:
+        Node *cur;
+        Node *top;
+        bool siblings;
+        Vector<Node *> pending;
+        void pushLeft(Node *p);
+        void popNext();
+    };
+
+    class LevelOrderIterator {
+    public:
+        explicit LevelOrderIterator(Node *start, bool withSiblings = false);
+        LevelOrderIterator(const LevelOrderIterator &) = delete;
+        LevelOrderIterator &operator=(const LevelOrderIterator &) = delete;
+
+        Node *operator*() const { return cur; }
+        Node *operator->() const { return cur; }
+        LevelOrderIterator &operator++();
+        bool isEnd() const { return cur == nullptr; }
+
+    private:
+        Node *cur;
+        size_t pos;
+        Vector<Node *> level;       // generation being visited
+        Vector<Node *> nextLevel;   // their children, in order
     };
 
 public:
@@ -53,22 +139,45 @@ public:
     int dismissSubTree(Node * node);
     int dismissSubTree(Node * node, Vector<Type> &valList);
     Node *getRoot() const;
+    void reset(const Type &d);
+
+    // Genealogy queries, O(log n) with the ancestor index enabled.
+    void enableAncestorIndex();
+    bool hasAncestorIndex() const;
+    static Node *parentOf(Node *node);
+    static int depthOf(Node *node);
+    static Node *kthAncestor(Node *node, int k);
+    static Node *lowestCommonAncestor(Node *a, Node *b);
+    static bool isDescendantOf(Node *node, Node *ancestor);
+
+    // Subtree aggregates, O(1).
+    static int familySize(Node *node) { return node->descendants + 1; }
+    static int descendantCount(Node *node) { return node->descendants; }
+    static int heightOf(Node *node) { return node->height; }
+    static const typename Aggregate::Value &summaryOf(Node *node) {
+        return node->summary;
+    }
+    static void setData(Node *node, const Type &d);
 
 private:
     Node * root;
     static bool deleteLeave(Node * node, Node *&parent);
-    static Node *recursiveFind(Node *, const Type &d);
-    static void showNode(Node *, std::ostream & os);
+    static void showNode(Node *, BufferedWriter &out);
+    static void growAncestors(Node *father, Node *leaf);
+    static void shrinkAncestors(Node *father, int removed);
+    static void recompute(Node *node);
 };
 
-template<class Type>
+template<class Type, class Aggregate>
 int
-MultiTree<Type>::dismissSubTree(MultiTree::Node *node, Vector<Type> &valList) {
+MultiTree<Type, Aggregate>::dismissSubTree(MultiTree::Node *node, Vector<Type> &valList) {
     if (node == nullptr)
         return 0;
     if (node == root && root->sibling == nullptr) {
         throw MultiTreeException("Cannot delete only root");
     }
+    Node *father = parentOf(node);
+    valList.reserve(familySize(node));
     auto *child = node->firstChild;
     auto *p = child;
     Node *temp;
@@ -95,29 +204,32 @@ MultiTree<Type>::dismissSubTree(MultiTree::Node *node, Vector<Type> &valList) {
         deleteLeave(child, temp);
         ++count;
     }
-    if (node->sibling) {
-        if (node->parent)
-            node->parent->sibling = node->sibling;
-        else
-            root = node->sibling;
-        node->sibling = nullptr;
-    }
+    Node *next = node->sibling;
+    if (node->parent == nullptr)
+        root = next;
+    else if (node->parent->firstChild == node)
+        node->parent->firstChild = next;
+    else
+        node->parent->sibling = next;
+    if (next)
+        next->parent = node->parent;
+    node->sibling = nullptr;
     valList.pushBack(node->data);
     node->parent = nullptr;
     deleteLeave(node, temp);
     ++count;
-
+    shrinkAncestors(father, count);
     return count;
 }
 
-template<class Type>
-int MultiTree<Type>::dismissSubTree(MultiTree::Node *node) {
+template<class Type, class Aggregate>
+int MultiTree<Type, Aggregate>::dismissSubTree(MultiTree::Node *node) {
     Vector<Type> temp;
     return dismissSubTree(node, temp);
 }
 
-template<class Type>
-bool MultiTree<Type>::deleteLeave(MultiTree::Node * node, Node *&parent) {
+template<class Type, class Aggregate>
+bool MultiTree<Type, Aggregate>::deleteLeave(MultiTree::Node * node, Node *&parent) {
     if (node->firstChild == nullptr && node->sibling == nullptr) {
         parent = node->parent;
         if (parent) {
@@ -130,9 +242,9 @@ bool MultiTree<Type>::deleteLeave(MultiTree::Node * node, Node *&parent) {
     return false;
 }
 
-template<class Type>
-typename MultiTree<Type>::Node *
-MultiTree<Type>::insertChild(MultiTree::Node *node, const Type &d) {
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::Node *
+MultiTree<Type, Aggregate>::insertChild(MultiTree::Node *node, const Type &d) {
     auto child = node->firstChild;
     Node* ret;
     if (!child) {
@@ -146,9 +258,9 @@ MultiTree<Type>::insertChild(MultiTree::Node *node, const Type &d) {
     return ret;
 }
 
-template<class Type>
-typename MultiTree<Type>::Node *
-MultiTree<Type>::insertSibling(MultiTree::Node *node, const Type &d) {
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::Node *
+MultiTree<Type, Aggregate>::insertSibling(MultiTree::Node *node, const Type &d) {
     auto sib = node->rightMostOf();
     auto ret = sib->insertSibling(d);
     if (ret == nullptr)
@@ -156,80 +268,249 @@ MultiTree<Type>::insertSibling(MultiTree::Node *node, const Type &d) {
     return ret;
 }
 
-template<class Type>
-typename MultiTree<Type>::Node *MultiTree<Type>::trivialFind(const Type &d) {
-    return recursiveFind(root, d);
-}
-
-template<class Type>
-typename MultiTree<Type>::Node *
-MultiTree<Type>::recursiveFind(MultiTree::Node *node, const Type &d) {
-    if (node->data == d) return node;
-    Node *ret = nullptr;
-    if (node->sibling)
-        ret = recursiveFind(node->sibling, d);
-    if (!ret && node->firstChild)
-        ret = recursiveFind(node->firstChild, d);
-    return ret;
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::Node *MultiTree<Type, Aggregate>::trivialFind(const Type &d) {
+    for (PreorderIterator it(root, true); !it.isEnd(); ++it) {
+        if (it->data == d)
+            return *it;
+    }
+    return nullptr;
 }
 
-template<class Type>
-std::ostream &MultiTree<Type>::show(std::ostream &os) {
-    showNode(root, os);
+template<class Type, class Aggregate>
+std::ostream &MultiTree<Type, Aggregate>::show(std::ostream &os) {
+    BufferedWriter out(os);
+    showNode(root, out);
     return os;
 }
 
-template<class Type>
-void MultiTree<Type>::showNode(MultiTree::Node *node, std::ostream &os) {
-    os << node->data << '\t';
-    if (node->sibling) {
-        showNode(node->sibling, os);
-    } else {
-        os << '\n';
-    }
-    if (node->firstChild) {
-        showNode(node->firstChild, os);
+// Prints every sibling chain on one line, then the chains hanging below it,
+// last sibling's children first.
+template<class Type, class Aggregate>
+void MultiTree<Type, Aggregate>::showNode(MultiTree::Node *node, BufferedWriter &out) {
+    Vector<Node *> chains;
+    chains.pushBack(node);
+    while (!chains.isEmpty()) {
+        Node *p = chains.pop();
+        chains.popBack();
+        for (; p; p = p->sibling) {
+            out << p->data << '\t';
+            if (p->firstChild)
+                chains.pushBack(p->firstChild);
+        }
+        out << '\n';
     }
 }
 
-template<class Type>
-MultiTree<Type>::~MultiTree() {
-    dismissSubTree(root);
+template<class Type, class Aggregate>
+MultiTree<Type, Aggregate>::~MultiTree() {
+    // Children always come before their parent in postorder.
+    PostorderIterator it(root, true);
+    while (!it.isEnd()) {
+        Node *p = *it;
+        ++it;
+        delete p;
+    }
     root = nullptr;
 }
 
-template<class Type>
-typename MultiTree<Type>::Node *MultiTree<Type>::getRoot() const {
+// Drops every member and starts over with a single root.
+template<class Type, class Aggregate>
+void MultiTree<Type, Aggregate>::reset(const Type &d) {
+    bool indexed = hasAncestorIndex();
+    PostorderIterator it(root, true);
+    while (!it.isEnd()) {
+        Node *p = *it;
+        ++it;
+        delete p;
+    }
+    root = new Node(d, nullptr);
+    if (indexed)
+        root->buildJumps(nullptr);
+}
+
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::Node *MultiTree<Type, Aggregate>::getRoot() const {
     if (root == nullptr)
         throw MultiTreeException("Root deleted.");
     return root;
 }
 
 
-template<class Type>
-typename MultiTree<Type>::Node *
-MultiTree<Type>::Node::insertChild(const Type &d) {
+template<class Type, class Aggregate>
+void MultiTree<Type, Aggregate>::Node::buildJumps(Node *father) {
+    depth = father ? father->depth + 1 : 0;
+    int levels = 0;
+    while ((1 << levels) <= depth) {
+        ++levels;
+    }
+    delete[] jump;
+    jump = levels ? new Node *[levels] : nullptr;
+    if (levels) {
+        jump[0] = father;
+        for (int k = 1; k < levels; ++k) {
+            jump[k] = jump[k - 1]->jump[k - 1];
+        }
+    }
+}
+
+template<class Type, class Aggregate>
+void MultiTree<Type, Aggregate>::enableAncestorIndex() {
+    if (hasAncestorIndex())
+        return;
+    // In preorder a node's binary parent is either its father or its
+    // elder sibling, and both have been indexed already.
+    for (PreorderIterator it(root, true); !it.isEnd(); ++it) {
+        Node *p = it->parent;
+        if (p == nullptr)
+            it->buildJumps(nullptr);
+        else if (p->firstChild == *it)
+            it->buildJumps(p);
+        else
+            it->buildJumps(p->depth > 0 ? p->jump[0] : nullptr);
+    }
+}
+
+template<class Type, class Aggregate>
+bool MultiTree<Type, Aggregate>::hasAncestorIndex() const {
+    return root != nullptr && root->depth >= 0;
+}
+
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::Node *MultiTree<Type, Aggregate>::parentOf(Node *node) {
+    if (node->depth >= 0)
+        return node->depth > 0 ? node->jump[0] : nullptr;
+    while (node->parent && node->parent->firstChild != node) {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+template<class Type, class Aggregate>
+int MultiTree<Type, Aggregate>::depthOf(Node *node) {
+    if (node->depth >= 0)
+        return node->depth;
+    int d = 0;
+    for (Node *p = parentOf(node); p; p = parentOf(p)) {
+        ++d;
+    }
+    return d;
+}
+
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::Node *
+MultiTree<Type, Aggregate>::kthAncestor(Node *node, int k) {
+    if (node->depth < 0)
+        throw MultiTreeException("Ancestor index not enabled");
+    if (k < 0 || k > node->depth)
+        return nullptr;
+    for (int bit = 0; k > 0; ++bit, k >>= 1) {
+        if (k & 1)
+            node = node->jump[bit];
+    }
+    return node;
+}
+
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::Node *
+MultiTree<Type, Aggregate>::lowestCommonAncestor(Node *a, Node *b) {
+    if (a->depth < 0 || b->depth < 0)
+        throw MultiTreeException("Ancestor index not enabled");
+    if (a->depth < b->depth)
+        std::swap(a, b);
+    a = kthAncestor(a, a->depth - b->depth);
+    if (a == b)
+        return a;
+    // Climb together while the ancestors still differ.
+    for (int k = 30; k >= 0; --k) {
+        if ((1 << k) <= a->depth && a->jump[k] != b->jump[k]) {
+            a = a->jump[k];
+            b = b->jump[k];
+        }
+    }
+    // Different ancestors at the top level share no one.
+    return a->depth > 0 ? a->jump[0] : nullptr;
+}
+
+template<class Type, class Aggregate>
+bool MultiTree<Type, Aggregate>::isDescendantOf(Node *node, Node *ancestor) {
+    if (node->depth < 0 || ancestor->depth < 0)
+        throw MultiTreeException("Ancestor index not enabled");
+    return node->depth > ancestor->depth &&
+           kthAncestor(node, node->depth - ancestor->depth) == ancestor;
+}
+
+template<class Type, class Aggregate>
+void MultiTree<Type, Aggregate>::growAncestors(Node *father, Node *leaf) {
+    int h = leaf->height;
+    for (Node *a = father; a; a = parentOf(a)) {
+        ++a->descendants;
+        if (a->height < ++h)
+            a->height = h;
+        else
+            h = a->height;
+        a->summary = Aggregate::combine(a->summary, leaf->summary);
+    }
+}
+
+template<class Type, class Aggregate>
+void MultiTree<Type, Aggregate>::shrinkAncestors(Node *father, int removed) {
+    for (Node *a = father; a; a = parentOf(a)) {
+        a->descendants -= removed;
+        recompute(a);
+    }
+}
+
+// Height and summary of node from its children, which are up to date.
+template<class Type, class Aggregate>
+void MultiTree<Type, Aggregate>::recompute(Node *node) {
+    node->height = 0;
+    node->summary = Aggregate::of(node->data);
+    for (Node *c = node->firstChild; c; c = c->sibling) {
+        if (node->height < c->height + 1)
+            node->height = c->height + 1;
+        node->summary = Aggregate::combine(node->summary, c->summary);
+    }
+}
+
+template<class Type, class Aggregate>
+void MultiTree<Type, Aggregate>::setData(Node *node, const Type &d) {
+    node->data = d;
+    for (Node *a = node; a; a = parentOf(a)) {
+        recompute(a);
+    }
+}
+
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::Node *
+MultiTree<Type, Aggregate>::Node::insertChild(const Type &d) {
     if (firstChild != nullptr) {
         return nullptr;
     }
     auto node = new Node(d, this);
     firstChild = node;
+    if (depth >= 0)
+        node->buildJumps(this);
+    growAncestors(this, node);
     return node;
 }
 
-template<class Type>
-typename MultiTree<Type>::Node *
-MultiTree<Type>::Node::insertSibling(const Type &d) {
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::Node *
+MultiTree<Type, Aggregate>::Node::insertSibling(const Type &d) {
     if (sibling != nullptr) {
         return nullptr;
     }
     auto node = new Node(d, this);
     sibling = node;
+    if (depth >= 0)
+        node->buildJumps(depth > 0 ? jump[0] : nullptr);
+    growAncestors(parentOf(node), node);
     return node;
 }
 
-template<class Type>
-typename MultiTree<Type>::Node *MultiTree<Type>::Node::leftMostOf() {
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::Node *MultiTree<Type, Aggregate>::Node::leftMostOf() {
     auto p = this;
     while (p->firstChild) {
         p = p->firstChild;
@@ -237,8 +518,8 @@ typename MultiTree<Type>::Node *MultiTree<Type>::Node::leftMostOf() {
     return p;
 }
 
-template<class Type>
-typename MultiTree<Type>::Node *MultiTree<Type>::Node::rightMostOf() {
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::Node *MultiTree<Type, Aggregate>::Node::rightMostOf() {
     auto p = this;
     while (p->sibling) {
         p = p->sibling;
@@ -246,4 +527,98 @@ typename MultiTree<Type>::Node *MultiTree<Type>::Node::rightMostOf() {
     return p;
 }
 
+template<class Type, class Aggregate>
+MultiTree<Type, Aggregate>::PreorderIterator::PreorderIterator(Node *start,
+                                                    bool withSiblings) :
+        cur(start), top(start), siblings(withSiblings) { }
+
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::PreorderIterator &
+MultiTree<Type, Aggregate>::PreorderIterator::operator++() {
+    if (cur == nullptr)
+        return *this;
+    Node *next = (siblings || cur != top) ? cur->sibling : nullptr;
+    if (cur->firstChild) {
+        if (next)
+            pending.pushBack(next);
+        cur = cur->firstChild;
+    } else if (next) {
+        cur = next;
+    } else if (!pending.isEmpty()) {
+        cur = pending.pop();
+        pending.popBack();
+    } else {
+        cur = nullptr;
+    }
+    return *this;
+}
+
+template<class Type, class Aggregate>
+MultiTree<Type, Aggregate>::PostorderIterator::PostorderIterator(Node *start,
+                                                      bool withSiblings) :
+        cur(nullptr), top(start), siblings(withSiblings) {
+    pushLeft(start);
+    popNext();
+}
+
+template<class Type, class Aggregate>
+void MultiTree<Type, Aggregate>::PostorderIterator::pushLeft(Node *p) {
+    for (; p; p = p->firstChild) {
+        pending.pushBack(p);
+    }
+}
+
+template<class Type, class Aggregate>
+void MultiTree<Type, Aggregate>::PostorderIterator::popNext() {
+    if (pending.isEmpty()) {
+        cur = nullptr;
+    } else {
+        cur = pending.pop();
+        pending.popBack();
+    }
+}
+
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::PostorderIterator &
+MultiTree<Type, Aggregate>::PostorderIterator::operator++() {
+    if (cur == nullptr)
+        return *this;
+    // All children of cur are done; its younger siblings come next.
+    if (siblings || cur != top)
+        pushLeft(cur->sibling);
+    popNext();
+    return *this;
+}
+
+template<class Type, class Aggregate>
+MultiTree<Type, Aggregate>::LevelOrderIterator::LevelOrderIterator(Node *start,
+                                                        bool withSiblings) :
+        cur(start), pos(0) {
+    if (start == nullptr)
+        return;
+    level.pushBack(start);
+    if (withSiblings) {
+        for (Node *p = start->sibling; p; p = p->sibling) {
+            level.pushBack(p);
+        }
+    }
+}
+
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::LevelOrderIterator &
+MultiTree<Type, Aggregate>::LevelOrderIterator::operator++() {
+    if (cur == nullptr)
+        return *this;
+    for (Node *c = cur->firstChild; c; c = c->sibling) {
+        nextLevel.pushBack(c);
+    }
+    if (++pos == level.length()) {
+        level.swap(nextLevel);
+        nextLevel.clear();
+        pos = 0;
+    }
+    cur = pos < level.length() ? level[pos] : nullptr;
+    return *this;
+}
+
 #endif //DATASTRUCTURE_MULTITREE_H
@@ -0,0 +1,42 @@
+//
+// Created by Zhengyi on 2020/12/20.
+//
+
+#include "PersistentMultiTree.h"
+#include <string>
+#include <vector>
+
+int main() {
+    typedef PersistentMultiTree<std::string> Tree;
+    Tree::Path path;
+    Tree v0;
+    Tree v1 = v0.appendChild(path, "A").appendChild(path, "H");
+    v1.find("A", path);
+    Tree v2 = v1.appendChild(path, "B").appendChild(path, "C");
+    v2.find("B", path);
+    Tree v3 = v2.appendChild(path, "E");
+    v3.find("C", path);
+    Tree v4 = v3.remove(path);
+    v4.find("A", path);
+    Tree v5 = v4.setData(path, "AA");
+
+    v3.show(std::cout) << v3.size() << "\n\n";
+    v5.show(std::cout) << v5.size() << "\n\n";
+    // Untouched branches are shared, not copied.
+    std::cout << (v0.getTop() != v1.getTop()) << ' '
+              << (v4.getTop()->child(1) == v1.getTop()->child(1))
+              << std::endl;
+
+    // Every version of a wide family is kept, each a few links bigger.
+    std::vector<Tree> versions(1, v5);
+    v5.find("H", path);
+    for (int i = 0; i < 100000; ++i) {
+        versions.push_back(versions.back().appendChild(path, std::to_string(i)));
+    }
+    Tree::Path last = path;
+    last.pushBack(99999);
+    std::cout << versions.back().size() << ' ' << versions[5000].size() << ' '
+              << versions.back().nodeAt(last)->data << ' '
+              << versions.back().remove(last).size() << std::endl;
+    return 0;
+}
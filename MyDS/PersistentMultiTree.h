@@ -0,0 +1,474 @@
+//
+// Created by Zhengyi on 2020/12/20.
+//
+
+#ifndef DATASTRUCTURE_PERSISTENTMULTITREE_H
+#define DATASTRUCTURE_PERSISTENTMULTITREE_H
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include "Vector.h"
+#include "BufferedWriter.h"
+#include "MultiTree.h"
+
+/// Immutable multi-way tree. An update copies only the nodes on the path
+/// from the top to the change and shares everything else with the version
+/// it came from, so old versions stay valid and can be read from any thread
+/// without locks. The children of a node are kept in a persistent AVL tree
+/// ordered by position, so each level of the path copies O(log fan-out)
+/// links instead of the whole sibling list, and a version costs
+/// O(depth * log fan-out). Nodes and links are reference counted.
+template <class Type>
+class PersistentMultiTree {
+public:
+    struct Node;
+
+    // One child in the sibling tree of its parent, with the number of
+    // children and of members below this link.
+    struct Link {
+        Link(const Link *l, const Node *n, const Link *r);
+        Link(const Link &) = delete;
+        Link &operator=(const Link &) = delete;
+
+        const Node *node;
+        const Link *left;
+        const Link *right;
+        int count;
+        int members;
+        int height;
+        mutable std::atomic<int> refs;
+    };
+
+    struct Node {
+        explicit Node(const Type &d) : data(d), children(nullptr), size(1), refs(1) { }
+        Node(const Node &) = delete;
+        Node &operator=(const Node &) = delete;
+
+        int childCount() const { return countOf(children); }
+        // O(log fan-out)
+        const Node *child(int i) const;
+
+        Type data;
+        const Link *children;
+        int size;                       // nodes in this subtree
+        mutable std::atomic<int> refs;
+    };
+
+    // Child indices from the top level down; empty means "the top".
+    typedef Vector<int> Path;
+
+    PersistentMultiTree();
+    PersistentMultiTree(const PersistentMultiTree &another);
+    PersistentMultiTree &operator=(const PersistentMultiTree &another);
+    ~PersistentMultiTree();
+
+    // Each update returns the new version and leaves *this untouched.
+    PersistentMultiTree appendChild(const Path &parent, const Type &d) const;
+    PersistentMultiTree remove(const Path &path) const;
+    PersistentMultiTree setData(const Path &path, const Type &d) const;
+
+    bool find(const Type &d, Path &path) const;
+    const Node *nodeAt(const Path &path) const;
+    // Virtual node whose children are the top level ancestors.
+    const Node *getTop() const { return top; }
+    int size() const { return top->size - 1; }
+    std::ostream &show(std::ostream &os) const;
+
+private:
+    const Node *top;
+
+    explicit PersistentMultiTree(const Node *t) : top(t) { }
+    const Node *walk(const Path &path, int levels, Vector<const Node *> &chain) const;
+    static PersistentMultiTree copyPath(const Path &path, int levels,
+                                        Vector<const Node *> &chain,
+                                        const Node *replacement);
+    static Node *copyOf(const Node *node);
+    static void setChildren(Node *node, const Link *list);
+
+    // Sibling tree updates. Arguments are borrowed, results are owned by
+    // the caller.
+    static int countOf(const Link *t) { return t ? t->count : 0; }
+    static int membersOf(const Link *t) { return t ? t->members : 0; }
+    static int heightOf(const Link *t) { return t ? t->height : 0; }
+    static const Link *balance(const Link *l, const Node *n, const Link *r);
+    static const Link *insertAt(const Link *t, int i, const Node *n);
+    static const Link *eraseAt(const Link *t, int i);
+    static const Link *replaceAt(const Link *t, int i, const Node *n);
+
+    static void retain(const Node *node);
+    static void retain(const Link *link);
+    static void release(const Node *node);
+    static void release(const Link *link);
+    static void release(const Node *node, const Link *link);
+};
+
+template<class Type>
+PersistentMultiTree<Type>::Link::Link(const Link *l, const Node *n, const Link *r) :
+        node(n), left(l), right(r),
+        count(countOf(l) + 1 + countOf(r)),
+        members(membersOf(l) + n->size + membersOf(r)),
+        height(std::max(heightOf(l), heightOf(r)) + 1), refs(1) {
+    retain(l);
+    retain(n);
+    retain(r);
+}
+
+template<class Type>
+const typename PersistentMultiTree<Type>::Node *
+PersistentMultiTree<Type>::Node::child(int i) const {
+    const Link *t = children;
+    while (i != countOf(t->left)) {
+        if (i < countOf(t->left)) {
+            t = t->left;
+        } else {
+            i -= countOf(t->left) + 1;
+            t = t->right;
+        }
+    }
+    return t->node;
+}
+
+template<class Type>
+PersistentMultiTree<Type>::PersistentMultiTree() : top(new Node(Type())) { }
+
+template<class Type>
+PersistentMultiTree<Type>::PersistentMultiTree(const PersistentMultiTree &another) :
+        top(another.top) {
+    retain(top);
+}
+
+template<class Type>
+PersistentMultiTree<Type> &
+PersistentMultiTree<Type>::operator=(const PersistentMultiTree &another) {
+    if (&another == this)
+        return *this;
+    retain(another.top);
+    release(top);
+    top = another.top;
+    return *this;
+}
+
+template<class Type>
+PersistentMultiTree<Type>::~PersistentMultiTree() {
+    release(top);
+}
+
+template<class Type>
+void PersistentMultiTree<Type>::retain(const Node *node) {
+    if (node)
+        node->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+template<class Type>
+void PersistentMultiTree<Type>::retain(const Link *link) {
+    if (link)
+        link->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+template<class Type>
+void PersistentMultiTree<Type>::release(const Node *node) {
+    release(node, nullptr);
+}
+
+template<class Type>
+void PersistentMultiTree<Type>::release(const Link *link) {
+    release(nullptr, link);
+}
+
+// Frees every node and link nobody else refers to, without recursion.
+template<class Type>
+void PersistentMultiTree<Type>::release(const Node *node, const Link *link) {
+    Vector<const Node *> nodes;
+    Vector<const Link *> links;
+    auto dropNode = [&nodes](const Node *p) {
+        if (p && p->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            nodes.pushBack(p);
+    };
+    auto dropLink = [&links](const Link *t) {
+        if (t && t->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            links.pushBack(t);
+    };
+    dropNode(node);
+    dropLink(link);
+    while (!nodes.isEmpty() || !links.isEmpty()) {
+        if (!links.isEmpty()) {
+            const Link *t = links.pop();
+            links.popBack();
+            dropLink(t->left);
+            dropLink(t->right);
+            dropNode(t->node);
+            delete t;
+        } else {
+            const Node *p = nodes.pop();
+            nodes.popBack();
+            dropLink(p->children);
+            delete p;
+        }
+    }
+}
+
+// Joins l, n and r, whose heights differ by at most two, with at most
+// one single or double rotation.
+template<class Type>
+const typename PersistentMultiTree<Type>::Link *
+PersistentMultiTree<Type>::balance(const Link *l, const Node *n, const Link *r) {
+    if (heightOf(l) > heightOf(r) + 1) {
+        if (heightOf(l->left) >= heightOf(l->right)) {
+            const Link *inner = new Link(l->right, n, r);
+            const Link *result = new Link(l->left, l->node, inner);
+            release(inner);
+            return result;
+        }
+        const Link *a = new Link(l->left, l->node, l->right->left);
+        const Link *b = new Link(l->right->right, n, r);
+        const Link *result = new Link(a, l->right->node, b);
+        release(a);
+        release(b);
+        return result;
+    }
+    if (heightOf(r) > heightOf(l) + 1) {
+        if (heightOf(r->right) >= heightOf(r->left)) {
+            const Link *inner = new Link(l, n, r->left);
+            const Link *result = new Link(inner, r->node, r->right);
+            release(inner);
+            return result;
+        }
+        const Link *a = new Link(l, n, r->left->left);
+        const Link *b = new Link(r->left->right, r->node, r->right);
+        const Link *result = new Link(a, r->left->node, b);
+        release(a);
+        release(b);
+        return result;
+    }
+    return new Link(l, n, r);
+}
+
+template<class Type>
+const typename PersistentMultiTree<Type>::Link *
+PersistentMultiTree<Type>::insertAt(const Link *t, int i, const Node *n) {
+    if (!t)
+        return new Link(nullptr, n, nullptr);
+    const Link *part, *result;
+    if (i <= countOf(t->left)) {
+        part = insertAt(t->left, i, n);
+        result = balance(part, t->node, t->right);
+    } else {
+        part = insertAt(t->right, i - countOf(t->left) - 1, n);
+        result = balance(t->left, t->node, part);
+    }
+    release(part);
+    return result;
+}
+
+template<class Type>
+const typename PersistentMultiTree<Type>::Link *
+PersistentMultiTree<Type>::eraseAt(const Link *t, int i) {
+    const Link *part, *result;
+    const int before = countOf(t->left);
+    if (i < before) {
+        part = eraseAt(t->left, i);
+        result = balance(part, t->node, t->right);
+    } else if (i > before) {
+        part = eraseAt(t->right, i - before - 1);
+        result = balance(t->left, t->node, part);
+    } else if (!t->left || !t->right) {
+        result = t->left ? t->left : t->right;
+        retain(result);
+        return result;
+    } else {
+        // The next sibling takes this link's place.
+        const Link *next = t->right;
+        while (next->left) {
+            next = next->left;
+        }
+        part = eraseAt(t->right, 0);
+        result = balance(t->left, next->node, part);
+    }
+    release(part);
+    return result;
+}
+
+template<class Type>
+const typename PersistentMultiTree<Type>::Link *
+PersistentMultiTree<Type>::replaceAt(const Link *t, int i, const Node *n) {
+    const int before = countOf(t->left);
+    if (i == before)
+        return new Link(t->left, n, t->right);
+    const Link *part, *result;
+    if (i < before) {
+        part = replaceAt(t->left, i, n);
+        result = new Link(part, t->node, t->right);
+    } else {
+        part = replaceAt(t->right, i - before - 1, n);
+        result = new Link(t->left, t->node, part);
+    }
+    release(part);
+    return result;
+}
+
+// Shallow copy sharing (and retaining) the children.
+template<class Type>
+typename PersistentMultiTree<Type>::Node *
+PersistentMultiTree<Type>::copyOf(const Node *node) {
+    auto copy = new Node(node->data);
+    setChildren(copy, node->children);
+    return copy;
+}
+
+// Takes a reference to list; the size follows from its member count.
+template<class Type>
+void PersistentMultiTree<Type>::setChildren(Node *node, const Link *list) {
+    retain(list);
+    release(node->children);
+    node->children = list;
+    node->size = 1 + membersOf(list);
+}
+
+// chain[i] is the node reached after i steps of path.
+template<class Type>
+const typename PersistentMultiTree<Type>::Node *
+PersistentMultiTree<Type>::walk(const Path &path, int levels,
+                                Vector<const Node *> &chain) const {
+    const Node *p = top;
+    chain.pushBack(p);
+    for (int i = 0; i < levels; ++i) {
+        if (path[i] < 0 || path[i] >= p->childCount())
+            throw MultiTreeException("Path out of tree");
+        p = p->child(path[i]);
+        chain.pushBack(p);
+    }
+    return p;
+}
+
+// Rebuilds chain[0..levels-1] with chain[levels] swapped for replacement.
+// Takes over the caller's reference to replacement.
+template<class Type>
+PersistentMultiTree<Type>
+PersistentMultiTree<Type>::copyPath(const Path &path, int levels,
+                                    Vector<const Node *> &chain,
+                                    const Node *replacement) {
+    for (int i = levels - 1; i >= 0; --i) {
+        Node *copy = copyOf(chain[i]);
+        const Link *list = replaceAt(copy->children, path[i], replacement);
+        release(replacement);
+        setChildren(copy, list);
+        release(list);
+        replacement = copy;
+    }
+    return PersistentMultiTree(replacement);
+}
+
+template<class Type>
+PersistentMultiTree<Type>
+PersistentMultiTree<Type>::appendChild(const Path &parent, const Type &d) const {
+    Vector<const Node *> chain;
+    int levels = parent.length();
+    const Node *p = walk(parent, levels, chain);
+    Node *copy = copyOf(p);
+    const Node *leaf = new Node(d);
+    const Link *list = insertAt(copy->children, copy->childCount(), leaf);
+    release(leaf);
+    setChildren(copy, list);
+    release(list);
+    return copyPath(parent, levels, chain, copy);
+}
+
+template<class Type>
+PersistentMultiTree<Type>
+PersistentMultiTree<Type>::remove(const Path &path) const {
+    if (path.isEmpty())
+        throw MultiTreeException("Cannot remove the top");
+    Vector<const Node *> chain;
+    int levels = path.length();
+    walk(path, levels, chain);
+    // Drop the child from its parent, then copy the rest of the way up.
+    Node *copy = copyOf(chain[levels - 1]);
+    const Link *list = eraseAt(copy->children, path[levels - 1]);
+    setChildren(copy, list);
+    release(list);
+    return copyPath(path, levels - 1, chain, copy);
+}
+
+template<class Type>
+PersistentMultiTree<Type>
+PersistentMultiTree<Type>::setData(const Path &path, const Type &d) const {
+    Vector<const Node *> chain;
+    int levels = path.length();
+    const Node *p = walk(path, levels, chain);
+    Node *copy = copyOf(p);
+    copy->data = d;
+    return copyPath(path, levels, chain, copy);
+}
+
+template<class Type>
+const typename PersistentMultiTree<Type>::Node *
+PersistentMultiTree<Type>::nodeAt(const Path &path) const {
+    Vector<const Node *> chain;
+    return walk(path, path.length(), chain);
+}
+
+// Depth first; path holds the index of the next child at each open level.
+template<class Type>
+bool PersistentMultiTree<Type>::find(const Type &d, Path &path) const {
+    Vector<const Node *> open;
+    path.clear();
+    open.pushBack(top);
+    path.pushBack(0);
+    while (!open.isEmpty()) {
+        const Node *p = open.pop();
+        int i = path.pop();
+        if (i == p->childCount()) {
+            open.popBack();
+            path.popBack();
+            continue;
+        }
+        path[path.length() - 1] = i + 1;
+        const Node *child = p->child(i);
+        if (child->data == d) {
+            for (size_t j = 0; j < path.length(); ++j) {
+                --path[j];
+            }
+            return true;
+        }
+        open.pushBack(child);
+        path.pushBack(0);
+    }
+    return false;
+}
+
+template<class Type>
+std::ostream &PersistentMultiTree<Type>::show(std::ostream &os) const {
+    struct Frame {
+        const Node *node;
+        int indent;
+        bool last;
+    };
+    BufferedWriter out(os);
+    Vector<Frame> frames;
+    Vector<int> rails;
+    for (int i = top->childCount() - 1; i >= 0; --i) {
+        frames.pushBack(Frame{top->child(i), 0, i == top->childCount() - 1});
+    }
+    while (!frames.isEmpty()) {
+        Frame f = frames.pop();
+        frames.popBack();
+        if (f.indent > 0) {
+            for (int i = 0; i < f.indent - 1; ++i) {
+                out << (rails[i] ? "│   " : "    ");
+            }
+            out << (f.last ? "└── " : "├── ");
+            rails[f.indent - 1] = !f.last;
+        }
+        out << f.node->data << '\n';
+        while (rails.length() < size_t(f.indent) + 1)
+            rails.pushBack(0);
+        int n = f.node->childCount();
+        for (int i = n - 1; i >= 0; --i) {
+            frames.pushBack(Frame{f.node->child(i), f.indent + 1, i == n - 1});
+        }
+    }
+    return os;
+}
+
+#endif //DATASTRUCTURE_PERSISTENTMULTITREE_H
@@ -74,6 +74,7 @@ public:
     bool hasKey(const string &s) { return ht.hasKey(s); }
     size_t erase(const string& key) { return ht.erase(key); }
     void resize(size_t hint) { ht.resize(hint); }
+    void clear() { ht.clear(); }
     inline void insert(const string& s, const Value& val);
     inline void insert(const MapPair& pair);
 
@@ -0,0 +1,121 @@
+//
+// Created by Zhengyi on 2020/12/22.
+//
+
+#ifndef DATASTRUCTURE_THREADPOOL_H
+#define DATASTRUCTURE_THREADPOOL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include "Queue.h"
+
+/// Fixed set of worker threads taking tasks from one shared queue.
+/// The destructor runs whatever is still queued before joining.
+/// A thread waiting through wait() runs queued tasks meanwhile, so tasks
+/// may submit tasks of their own and wait for them.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned n = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    template<class F>
+    std::future<typename std::result_of<F()>::type> submit(F f);
+    // result.get(), running queued tasks until result is ready.
+    template<class T>
+    T wait(std::future<T> &result);
+    unsigned size() const { return count; }
+
+private:
+    std::thread *workers;
+    unsigned count;
+    Queue<std::function<void()> > tasks;
+    std::mutex lock;
+    std::condition_variable ready;
+    bool stopping;
+
+    void work();
+};
+
+// n == 0 means one thread per hardware thread.
+inline ThreadPool::ThreadPool(unsigned n) : stopping(false) {
+    if (n == 0)
+        n = std::thread::hardware_concurrency();
+    if (n == 0)
+        n = 1;
+    count = n;
+    workers = new std::thread[n];
+    for (unsigned i = 0; i < n; ++i) {
+        workers[i] = std::thread(&ThreadPool::work, this);
+    }
+}
+
+inline ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    ready.notify_all();
+    for (unsigned i = 0; i < count; ++i) {
+        workers[i].join();
+    }
+    delete[] workers;
+}
+
+inline void ThreadPool::work() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            ready.wait(guard, [this] { return stopping || !tasks.isEmpty(); });
+            if (!tasks.dequeue(task))
+                return;             // stopping and drained
+        }
+        task();
+    }
+}
+
+template<class F>
+std::future<typename std::result_of<F()>::type> ThreadPool::submit(F f) {
+    typedef typename std::result_of<F()>::type Result;
+    // std::function needs a copyable target, packaged_task is move only.
+    auto task = std::make_shared<std::packaged_task<Result()> >(f);
+    std::future<Result> result = task->get_future();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        tasks.enqueue([this, task] {
+            (*task)();
+            // Wakes whoever waits for this result in wait().
+            { std::lock_guard<std::mutex> finished(lock); }
+            ready.notify_all();
+        });
+    }
+    ready.notify_one();
+    return result;
+}
+
+template<class T>
+T ThreadPool::wait(std::future<T> &result) {
+    std::unique_lock<std::mutex> guard(lock);
+    while (result.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        std::function<void()> task;
+        if (tasks.dequeue(task)) {
+            guard.unlock();
+            task();
+            guard.lock();
+        } else {
+            ready.wait(guard);
+        }
+    }
+    guard.unlock();
+    return result.get();
+}
+
+#endif //DATASTRUCTURE_THREADPOOL_H
@@ -1,4 +1,5 @@
 #include <string>
+#include <cstdint>
 #include <iostream>
 #include <functional>
 #include <limits>
@@ -251,8 +252,7 @@ public:
 class BigInteger {
     friend std::ostream &operator <<(std::ostream &, const BigInteger &);
 public:
-    explicit BigInteger(const std::string &i = "") :
-            integer(check(i)) { }
+    explicit BigInteger(const std::string &i = "") { assign(check(i)); }
 
     BigInteger &operator=(std::string s);
     bool operator>(const BigInteger &other) const;
@@ -262,40 +262,65 @@ public:
     static std::string check(const std::string &s);
 
 protected:
+    // Up to 19 digits are kept as a number in small, with integer left
+    // empty. Longer numbers, and anything else such as "-1", keep their text.
     std::string integer = "";
+    uint64_t small = 0;
+    bool isSmall = true;
+
+    void assign(std::string s);
+    std::string digits() const;
+    int compare(const BigInteger &other) const;
 };
 
+void BigInteger::assign(std::string s) {
+    bool number = s.length() <= 19;
+    for (int i = 0; number && i < (int)s.length(); ++i) {
+        number = s[i] >= '0' && s[i] <= '9';
+    }
+    if (!number) {
+        integer = std::move(s);
+        isSmall = false;
+        return;
+    }
+    small = 0;
+    for (int i = 0; i < (int)s.length(); ++i) {
+        small = small * 10 + (s[i] - '0');
+    }
+    integer.clear();
+    isSmall = true;
+}
+
+// The text a small number stands for; zero is the empty string check
+// leaves behind.
+std::string BigInteger::digits() const {
+    if (!isSmall) return integer;
+    return small == 0 ? std::string() : std::to_string(small);
+}
+
 BigInteger &BigInteger::operator=(std::string s) {
-    this->integer = std::move(s);
+    assign(std::move(s));
     return *this;
 }
 
+int BigInteger::compare(const BigInteger &other) const {
+    if (isSmall && other.isSmall)
+        return (small > other.small) - (small < other.small);
+    std::string a = digits(), b = other.digits();
+    if (a.length() != b.length()) return a.length() < b.length() ? -1 : 1;
+    return a.compare(b) < 0 ? -1 : (a.compare(b) > 0 ? 1 : 0);
+}
+
 bool BigInteger::operator>(const BigInteger &other) const {
-    if (integer.length() > other.integer.length()) return true;
-    if (integer.length() < other.integer.length()) return false;
-    for (int i = 0; i < (int)integer.length(); ++i) {
-        if (integer[i] > other.integer[i]) return true;
-        if (integer[i] < other.integer[i]) return false;
-    }
-    return false;
+    return compare(other) > 0;
 }
 
 bool BigInteger::operator<(const BigInteger &other) const {
-    if (integer.length() < other.integer.length()) return true;
-    if (integer.length() > other.integer.length()) return false;
-    for (int i = 0; i < (int)integer.length(); ++i) {
-        if (integer[i] < other.integer[i]) return true;
-        if (integer[i] > other.integer[i]) return false;
-    }
-    return false;
+    return compare(other) < 0;
 }
 
 bool BigInteger::operator==(const BigInteger &other) const {
-    if (integer.length() != other.integer.length()) return false;
-    for (int i = 0; i < (int)integer.length(); ++i) {
-        if (integer[i] != other.integer[i]) return false;
-    }
-    return true;
+    return compare(other) == 0;
 }
 
 std::string BigInteger::check(const std::string &s) {
@@ -313,7 +338,10 @@ std::string BigInteger::check(const std::string &s) {
 }
 
 std::ostream &operator<<(std::ostream &os, const BigInteger &bi) {
-    os << bi.integer;
+    if (!bi.isSmall)
+        os << bi.integer;
+    else if (bi.small != 0)
+        os << bi.small;
     return os;
 }
 
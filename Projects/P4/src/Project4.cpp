@@ -1,9 +1,32 @@
 #include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <cstdlib>
 #include <string>
+#include <vector>
 #include <iostream>
 #include <exception>
+#include <list>
+#include <map>
+#include <tuple>
+#include <unordered_map>
 #include <utility>
 #include <algorithm>
+#include <deque>
+#include <sstream>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #ifndef _NOEXCEPT
 #define _NOEXCEPT noexcept
@@ -11,6 +34,247 @@
 
 using std::string;
 
+///--------------------------------- Queue ----------------------------------///
+// Cyclic queue
+template <class Type>
+class Queue {
+public:
+    Queue();
+    ~Queue();
+    bool enqueue(const Type &d);
+    bool dequeue(Type &d);
+    bool peekFront(Type &d);
+    bool isEmpty();
+    int length();
+    void clear();
+    std::ostream &show(std::ostream &os);
+
+private:
+    static constexpr int InitSize = 10;
+    int size;
+    int capacity;
+    int front;
+    int rear;
+    Type * data;
+
+    int resize(int n);
+    void tryExtend();
+    void tryShrink();
+};
+
+template<class Type>
+Queue<Type>::Queue() : size(0), capacity(InitSize), front(0), rear(0){
+    data = new Type[capacity];
+    // Compiler will throw failure message.
+}
+
+template<class Type>
+Queue<Type>::~Queue() {
+    delete[] data;
+}
+
+template<class Type>
+bool Queue<Type>::enqueue(const Type &d) {
+    tryExtend();
+    data[rear] = d;
+    rear = (rear+1) % capacity;
+    ++size;
+    return true;
+}
+
+template<class Type>
+bool Queue<Type>::dequeue(Type &d) {
+    if (isEmpty())
+        return false;
+    d = data[front];
+    front = (front+1) % capacity;
+    --size;
+    tryShrink();
+    return true;
+}
+
+template<class Type>
+bool Queue<Type>::peekFront(Type &d) {
+    if (isEmpty())
+        return false;
+    d = data[front];
+    return true;
+}
+
+template<class Type>
+bool Queue<Type>::isEmpty() {
+    return size == 0;
+}
+
+template<class Type>
+int Queue<Type>::length() {
+    return size;
+}
+
+template<class Type>
+int Queue<Type>::resize(int n) {
+    if (n < size) {
+        return -1;                  // data loss is not permitted
+    }
+    if (n == capacity) {
+        return 1;                   // not resize
+    }
+    auto temp = new Type[n]; // Compiler will throw failure message.
+    if (!isEmpty()) {
+        int j = 0;
+        for (int i = front; i != rear; i = (i+1)%capacity) {
+            temp[j++] = data[i];
+        }
+    }
+    capacity = n;
+    front = 0;
+    rear = size;
+    delete [] data;
+    data = temp;
+    return 1;
+}
+
+template<class Type>
+void Queue<Type>::tryExtend() {
+    if (capacity - size <= 1)
+        resize(capacity * 2);
+}
+
+template<class Type>
+void Queue<Type>::tryShrink() {
+    if (isEmpty())
+        resize(InitSize);
+    else if (capacity > InitSize && capacity / 4 > size)
+        resize(capacity / 2);
+}
+
+template<class Type>
+std::ostream &Queue<Type>::show(std::ostream &os) {
+//    for (int i = 0; i < capacity; ++i) {
+//        os << data[i] << "\t";
+//    }
+//    os << std::endl;
+    for (int t = front; t != rear; t = (t+1) % capacity) {
+        os << data[t] << "\t";
+    }
+    os << std::endl;
+    return os;
+}
+
+template<class Type>
+void Queue<Type>::clear() {
+    front = 0;
+    rear = 0;
+    size = 0;
+    tryShrink();
+}
+
+
+///------------------------------- ThreadPool -------------------------------///
+/// Fixed set of worker threads taking tasks from one shared queue.
+/// The destructor runs whatever is still queued before joining.
+/// A thread waiting through wait() runs queued tasks meanwhile, so tasks
+/// may submit tasks of their own and wait for them.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned n = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    template<class F>
+    std::future<typename std::result_of<F()>::type> submit(F f);
+    // result.get(), running queued tasks until result is ready.
+    template<class T>
+    T wait(std::future<T> &result);
+    unsigned size() const { return count; }
+
+private:
+    std::thread *workers;
+    unsigned count;
+    Queue<std::function<void()> > tasks;
+    std::mutex lock;
+    std::condition_variable ready;
+    bool stopping;
+
+    void work();
+};
+
+// n == 0 means one thread per hardware thread.
+inline ThreadPool::ThreadPool(unsigned n) : stopping(false) {
+    if (n == 0)
+        n = std::thread::hardware_concurrency();
+    if (n == 0)
+        n = 1;
+    count = n;
+    workers = new std::thread[n];
+    for (unsigned i = 0; i < n; ++i) {
+        workers[i] = std::thread(&ThreadPool::work, this);
+    }
+}
+
+inline ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    ready.notify_all();
+    for (unsigned i = 0; i < count; ++i) {
+        workers[i].join();
+    }
+    delete[] workers;
+}
+
+inline void ThreadPool::work() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            ready.wait(guard, [this] { return stopping || !tasks.isEmpty(); });
+            if (!tasks.dequeue(task))
+                return;             // stopping and drained
+        }
+        task();
+    }
+}
+
+template<class F>
+std::future<typename std::result_of<F()>::type> ThreadPool::submit(F f) {
+    typedef typename std::result_of<F()>::type Result;
+    // std::function needs a copyable target, packaged_task is move only.
+    auto task = std::make_shared<std::packaged_task<Result()> >(f);
+    std::future<Result> result = task->get_future();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        tasks.enqueue([this, task] {
+            (*task)();
+            // Wakes whoever waits for this result in wait().
+            { std::lock_guard<std::mutex> finished(lock); }
+            ready.notify_all();
+        });
+    }
+    ready.notify_one();
+    return result;
+}
+
+template<class T>
+T ThreadPool::wait(std::future<T> &result) {
+    std::unique_lock<std::mutex> guard(lock);
+    while (result.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        std::function<void()> task;
+        if (tasks.dequeue(task)) {
+            guard.unlock();
+            task();
+            guard.lock();
+        } else {
+            ready.wait(guard);
+        }
+    }
+    guard.unlock();
+    return result.get();
+}
+
+
 ///-------------------------- BigInteger ------------------------------------///
 class ParseError : public std::exception {
     const char *what() const _NOEXCEPT override {
@@ -27,332 +291,1443 @@ class DivideByZero : public std::exception {
 class BigInteger {
 public:
 
-    BigInteger() : value("0"), negative(false) {}
-    explicit BigInteger(int i);
+    BigInteger() = default;
+
+    explicit BigInteger(int64_t i);
+
     explicit BigInteger(const string &s);
+
+    // Parses the first count chars of s, which need no terminator.
+    BigInteger(const char *s, size_t count);
+
     BigInteger(const BigInteger &bi);
+
+    // Leaves bi zero.
+    BigInteger(BigInteger &&bi) _NOEXCEPT;
+
     ~BigInteger() = default;
 
     // Unary operator
     BigInteger operator-() const;
+
     BigInteger operator+() const;
+
     BigInteger absolute() const;
 
     std::ostream &show(std::ostream &os) const;
+
+    // Number of chars format writes, sign included.
+    size_t length() const;
+
+    // Stores the value in word if it fits in an int64_t.
+    bool toWord(int64_t &word) const {
+        word = small;
+        return !big;
+    }
+
+    // Writes the decimal form, without terminator, into buffer, which
+    // must hold length() chars. Returns the number of chars written.
+    size_t format(char *buffer) const;
+
     int compare(const BigInteger &bi) const;
 
-    // Binary operator
     BigInteger &operator=(const BigInteger &bi);
+
+    BigInteger &operator=(BigInteger &&bi) _NOEXCEPT;
+
+    // In place, reusing this value's limbs: += and -= only allocate
+    // when the result outgrows their capacity.
+    BigInteger &operator+=(const BigInteger &bi);
+
+    BigInteger &operator-=(const BigInteger &bi);
+
+    BigInteger &operator*=(const BigInteger &bi);
+
+    // Throws DivideByZero exception
+    BigInteger &operator/=(const BigInteger &bi);
+
     BigInteger operator+(const BigInteger &bi) const;
+
     BigInteger operator-(const BigInteger &bi) const;
+
     BigInteger operator*(const BigInteger &bi) const;
+
     BigInteger operator/(const BigInteger &bi) const;
+
     BigInteger operator%(const BigInteger &bi) const;
+
     BigInteger operator^(const BigInteger &bi) const;
+
     bool operator==(const BigInteger &bi) const;
 
+    // Truncating division giving both results in one pass: quotient
+    // rounds toward zero, remainder takes the sign of *this.
+    // Throws DivideByZero exception
+    void divMod(const BigInteger &bi, BigInteger &quotient, BigInteger &remainder) const;
+
+    // Power with a machine-word exponent; pow(0) is 1.
+    BigInteger pow(uint64_t exponent) const;
+
+    // Same value as (*this ^ exp) % mod, without building the power.
+    // Throws DivideByZero exception
+    BigInteger modPow(const BigInteger &exp, const BigInteger &mod) const;
+
+    // Operand sizes, in limbs, from which multiplication switches to
+    // Karatsuba, Toom-3 and NTT. Exposed for tuning and for tests that
+    // check the fast paths against schoolbook multiplication.
+    struct Thresholds {
+        size_t karatsuba;
+        size_t toom3;
+        size_t ntt;
+    };
+
+    static Thresholds &multiplyThresholds() {
+        static Thresholds thresholds = {64, 300, 2500};
+        return thresholds;
+    }
+
+    // With a pool set, multiplications whose smaller operand has at
+    // least cutoff limbs run their Karatsuba/Toom-3 sub-products, their
+    // three NTT primes and slices of every NTT pass as pool tasks. Tasks
+    // fork again down to about log2(pool size) levels, on pool threads
+    // too, and wait through ThreadPool::wait. Set it up before
+    // multiplying; no pool means single-threaded.
+    struct Parallel {
+        ThreadPool *pool;
+        size_t cutoff;
+    };
+
+    static Parallel &parallelPolicy() {
+        static Parallel policy = {nullptr, 1000};
+        return policy;
+    }
+
+
 protected:
-    string value;
+    // Base 10^9 limbs, least significant first, without leading zero
+    // limbs. Zero has no limbs and is never negative.
+    typedef std::vector<uint32_t> Limbs;
+    static constexpr uint32_t Base = 1000000000;
+    static constexpr int BaseDigits = 9;
+
+    // Values that fit in int64_t are kept inline in small, with big
+    // false and no limbs. Only values outside that range use limbs and
+    // negative, so every value has exactly one representation.
+    Limbs limbs;
     bool negative = false;
+    int64_t small = 0;
+    bool big = false;
 
     int compareAbs(const BigInteger &bi) const;
+    bool isZero() const { return !big && small == 0; }
+    bool isNegative() const { return big ? negative : small < 0; }
+    uint64_t smallAbs() const { return small < 0 ? 0 - uint64_t(small) : uint64_t(small); }
+    // The magnitude as limbs; small values are spelled out in scratch.
+    const Limbs &mag(Limbs &scratch) const;
+    // Takes limbs as the magnitude and demotes the value to small
+    // when it fits; limbs keeps its capacity either way.
+    void normalize(bool isNeg);
+    // Same, taking the magnitude from m (left empty).
+    void setMag(Limbs &m, bool isNeg);
+    // *this += bi, or -= when subtract is set.
+    void addSigned(const BigInteger &bi, bool subtract);
+    static void toLimbs(uint64_t u, Limbs &r);
+
+    static void trim(Limbs &a);
+    static int compareMag(const Limbs &a, const Limbs &b);
+    static int compareMag(const Limbs &a, uint64_t u);
+    static void addSmall(Limbs &a, uint64_t u);
+    // Requires a >= u.
+    static void subSmall(Limbs &a, uint64_t u);
+    static void addMag(const Limbs &a, const Limbs &b, Limbs &r);
+    // Requires a >= b.
+    static void subMag(const Limbs &a, const Limbs &b, Limbs &r);
+    // Squares when a and b are the same object.
+    static void mulMag(const Limbs &a, const Limbs &b, Limbs &r);
+    static uint32_t divSmall(Limbs &a, uint32_t d);
+    static void mulSmall(Limbs &a, uint32_t m);
+    static void divMag(const Limbs &a, const Limbs &b, Limbs &q, Limbs &r);
+
+    // Divisors and quotients shorter than this, in limbs, use Knuth's
+    // algorithm D; longer ones recurse (Burnikel-Ziegler).
+    static constexpr size_t DivideThreshold = 60;
+
+    static void divKnuth(const Limbs &a, const Limbs &b, Limbs &q, Limbs &r);
+    static void div2n1n(const Limbs &a, const Limbs &b, size_t n, Limbs &q, Limbs &r);
+    static void div3n2n(const Limbs &a12, const Limbs &a3, const Limbs &b,
+                        const Limbs &b1, const Limbs &b2, size_t n,
+                        Limbs &q, Limbs &r);
+
+    typedef std::vector<uint8_t> Bits;      // least significant first
+    static void bitsOf(const Limbs &a, Bits &bits);
+    template<class Multiply>
+    static void slidingWindowPow(const Limbs &x, const Bits &bits,
+                                 Multiply multiply, Limbs &r);
+    class Barrett;
+
+    static void mulRec(const Limbs &a, const Limbs &b, Limbs &r, bool square);
+    static void schoolbookMul(const Limbs &a, const Limbs &b, Limbs &r);
+    static void schoolbookSquare(const Limbs &a, Limbs &r);
+    static void karatsuba(const Limbs &a, const Limbs &b, Limbs &r, bool square);
+    static void toom3(const Limbs &a, const Limbs &b, Limbs &r, bool square);
+    static void nttMul(const Limbs &a, const Limbs &b, Limbs &r, bool square);
+    // In-place iterative transform over Z/p, a.size() a power of two.
+    static void ntt(std::vector<uint32_t> &a, bool invert, uint32_t p);
+    static BigInteger signedProduct(const BigInteger &x, const BigInteger &y, bool square);
+    // Runs every job, forking per parallelPolicy for operands of size
+    // limbs; the calling thread takes the last job itself.
+    static void runAll(std::function<void()> jobs[], int count, size_t size);
+    // How many runAll calls enclose the running job.
+    static int &forkDepth() {
+        static thread_local int depth = 0;
+        return depth;
+    }
+    static Limbs slice(const Limbs &a, size_t from, size_t length);
+    // r += a * Base^shift
+    static void addShifted(Limbs &r, const Limbs &a, size_t shift);
 };
 
-BigInteger::BigInteger(int i) {
-    if (i < 0) {
-        value = std::to_string(-i);
-        negative = true;
-    } else {
-        value = std::to_string(i);
-        negative = false;
-    }
-}
+BigInteger::BigInteger(int64_t i) : small(i) {}
+
+BigInteger::BigInteger(const string &s) : BigInteger(s.data(), s.length()) {}
 
-BigInteger::BigInteger(const string &s) {
-    negative = false;
+BigInteger::BigInteger(const char *s, size_t count) {
+    bool isNeg = false;
     unsigned long begPos = 0;
-    if (s.empty()) {
-        value = "0";
-        negative = false;
+    if (count == 0) {
         return;
     }
     if (s[0] == '-') {
-        negative = true;
+        isNeg = true;
         begPos = 1;
     }
-    for (auto &c : s.substr(begPos)) {
-        if (c > '9' || c < '0') {
+    if (begPos == count) {
+        throw ParseError();
+    }
+    for (unsigned long i = begPos; i < count; ++i) {
+        if (s[i] > '9' || s[i] < '0') {
             throw ParseError();
         }
     }
-    value = s.substr(begPos);
+    // Up to 18 digits always fit in int64_t.
+    if (count - begPos <= 18) {
+        for (unsigned long i = begPos; i < count; ++i) {
+            small = small * 10 + (s[i] - '0');
+        }
+        if (isNeg)
+            small = -small;
+        return;
+    }
+    // Nine digits per limb, starting from the least significant end.
+    Limbs m;
+    m.reserve((count - begPos) / BaseDigits + 1);
+    for (long end = long(count); end > long(begPos); end -= BaseDigits) {
+        long beg = std::max(long(begPos), end - BaseDigits);
+        uint32_t limb = 0;
+        for (long i = beg; i < end; ++i) {
+            limb = limb * 10 + (s[i] - '0');
+        }
+        m.push_back(limb);
+    }
+    trim(m);
+    setMag(m, isNeg);
 }
 
-BigInteger::BigInteger(const BigInteger &bi) {
-    negative = bi.negative;
-    value = bi.value;
+BigInteger::BigInteger(const BigInteger &bi) :
+        limbs(bi.limbs), negative(bi.negative), small(bi.small), big(bi.big) {}
+
+BigInteger::BigInteger(BigInteger &&bi) _NOEXCEPT :
+        limbs(std::move(bi.limbs)), negative(bi.negative), small(bi.small), big(bi.big) {
+    bi.limbs.clear();
+    bi.negative = false;
+    bi.small = 0;
+    bi.big = false;
 }
 
 BigInteger &BigInteger::operator=(const BigInteger &bi) {
     if (&bi == this)
         return *this;
     negative = bi.negative;
-    value = bi.value;
+    small = bi.small;
+    big = bi.big;
+    if (big)
+        limbs = bi.limbs;
+    else
+        limbs.clear();
     return *this;
 }
 
-int BigInteger::compare(const BigInteger &bi) const {
-    if (negative && !bi.negative)
-        return -1;
-    if (bi.negative && !negative)
-        return 1;
+BigInteger &BigInteger::operator=(BigInteger &&bi) _NOEXCEPT {
+    if (&bi == this)
+        return *this;
+    // bi takes the old buffer, so neither side gives up its capacity.
+    limbs.swap(bi.limbs);
+    negative = bi.negative;
+    small = bi.small;
+    big = bi.big;
+    bi.limbs.clear();
+    bi.negative = false;
+    bi.small = 0;
+    bi.big = false;
+    return *this;
+}
 
-    int result = 0;
-    if (value.length() < bi.value.length()) {
-        result = -1;
-    } else if (value.length() > bi.value.length()) {
-        result = 1;
-    } else {
-        result = value.compare(bi.value);
+void BigInteger::toLimbs(uint64_t u, Limbs &r) {
+    r.clear();
+    while (u) {
+        r.push_back(uint32_t(u % Base));
+        u /= Base;
     }
-    if (negative)
-        result = -result;
-    return result;
 }
 
-BigInteger BigInteger::absolute() const {
-    if (negative)
-        return -*this;
-    return *this;
+const BigInteger::Limbs &BigInteger::mag(Limbs &scratch) const {
+    if (big)
+        return limbs;
+    toLimbs(smallAbs(), scratch);
+    return scratch;
 }
 
-int BigInteger::compareAbs(const BigInteger &bi) const {
-    return this->absolute().compare(bi.absolute());
+void BigInteger::normalize(bool isNeg) {
+    // Three limbs with a top limb of at most 9 stay below 10^19 < 2^64.
+    if (limbs.size() < 3 || (limbs.size() == 3 && limbs[2] <= 9)) {
+        uint64_t u = 0;
+        for (size_t i = limbs.size(); i > 0; --i) {
+            u = u * Base + limbs[i - 1];
+        }
+        const uint64_t limit = uint64_t(INT64_MAX) + (isNeg ? 1 : 0);
+        if (u <= limit) {
+            small = isNeg ? int64_t(0 - u) : int64_t(u);
+            big = false;
+            negative = false;
+            limbs.clear();
+            return;
+        }
+    }
+    negative = isNeg;
+    small = 0;
+    big = true;
 }
 
-BigInteger BigInteger::operator+(const BigInteger &bi) const {
-    using std::reverse;
-    BigInteger result;
-    string lhs = value, rhs = bi.value;
-    reverse(lhs.begin(), lhs.end());
-    reverse(rhs.begin(), rhs.end());
-    if (this->negative == bi.negative) {
-        // Adding
-        result.value = "";
-        unsigned long length = std::min(lhs.length(), rhs.length());
-        int i = 0;
-        for (; i < length; i++) {
-            // Roughly adding each digit, not caring carrying.
-            result.value.push_back(lhs[i] - '0' + rhs[i]);
-        }
-
-        if (length < lhs.length()) {
-            result.value += lhs.substr(i);
-        } else if (length < rhs.length()) {
-            result.value += rhs.substr(i);
-        }
-
-        int carry = 0;
-        for (auto &c : result.value) {
-            int temp = c + carry - '0';
-            carry = temp / 10;
-            temp %= 10;
-            c = temp + '0';
-        }
-        if (carry != 0) {
-            result.value.push_back('1');
-        }
-        result.negative = negative;
-    } else {
-        // Subtracting
+void BigInteger::setMag(Limbs &m, bool isNeg) {
+    limbs.swap(m);
+    m.clear();
+    normalize(isNeg);
+}
 
-        int flag = compareAbs(bi);
-        if (flag == -1) {
-            return bi + *this;
-        } else if (!flag) {
-            return BigInteger("0");
-        } else {
-            result.value = "";
-            unsigned long length = std::min(lhs.length(), rhs.length());
-            int i = 0;
-            for (; i < length; ++i) {
-                // Roughly subtracting each digit, not caring carrying.
-                result.value.push_back(lhs[i] - (rhs[i] - '0'));
-            }
+void BigInteger::trim(Limbs &a) {
+    while (!a.empty() && a.back() == 0) {
+        a.pop_back();
+    }
+}
 
-            if (i < lhs.length()) {
-                result.value += lhs.substr(i);
-            }
-//            std::cout << result.value << std::endl;
-            int carry = 0;
-            for (auto &c : result.value) {
-                int temp = c - carry - '0';
-                carry = (temp < 0);
-                temp = carry * 10 + temp;
-                c = temp + '0';
-            }
-            result.negative = negative;
-        }
+int BigInteger::compareMag(const Limbs &a, const Limbs &b) {
+    if (a.size() != b.size())
+        return a.size() < b.size() ? -1 : 1;
+    for (size_t i = a.size(); i > 0; --i) {
+        if (a[i - 1] != b[i - 1])
+            return a[i - 1] < b[i - 1] ? -1 : 1;
     }
-    reverse(result.value.begin(), result.value.end());
-    auto valid = result.value.find_first_not_of('0');
-    if (valid == string::npos) {
-        return BigInteger("0");
+    return 0;
+}
+
+int BigInteger::compareMag(const Limbs &a, uint64_t u) {
+    uint32_t b[3];
+    size_t n = 0;
+    for (; u; u /= Base) {
+        b[n++] = uint32_t(u % Base);
     }
-    result.value = result.value.substr(valid);
-    return result;
+    if (a.size() != n)
+        return a.size() < n ? -1 : 1;
+    for (size_t i = n; i > 0; --i) {
+        if (a[i - 1] != b[i - 1])
+            return a[i - 1] < b[i - 1] ? -1 : 1;
+    }
+    return 0;
 }
 
-std::ostream &BigInteger::show(std::ostream &os) const {
-    if (negative)
-        os << '-';
-    os << value;
-    return os;
+void BigInteger::addSmall(Limbs &a, uint64_t u) {
+    for (size_t i = 0; u; ++i) {
+        if (i == a.size())
+            a.push_back(0);
+        uint64_t sum = a[i] + u % Base;
+        u /= Base;
+        if (sum >= Base) {
+            sum -= Base;
+            ++u;
+        }
+        a[i] = uint32_t(sum);
+    }
 }
 
-BigInteger BigInteger::operator-(const BigInteger &bi) const {
-    return (*this + (-bi));
+void BigInteger::subSmall(Limbs &a, uint64_t u) {
+    for (size_t i = 0; u; ++i) {
+        uint32_t sub = uint32_t(u % Base);
+        u /= Base;
+        if (a[i] < sub) {
+            a[i] = a[i] + Base - sub;
+            ++u;
+        } else {
+            a[i] -= sub;
+        }
+    }
+    trim(a);
 }
 
-BigInteger BigInteger::operator-() const {
-    auto ret = BigInteger(*this);
-    ret.negative = !negative;
-    return ret;
+// Both work in place: r may be a or b.
+void BigInteger::addMag(const Limbs &a, const Limbs &b, Limbs &r) {
+    const Limbs &longer = a.size() >= b.size() ? a : b;
+    const Limbs &shorter = a.size() >= b.size() ? b : a;
+    // Sizes are taken first, r may be resizing one of the operands.
+    size_t n = longer.size(), m = shorter.size();
+    r.resize(n + 1);
+    uint32_t carry = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t sum = longer[i] + carry + (i < m ? shorter[i] : 0);
+        carry = sum >= Base;
+        r[i] = carry ? sum - Base : sum;
+    }
+    r[n] = carry;
+    trim(r);
 }
 
-BigInteger BigInteger::operator+() const {
-    return *this;
+void BigInteger::subMag(const Limbs &a, const Limbs &b, Limbs &r) {
+    size_t m = b.size();
+    r.resize(a.size());
+    uint32_t borrow = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        uint32_t sub = borrow + (i < m ? b[i] : 0);
+        borrow = a[i] < sub;
+        r[i] = borrow ? a[i] + Base - sub : a[i] - sub;
+    }
+    trim(r);
 }
 
-BigInteger BigInteger::operator*(const BigInteger &bi) const {
-    using std::reverse;
-    if (this->value == "0" || bi.value == "0") {
-        return BigInteger("0");
+// Three NTT-friendly primes; their product (about 2^86) bounds every
+// convolution coefficient, n * (Base - 1)^2, for n below 2^26.
+static const uint32_t NttPrimes[3] = {998244353, 167772161, 469762049};
+static const uint32_t NttRoot = 3;          // primitive root of all three
+static const size_t NttMaxLength = size_t(1) << 23;
+
+static uint32_t powMod(uint32_t b, uint64_t e, uint32_t p) {
+    uint64_t result = 1, base = b;
+    while (e) {
+        if (e & 1)
+            result = result * base % p;
+        base = base * base % p;
+        e >>= 1;
+    }
+    return uint32_t(result);
+}
+
+void BigInteger::ntt(std::vector<uint32_t> &a, bool invert, uint32_t p) {
+    size_t n = a.size();
+    for (size_t i = 1, j = 0; i < n; ++i) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j)
+            std::swap(a[i], a[j]);
+    }
+    // roots[half + k] is the k-th power of the len-th root of unity,
+    // len = 2 half; each level is every other root of the one above.
+    // quotients[i] = floor(roots[i] 2^32 / p) turns y roots[i] % p into
+    // two multiplications (Shoup), as p is only known at run time.
+    std::vector<uint32_t> roots(n), quotients(n);
+    if (n >= 2) {
+        uint32_t w = powMod(NttRoot, (p - 1) / n, p);
+        if (invert)
+            w = powMod(w, p - 2, p);
+        roots[n / 2] = 1;
+        for (size_t k = n / 2 + 1; k < n; ++k) {
+            roots[k] = uint32_t(uint64_t(roots[k - 1]) * w % p);
+        }
+        for (size_t k = n / 2; k < n; ++k) {
+            quotients[k] = uint32_t((uint64_t(roots[k]) << 32) / p);
+        }
+        for (size_t k = n / 2 - 1; k > 0; --k) {
+            roots[k] = roots[2 * k];
+            quotients[k] = quotients[2 * k];
+        }
     }
-    BigInteger result = BigInteger();
-    if (this->negative != bi.negative) {
-        result.negative = true;
-    }
-    string lhs = value, rhs = bi.value;
-    reverse(lhs.begin(), lhs.end());
-    reverse(rhs.begin(), rhs.end());
-    result.value.resize(lhs.length() + rhs.length(), '0');
-
-    // Loop for multiplying
-    for (int i = 0; i < lhs.length(); i++) {
-        for (int j = 0; j < rhs.length(); j++) {
-            int temp = (result.value[i + j] - '0') +
-                       (lhs[i] - '0') * (rhs[j] - '0');
-            int carry = temp / 10;
-            result.value[i + j] = temp % 10 + '0';
-            // Adding carrying to every digit
-            for (int higherDigits = i + j + 1;
-                 carry != 0 && higherDigits < result.value.length();
-                 higherDigits++) {
-                int renewal = result.value[higherDigits] - '0' + carry;
-                carry = renewal / 10;
-                result.value[higherDigits] = renewal % 10 + '0';
+    const Parallel &policy = parallelPolicy();
+    const int parts = policy.pool ? int(std::min(policy.pool->size(), 8u)) : 1;
+    std::vector<std::function<void()> > slices(parts);
+    for (size_t half = 1; half < n; half <<= 1) {
+        // Butterfly t pairs i and i + half, k = t % half and i the
+        // k-th element of block t / half; slices take n / 2 / parts each.
+        auto butterflies = [&a, &roots, &quotients, half, p](size_t from, size_t to) {
+            while (from < to) {
+                size_t k = from & (half - 1), run = std::min(to - from, half - k);
+                uint32_t *x = &a[2 * from - k], *y = x + half;
+                const uint32_t *w = &roots[half + k], *q = &quotients[half + k];
+                for (size_t j = 0; j < run; ++j) {
+                    // y w - floor(y q / 2^32) p lies in [0, 2p)
+                    uint32_t v = y[j] * w[j] - uint32_t(uint64_t(y[j]) * q[j] >> 32) * p;
+                    v = v >= p ? v - p : v;
+                    uint32_t sum = x[j] + v, difference = x[j] + p - v;
+                    x[j] = sum >= p ? sum - p : sum;
+                    y[j] = difference >= p ? difference - p : difference;
+                }
+                from += run;
             }
+        };
+        for (int j = 0; j < parts; ++j) {
+            size_t from = n / 2 * j / parts, to = n / 2 * (j + 1) / parts;
+            slices[j] = [&butterflies, from, to] { butterflies(from, to); };
+        }
+        runAll(slices.data(), parts, n);
+    }
+    if (invert) {
+        uint32_t inv = powMod(uint32_t(n % p), p - 2, p);
+        uint32_t quotient = uint32_t((uint64_t(inv) << 32) / p);
+        for (size_t i = 0; i < n; ++i) {
+            uint32_t v = a[i] * inv - uint32_t(uint64_t(a[i]) * quotient >> 32) * p;
+            a[i] = v >= p ? v - p : v;
         }
     }
+}
 
-    reverse(result.value.begin(), result.value.end());
-    result.value = result.value.substr(result.value.find_first_not_of('0'));
-    return result;
+void BigInteger::mulMag(const Limbs &a, const Limbs &b, Limbs &r) {
+    Limbs result;
+    mulRec(a, b, result, &a == &b);
+    r.swap(result);
 }
 
-// Throws DivideByZero exception
-BigInteger BigInteger::operator/(const BigInteger &bi) const {
-    if (bi.value == "0") {
-        throw DivideByZero();
+void BigInteger::mulRec(const Limbs &a, const Limbs &b, Limbs &r, bool square) {
+    if (a.size() < b.size()) {
+        mulRec(b, a, r, false);
+        return;
+    }
+    size_t n = a.size(), m = b.size();
+    const Thresholds &t = multiplyThresholds();
+    if (m == 0) {
+        r.clear();
+    } else if (m >= t.ntt && n + m <= NttMaxLength) {
+        nttMul(a, b, r, square);
+    } else if (m < t.karatsuba) {
+        if (square)
+            schoolbookSquare(a, r);
+        else
+            schoolbookMul(a, b, r);
+    } else if (2 * m <= n) {
+        // Lopsided: multiply b by one m-limb piece of a at a time.
+        r.assign(n + m, 0);
+        Limbs product;
+        for (size_t from = 0; from < n; from += m) {
+            mulRec(slice(a, from, m), b, product, false);
+            addShifted(r, product, from);
+        }
+        trim(r);
+    } else if (m < t.toom3) {
+        karatsuba(a, b, r, square);
+    } else {
+        toom3(a, b, r, square);
     }
+}
 
-    // Integer division, return 0 if |*this| < |bi|
-    int cmp = this->compareAbs(bi);
-    if (cmp == -1) {
-        return BigInteger("0");
+BigInteger::Limbs BigInteger::slice(const Limbs &a, size_t from, size_t length) {
+    if (from >= a.size())
+        return Limbs();
+    Limbs part(a.begin() + from, a.begin() + std::min(a.size(), from + length));
+    trim(part);
+    return part;
+}
+
+void BigInteger::addShifted(Limbs &r, const Limbs &a, size_t shift) {
+    if (r.size() < shift + a.size() + 1)
+        r.resize(shift + a.size() + 1, 0);
+    uint32_t carry = 0;
+    size_t i = 0;
+    for (; i < a.size() || carry; ++i) {
+        if (shift + i == r.size())
+            r.push_back(0);
+        uint32_t sum = r[shift + i] + carry + (i < a.size() ? a[i] : 0);
+        carry = sum >= Base;
+        r[shift + i] = carry ? sum - Base : sum;
     }
+    trim(r);
+}
 
-    BigInteger result("0");
-    if (cmp == 0) {
-        result = BigInteger("1");
-    } else {
-        BigInteger absLhs(this->absolute()), absRhs(bi.absolute());
-        const BigInteger kTen("10");
-        for (int loopCount = int(value.length() - bi.value.length());
-             loopCount >= 0;
-             --loopCount) {
-            BigInteger temp(absRhs);
-            for (int i = 0; i < loopCount; ++i) {
-                temp = temp * kTen;
+// Products are summed in 64-bit columns and carried every few rows,
+// instead of carrying after every single product.
+void BigInteger::schoolbookMul(const Limbs &a, const Limbs &b, Limbs &r) {
+    const size_t RowsPerCarry = 16;     // 16 * (Base - 1)^2 + Base < 2^64
+    std::vector<uint64_t> acc(a.size() + b.size(), 0);
+    for (size_t i = 0; i < a.size(); ++i) {
+        uint64_t x = a[i];
+        for (size_t j = 0; j < b.size(); ++j) {
+            acc[i + j] += x * b[j];
+        }
+        if ((i + 1) % RowsPerCarry == 0 || i + 1 == a.size()) {
+            uint64_t carry = 0;
+            for (size_t k = 0; k < acc.size(); ++k) {
+                acc[k] += carry;
+                carry = acc[k] / Base;
+                acc[k] %= Base;
             }
+        }
+    }
+    r.assign(acc.begin(), acc.end());
+    trim(r);
+}
 
-            int divider = 0;
-            while (absLhs.compareAbs(temp) >= 0) {
-                absLhs = absLhs - temp;
-                ++divider;
+// Every cross product is computed once and doubled.
+void BigInteger::schoolbookSquare(const Limbs &a, Limbs &r) {
+    const size_t RowsPerCarry = 8;      // 8 * 2 * (Base - 1)^2 + Base < 2^64
+    std::vector<uint64_t> acc(2 * a.size(), 0);
+    for (size_t i = 0; i < a.size(); ++i) {
+        uint64_t x = a[i];
+        acc[2 * i] += x * x;
+        uint64_t twice = 2 * x;
+        for (size_t j = i + 1; j < a.size(); ++j) {
+            acc[i + j] += twice * a[j];
+        }
+        if ((i + 1) % RowsPerCarry == 0 || i + 1 == a.size()) {
+            uint64_t carry = 0;
+            for (size_t k = 0; k < acc.size(); ++k) {
+                acc[k] += carry;
+                carry = acc[k] / Base;
+                acc[k] %= Base;
             }
-            result = result * kTen + BigInteger(divider);
         }
     }
-    result.negative = negative ^ bi.negative;
-    return result;
+    r.assign(acc.begin(), acc.end());
+    trim(r);
 }
 
-// Throws DivideByZero exception
-BigInteger BigInteger::operator%(const BigInteger &bi) const {
-    BigInteger divider = *this / bi;
-    return ((*this - divider * bi).compareAbs(*this - (divider * bi - bi)) < 0) ? (*this - divider * bi) : (*this - (divider * bi - bi));
+// (a1 B + a0)(b1 B + b0) with three half-size products,
+// z1 = (a0 + a1)(b0 + b1) - z0 - z2.
+void BigInteger::karatsuba(const Limbs &a, const Limbs &b, Limbs &r, bool square) {
+    size_t k = a.size() / 2;
+    Limbs a0 = slice(a, 0, k), a1 = slice(a, k, a.size());
+    Limbs b0, b1, z0, z1, z2, sumA, sumB;
+    addMag(a0, a1, sumA);
+    if (!square) {
+        b0 = slice(b, 0, k);
+        b1 = slice(b, k, b.size());
+        addMag(b0, b1, sumB);
+    }
+    // Squares pass the same limbs twice.
+    const Limbs &c0 = square ? a0 : b0, &c1 = square ? a1 : b1;
+    const Limbs &sumC = square ? sumA : sumB;
+    std::function<void()> jobs[3] = {
+            [&] { mulRec(a0, c0, z0, square); },
+            [&] { mulRec(a1, c1, z2, square); },
+            [&] { mulRec(sumA, sumC, z1, square); }
+    };
+    runAll(jobs, 3, b.size());
+    subMag(z1, z0, z1);
+    subMag(z1, z2, z1);
+    r.assign(a.size() + b.size() + 1, 0);
+    addShifted(r, z0, 0);
+    addShifted(r, z1, k);
+    addShifted(r, z2, 2 * k);
+    trim(r);
 }
 
-BigInteger BigInteger::operator^(const BigInteger &bi) const {
-    BigInteger kZero("0");
-    int powZero = bi.compare(kZero);
-    int thisIsZero = compare(kZero);
-    if (thisIsZero == 0) {
-        if (powZero <= 0) {
-            throw DivideByZero();
-        } else {
-            return BigInteger("0");
+BigInteger BigInteger::signedProduct(const BigInteger &x, const BigInteger &y, bool square) {
+    BigInteger result;
+    Limbs sx, sy, r;
+    const Limbs &a = x.mag(sx);
+    mulRec(a, square ? a : y.mag(sy), r, square);
+    result.setMag(r, !square && x.isNegative() != y.isNegative());
+    return result;
+}
+
+void BigInteger::runAll(std::function<void()> jobs[], int count, size_t size) {
+    const Parallel &policy = parallelPolicy();
+    // Each level multiplies the tasks by count, so 1 + log2(pool size)
+    // levels are enough to keep every thread busy.
+    int budget = 1;
+    for (unsigned n = policy.pool ? policy.pool->size() : 0; n > 1; n >>= 1) {
+        ++budget;
+    }
+    if (!policy.pool || size < policy.cutoff || forkDepth() >= budget) {
+        for (int i = 0; i < count; ++i) {
+            jobs[i]();
         }
-    } else if (powZero == 0) {
-        return BigInteger("1");
-    } else if (powZero < 0) {
-        std::cerr
-                << "Warning: Integer to negative power always evaluate to zero\n";
-        return BigInteger("0");
+        return;
     }
-
-    BigInteger result("1");
-    BigInteger lhs = *this, rhs = bi;
-    while (rhs.compare(kZero) > 0) {
-        bool isOdd = (unsigned) (rhs.value.back() - '0') & 1u;
-        if (isOdd) {
-            result = result * lhs;
+    // Runs a job one level deeper, on whichever thread takes it.
+    struct Level {
+        int saved;
+        explicit Level(int depth) : saved(forkDepth()) { forkDepth() = depth; }
+        ~Level() { forkDepth() = saved; }
+    };
+    const int depth = forkDepth() + 1;
+    std::vector<std::future<void> > pending;
+    for (int i = 0; i + 1 < count; ++i) {
+        std::function<void()> &job = jobs[i];
+        pending.push_back(policy.pool->submit([&job, depth] {
+            Level level(depth);
+            job();
+        }));
+    }
+    // The jobs refer to the caller's locals: wait for all of them
+    // even if one throws.
+    std::exception_ptr error;
+    try {
+        Level level(depth);
+        jobs[count - 1]();
+    } catch (...) {
+        error = std::current_exception();
+    }
+    for (size_t i = 0; i < pending.size(); ++i) {
+        try {
+            policy.pool->wait(pending[i]);
+        } catch (...) {
+            if (!error)
+                error = std::current_exception();
         }
-        lhs = lhs * lhs;
-        rhs = rhs / BigInteger("2");
     }
-    return result;
+    if (error)
+        std::rethrow_exception(error);
 }
 
-bool BigInteger::operator==(const BigInteger &bi) const {
-    return this->compare(bi) == 0;
-}
+// Toom-Cook 3-way: evaluate both operands at 0, 1, -1, -2 and infinity,
+// multiply pointwise and interpolate (Bodrato's sequence).
+void BigInteger::toom3(const Limbs &a, const Limbs &b, Limbs &r, bool square) {
+    size_t k = (a.size() + 2) / 3;
+    BigInteger x[3], y[3];
+    for (int i = 0; i < 3; ++i) {
+        Limbs part = slice(a, i * k, k);
+        x[i].setMag(part, false);
+        part = slice(b, i * k, k);
+        y[i].setMag(part, false);
+    }
+    auto evaluate = [](const BigInteger p[3], BigInteger &one, BigInteger &minusOne,
+                       BigInteger &minusTwo) {
+        BigInteger even = p[0] + p[2];
+        one = even + p[1];
+        minusOne = even - p[1];
+        minusTwo = minusOne + p[2];
+        minusTwo = minusTwo + minusTwo - p[0];
+    };
+    BigInteger x1, xm1, xm2, y1, ym1, ym2;
+    evaluate(x, x1, xm1, xm2);
+    if (!square)
+        evaluate(y, y1, ym1, ym2);
+
+    BigInteger r0, r1, rm1, rm2, rInf;
+    std::function<void()> jobs[5] = {
+            [&] { r0 = signedProduct(x[0], y[0], square); },
+            [&] { r1 = signedProduct(x1, y1, square); },
+            [&] { rm1 = signedProduct(xm1, ym1, square); },
+            [&] { rm2 = signedProduct(xm2, ym2, square); },
+            [&] { rInf = signedProduct(x[2], y[2], square); }
+    };
+    runAll(jobs, 5, b.size());
 
-std::ostream &operator<<(std::ostream &os, const BigInteger &bi) {
-    bi.show(os);
-    return os;
+    auto divideExact = [](BigInteger &v, uint32_t d) {
+        Limbs scratch;
+        Limbs m = v.mag(scratch);
+        divSmall(m, d);
+        v.setMag(m, v.isNegative());
+    };
+    BigInteger r3 = rm2 - r1;
+    divideExact(r3, 3);
+    BigInteger r1h = r1 - rm1;
+    divideExact(r1h, 2);
+    BigInteger r2 = rm1 - r0;
+    r3 = r2 - r3;
+    divideExact(r3, 2);
+    r3 = r3 + rInf + rInf;
+    r2 = r2 + r1h - rInf;
+    r1 = r1h - r3;
+
+    Limbs scratch;
+    r.assign(a.size() + b.size() + 1, 0);
+    addShifted(r, r0.mag(scratch), 0);
+    addShifted(r, r1.mag(scratch), k);
+    addShifted(r, r2.mag(scratch), 2 * k);
+    addShifted(r, r3.mag(scratch), 3 * k);
+    addShifted(r, rInf.mag(scratch), 4 * k);
+    trim(r);
 }
 
+// Convolves the limbs modulo each prime, rebuilds the exact coefficients
+// with the Chinese remainder theorem (Garner) and carries in base 10^9.
+void BigInteger::nttMul(const Limbs &a, const Limbs &b, Limbs &r, bool square) {
+    size_t need = a.size() + b.size() - 1, n = 1;
+    while (n < need) {
+        n <<= 1;
+    }
+    std::vector<uint32_t> conv[3];
+    auto convolve = [&](int k) {
+        uint32_t p = NttPrimes[k];
+        std::vector<uint32_t> fa(n, 0);
+        for (size_t i = 0; i < a.size(); ++i) {
+            fa[i] = a[i] % p;
+        }
+        ntt(fa, false, p);
+        if (square) {
+            for (size_t i = 0; i < n; ++i) {
+                fa[i] = uint32_t(uint64_t(fa[i]) * fa[i] % p);
+            }
+        } else {
+            std::vector<uint32_t> fb(n, 0);
+            for (size_t i = 0; i < b.size(); ++i) {
+                fb[i] = b[i] % p;
+            }
+            ntt(fb, false, p);
+            for (size_t i = 0; i < n; ++i) {
+                fa[i] = uint32_t(uint64_t(fa[i]) * fb[i] % p);
+            }
+        }
+        ntt(fa, true, p);
+        conv[k].swap(fa);
+    };
+    std::function<void()> jobs[3] = {
+            [&] { convolve(0); }, [&] { convolve(1); }, [&] { convolve(2); }
+    };
+    runAll(jobs, 3, b.size());
+
+    const uint64_t p0 = NttPrimes[0], p1 = NttPrimes[1], p2 = NttPrimes[2];
+    const uint64_t inv01 = powMod(uint32_t(p0 % p1), p1 - 2, uint32_t(p1));
+    const uint64_t inv02 = powMod(uint32_t(p0 % p2), p2 - 2, uint32_t(p2));
+    const uint64_t inv12 = powMod(uint32_t(p1 % p2), p2 - 2, uint32_t(p2));
+    r.assign(need + 3, 0);
+    unsigned __int128 carry = 0;
+    for (size_t i = 0; i < need; ++i) {
+        uint64_t x0 = conv[0][i];
+        uint64_t x1 = (conv[1][i] + p1 - x0 % p1) % p1 * inv01 % p1;
+        uint64_t x2 = (conv[2][i] + p2 - x0 % p2) % p2 * inv02 % p2;
+        x2 = (x2 + p2 - x1 % p2) % p2 * inv12 % p2;
+        unsigned __int128 value = x0 + (unsigned __int128) x1 * p0 +
+                                  (unsigned __int128) x2 * p0 * p1 + carry;
+        r[i] = uint32_t(value % Base);
+        carry = value / Base;
+    }
+    for (size_t i = need; carry; ++i) {
+        r[i] = uint32_t(carry % Base);
+        carry /= Base;
+    }
+    trim(r);
+}
 
+// a /= d, returns a % d.
+uint32_t BigInteger::divSmall(Limbs &a, uint32_t d) {
+    uint64_t rem = 0;
+    for (size_t i = a.size(); i > 0; --i) {
+        uint64_t cur = a[i - 1] + rem * Base;
+        a[i - 1] = uint32_t(cur / d);
+        rem = cur % d;
+    }
+    trim(a);
+    return uint32_t(rem);
+}
 
-///------------------------ ExpressionExceptions ----------------------------///
-class UnidentifiedToken : public std::exception {
-public:
-    explicit UnidentifiedToken(char o) : op(o) {}
+void BigInteger::mulSmall(Limbs &a, uint32_t m) {
+    uint64_t carry = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        uint64_t cur = uint64_t(a[i]) * m + carry;
+        a[i] = uint32_t(cur % Base);
+        carry = cur / Base;
+    }
+    if (carry)
+        a.push_back(uint32_t(carry));
+    trim(a);
+}
 
-    const char *what() const _NOEXCEPT override {
+void BigInteger::divMag(const Limbs &a, const Limbs &b, Limbs &q, Limbs &r) {
+    if (compareMag(a, b) < 0) {
+        Limbs rem = a;
+        q.clear();
+        r.swap(rem);
+        return;
+    }
+    size_t n = b.size();
+    if (n < DivideThreshold || a.size() - n < DivideThreshold) {
+        divKnuth(a, b, q, r);
+        return;
+    }
+    // Scale so the top limb of the divisor is at least Base / 2, then
+    // feed the dividend to div2n1n n limbs at a time, top first.
+    uint32_t d = Base / (b.back() + 1);
+    Limbs u = a, v = b, quotient, digit, rem, chunk;
+    mulSmall(u, d);
+    mulSmall(v, d);
+    size_t chunks = (u.size() + n - 1) / n;
+    quotient.assign(chunks * n + 1, 0);
+    for (size_t k = chunks; k > 0; --k) {
+        chunk = slice(u, (k - 1) * n, n);
+        rem.insert(rem.begin(), n, 0);
+        addShifted(rem, chunk, 0);
+        div2n1n(rem, v, n, digit, rem);
+        addShifted(quotient, digit, (k - 1) * n);
+    }
+    trim(quotient);
+    divSmall(rem, d);
+    q.swap(quotient);
+    r.swap(rem);
+}
+
+// Knuth, TAOCP vol. 2, 4.3.1, algorithm D.
+void BigInteger::divKnuth(const Limbs &a, const Limbs &b, Limbs &q, Limbs &r) {
+    if (compareMag(a, b) < 0) {
+        Limbs rem = a;
+        q.clear();
+        r.swap(rem);
+        return;
+    }
+    if (b.size() == 1) {
+        Limbs quotient = a;
+        uint32_t rem = divSmall(quotient, b[0]);
+        q.swap(quotient);
+        r.clear();
+        if (rem)
+            r.push_back(rem);
+        return;
+    }
+    size_t n = b.size(), m = a.size() - n;
+    uint32_t d = Base / (b.back() + 1);
+    Limbs u = a, v = b, quotient(m + 1, 0);
+    mulSmall(u, d);
+    mulSmall(v, d);
+    u.resize(a.size() + 1, 0);
+    const uint64_t vTop = v[n - 1], vNext = v[n - 2];
+    for (size_t j = m + 1; j-- > 0;) {
+        uint64_t num = uint64_t(u[j + n]) * Base + u[j + n - 1];
+        uint64_t qhat = num / vTop, rhat = num % vTop;
+        while (qhat >= Base || qhat * vNext > rhat * Base + u[j + n - 2]) {
+            --qhat;
+            rhat += vTop;
+            if (rhat >= Base)
+                break;
+        }
+        // u[j .. j+n] -= qhat * v
+        uint64_t carry = 0;
+        int64_t borrow = 0;
+        for (size_t i = 0; i < n; ++i) {
+            uint64_t product = qhat * v[i] + carry;
+            carry = product / Base;
+            int64_t t = int64_t(u[i + j]) - int64_t(product % Base) - borrow;
+            borrow = t < 0;
+            u[i + j] = uint32_t(t < 0 ? t + Base : t);
+        }
+        int64_t top = int64_t(u[j + n]) - int64_t(carry) - borrow;
+        if (top < 0) {
+            // qhat was one too large: add v back.
+            u[j + n] = uint32_t(top + Base);
+            --qhat;
+            uint32_t c = 0;
+            for (size_t i = 0; i < n; ++i) {
+                uint32_t sum = u[i + j] + v[i] + c;
+                c = sum >= Base;
+                u[i + j] = c ? sum - Base : sum;
+            }
+            u[j + n] = (u[j + n] + c) % Base;
+        } else {
+            u[j + n] = uint32_t(top);
+        }
+        quotient[j] = uint32_t(qhat);
+    }
+    trim(quotient);
+    u.resize(n);
+    trim(u);
+    divSmall(u, d);
+    q.swap(quotient);
+    r.swap(u);
+}
+
+// a < b * Base^n, b has n limbs and a normalised top limb.
+void BigInteger::div2n1n(const Limbs &a, const Limbs &b, size_t n, Limbs &q, Limbs &r) {
+    if (a.size() <= n + DivideThreshold) {
+        divKnuth(a, b, q, r);
+        return;
+    }
+    Limbs u = a, v = b;
+    bool pad = n & 1;
+    if (pad) {
+        // Shifting by a whole limb keeps the divisor normalised.
+        u.insert(u.begin(), 0);
+        v.insert(v.begin(), 0);
+        ++n;
+    }
+    size_t half = n / 2;
+    Limbs b1 = slice(v, half, half), b2 = slice(v, 0, half);
+    Limbs q1, q2, rem;
+    div3n2n(slice(u, n, u.size()), slice(u, half, half), v, b1, b2, half, q1, rem);
+    div3n2n(rem, slice(u, 0, half), v, b1, b2, half, q2, rem);
+    if (pad && !rem.empty())
+        rem.erase(rem.begin());
+    q.assign(n + 1, 0);
+    addShifted(q, q1, half);
+    addShifted(q, q2, 0);
+    trim(q);
+    r.swap(rem);
+}
+
+// Divides [a12, a3] (a3 has n limbs) by b = [b1, b2]; the quotient
+// fits in n limbs.
+void BigInteger::div3n2n(const Limbs &a12, const Limbs &a3, const Limbs &b,
+                         const Limbs &b1, const Limbs &b2, size_t n,
+                         Limbs &q, Limbs &r) {
+    Limbs quotient, rem;
+    if (compareMag(slice(a12, n, a12.size()), b1) == 0) {
+        // Quotient would be Base^n or more: take Base^n - 1.
+        quotient.assign(n, Base - 1);
+        Limbs shifted(n, 0);
+        shifted.insert(shifted.end(), b1.begin(), b1.end());
+        addMag(a12, b1, rem);
+        subMag(rem, shifted, rem);
+    } else {
+        div2n1n(a12, b1, n, quotient, rem);
+    }
+    // rem * Base^n + a3 - quotient * b2, fixed up while negative.
+    rem.insert(rem.begin(), n, 0);
+    addShifted(rem, a3, 0);
+    Limbs product;
+    mulMag(quotient, b2, product);
+    const Limbs one(1, 1);
+    while (compareMag(rem, product) < 0) {
+        subMag(quotient, one, quotient);
+        addMag(rem, b, rem);
+    }
+    subMag(rem, product, rem);
+    q.swap(quotient);
+    r.swap(rem);
+}
+
+int BigInteger::compare(const BigInteger &bi) const {
+    if (!big && !bi.big)
+        return (small > bi.small) - (small < bi.small);
+    // A big value lies beyond every small one.
+    if (!bi.big)
+        return negative ? -1 : 1;
+    if (!big)
+        return bi.negative ? 1 : -1;
+    if (negative && !bi.negative)
+        return -1;
+    if (bi.negative && !negative)
+        return 1;
+
+    int result = compareMag(limbs, bi.limbs);
+    if (negative)
+        result = -result;
+    return result;
+}
+
+BigInteger BigInteger::absolute() const {
+    if (isNegative())
+        return -*this;
+    return *this;
+}
+
+int BigInteger::compareAbs(const BigInteger &bi) const {
+    if (!big && !bi.big) {
+        uint64_t a = smallAbs(), b = bi.smallAbs();
+        return (a > b) - (a < b);
+    }
+    if (!bi.big)
+        return compareMag(limbs, bi.smallAbs());
+    if (!big)
+        return -compareMag(bi.limbs, smallAbs());
+    return compareMag(limbs, bi.limbs);
+}
+
+void BigInteger::addSigned(const BigInteger &bi, bool subtract) {
+    bool aNeg = isNegative(), bNeg = bi.isNegative() != subtract;
+    if (!bi.big) {
+        // Read before limbs changes: bi may be *this.
+        uint64_t u = bi.smallAbs();
+        if (!big)
+            toLimbs(smallAbs(), limbs);
+        // Two small values only get here when they overflow, which
+        // needs equal signs, so a subtraction always has a big *this
+        // and |*this| >= u.
+        if (aNeg == bNeg)
+            addSmall(limbs, u);
+        else
+            subSmall(limbs, u);
+        normalize(aNeg);
+        return;
+    }
+    if (!big)
+        toLimbs(smallAbs(), limbs);
+    if (aNeg == bNeg) {
+        addMag(limbs, bi.limbs, limbs);
+        normalize(aNeg);
+        return;
+    }
+    int flag = compareMag(limbs, bi.limbs);
+    if (flag < 0) {
+        subMag(bi.limbs, limbs, limbs);
+        normalize(bNeg);
+    } else if (flag > 0) {
+        subMag(limbs, bi.limbs, limbs);
+        normalize(aNeg);
+    } else {
+        limbs.clear();
+        normalize(false);
+    }
+}
+
+BigInteger &BigInteger::operator+=(const BigInteger &bi) {
+    int64_t sum;
+    if (!big && !bi.big && !__builtin_add_overflow(small, bi.small, &sum))
+        small = sum;
+    else
+        addSigned(bi, false);
+    return *this;
+}
+
+BigInteger &BigInteger::operator-=(const BigInteger &bi) {
+    int64_t difference;
+    if (!big && !bi.big && !__builtin_sub_overflow(small, bi.small, &difference))
+        small = difference;
+    else
+        addSigned(bi, true);
+    return *this;
+}
+
+BigInteger &BigInteger::operator*=(const BigInteger &bi) {
+    int64_t product;
+    if (!big && !bi.big && !__builtin_mul_overflow(small, bi.small, &product))
+        small = product;
+    else
+        *this = *this * bi;
+    return *this;
+}
+
+BigInteger &BigInteger::operator/=(const BigInteger &bi) {
+    if (!big && !bi.big && bi.small != 0 && !(small == INT64_MIN && bi.small == -1))
+        small /= bi.small;
+    else
+        *this = *this / bi;
+    return *this;
+}
+
+BigInteger BigInteger::operator+(const BigInteger &bi) const {
+    BigInteger result(*this);
+    result += bi;
+    return result;
+}
+
+std::ostream &BigInteger::show(std::ostream &os) const {
+    if (!big)
+        return os << small;
+    string digits(length(), '0');
+    format(&digits[0]);
+    os << digits;
+    return os;
+}
+
+size_t BigInteger::length() const {
+    size_t n = isNegative() ? 1 : 0;
+    if (!big) {
+        uint64_t u = smallAbs();
+        do {
+            ++n;
+            u /= 10;
+        } while (u);
+        return n;
+    }
+    n += (limbs.size() - 1) * BaseDigits;
+    for (uint32_t top = limbs.back(); top; top /= 10) {
+        ++n;
+    }
+    return n;
+}
+
+// Base 10^9 limbs are already decimal: every limb but the top one is
+// exactly nine digits, filled in from the end of the buffer.
+size_t BigInteger::format(char *buffer) const {
+    size_t n = length();
+    char *p = buffer + n;
+    if (!big) {
+        uint64_t u = smallAbs();
+        do {
+            *--p = char('0' + u % 10);
+            u /= 10;
+        } while (u);
+    } else {
+        for (size_t i = 0; i + 1 < limbs.size(); ++i) {
+            uint32_t limb = limbs[i];
+            for (int j = 0; j < BaseDigits; ++j) {
+                *--p = char('0' + limb % 10);
+                limb /= 10;
+            }
+        }
+        for (uint32_t top = limbs.back(); top; top /= 10) {
+            *--p = char('0' + top % 10);
+        }
+    }
+    if (isNegative())
+        *--p = '-';
+    return n;
+}
+
+BigInteger BigInteger::operator-(const BigInteger &bi) const {
+    BigInteger result(*this);
+    result -= bi;
+    return result;
+}
+
+BigInteger BigInteger::operator-() const {
+    BigInteger ret;
+    if (!big && small != INT64_MIN) {
+        ret.small = -small;
+        return ret;
+    }
+    Limbs scratch;
+    Limbs m = mag(scratch);
+    ret.setMag(m, !isNegative());
+    return ret;
+}
+
+BigInteger BigInteger::operator+() const {
+    return *this;
+}
+
+BigInteger BigInteger::operator*(const BigInteger &bi) const {
+    BigInteger result;
+    if (!big && !bi.big && !__builtin_mul_overflow(small, bi.small, &result.small))
+        return result;
+    Limbs sa, sb, r;
+    const Limbs &a = mag(sa);
+    // Passing the same limbs twice lets mulMag square.
+    mulMag(a, &bi == this ? a : bi.mag(sb), r);
+    result.setMag(r, isNegative() != bi.isNegative());
+    return result;
+}
+
+void BigInteger::divMod(const BigInteger &bi, BigInteger &quotient,
+                        BigInteger &remainder) const {
+    if (bi.isZero()) {
+        throw DivideByZero();
+    }
+    // INT64_MIN / -1 is the one small quotient that does not fit.
+    if (!big && !bi.big && !(small == INT64_MIN && bi.small == -1)) {
+        int64_t q = small / bi.small, r = small % bi.small;
+        quotient = BigInteger();
+        quotient.small = q;
+        remainder = BigInteger();
+        remainder.small = r;
+        return;
+    }
+    bool qNegative = isNegative() ^ bi.isNegative(), rNegative = isNegative();
+    Limbs sa, sb, q, r;
+    divMag(mag(sa), bi.mag(sb), q, r);
+    quotient.setMag(q, qNegative);
+    remainder.setMag(r, rNegative);
+}
+
+// Throws DivideByZero exception
+BigInteger BigInteger::operator/(const BigInteger &bi) const {
+    BigInteger quotient, remainder;
+    divMod(bi, quotient, remainder);
+    return quotient;
+}
+
+// Throws DivideByZero exception
+// Picks whichever of r and r + bi is closer to zero, r being the
+// truncated remainder *this - (*this / bi) * bi.
+BigInteger BigInteger::operator%(const BigInteger &bi) const {
+    BigInteger quotient, r;
+    divMod(bi, quotient, r);
+    BigInteger other = r + bi;
+    return (r.compareAbs(other) < 0) ? r : other;
+}
+
+void BigInteger::bitsOf(const Limbs &a, Bits &bits) {
+    const uint32_t Chunk = 1u << 30;
+    Limbs rest = a;
+    bits.clear();
+    while (!rest.empty()) {
+        uint32_t low = divSmall(rest, Chunk);
+        for (int i = 0; i < 30; ++i) {
+            bits.push_back((low >> i) & 1u);
+        }
+    }
+    while (!bits.empty() && bits.back() == 0) {
+        bits.pop_back();
+    }
+}
+
+// Left-to-right sliding window: the exponent is read in windows of up
+// to w bits ending in a one, each costing one multiplication by a
+// precomputed odd power. multiply(a, b, r) may reduce its result.
+template<class Multiply>
+void BigInteger::slidingWindowPow(const Limbs &x, const Bits &bits,
+                                  Multiply multiply, Limbs &r) {
+    if (bits.empty()) {
+        r.assign(1, 1);
+        return;
+    }
+    int w = bits.size() > 640 ? 6 : bits.size() > 240 ? 5 :
+            bits.size() > 80 ? 4 : bits.size() > 24 ? 3 : bits.size() > 6 ? 2 : 1;
+    std::vector<Limbs> odd(size_t(1) << (w - 1));
+    odd[0] = x;
+    if (odd.size() > 1) {
+        Limbs square;
+        multiply(x, x, square);
+        for (size_t k = 1; k < odd.size(); ++k) {
+            multiply(odd[k - 1], square, odd[k]);
+        }
+    }
+
+    Limbs result;
+    bool started = false;
+    long i = long(bits.size()) - 1;
+    while (i >= 0) {
+        if (!bits[i]) {
+            multiply(result, result, result);
+            --i;
+            continue;
+        }
+        long j = std::max(i - w + 1, 0L);
+        while (!bits[j]) {
+            ++j;
+        }
+        uint32_t window = 0;
+        for (long k = i; k >= j; --k) {
+            window = window << 1 | bits[k];
+        }
+        if (started) {
+            for (long k = i; k >= j; --k) {
+                multiply(result, result, result);
+            }
+            multiply(result, odd[window >> 1], result);
+        } else {
+            result = odd[window >> 1];
+            started = true;
+        }
+        i = j - 1;
+    }
+    r.swap(result);
+}
+
+// Barrett reduction modulo m with mu = floor(Base^2k / m), k limbs in m:
+// reduces anything below Base^2k with two multiplications.
+class BigInteger::Barrett {
+public:
+    explicit Barrett(const Limbs &modulus) : m(modulus), k(modulus.size()) {
+        Limbs power(2 * k + 1, 0), rem;
+        power.back() = 1;
+        divMag(power, m, mu, rem);
+    }
+
+    void reduce(Limbs &x) const {
+        if (compareMag(x, m) < 0)
+            return;
+        Limbs q, product;
+        mulMag(slice(x, k - 1, x.size()), mu, q);
+        mulMag(slice(q, k + 1, q.size()), m, product);
+        subMag(x, product, x);
+        while (compareMag(x, m) >= 0) {
+            subMag(x, m, x);
+        }
+    }
+
+    void multiply(const Limbs &a, const Limbs &b, Limbs &r) const {
+        mulMag(a, b, r);
+        reduce(r);
+    }
+
+private:
+    Limbs m, mu;
+    size_t k;
+};
+
+BigInteger BigInteger::pow(uint64_t exponent) const {
+    Bits bits;
+    for (; exponent; exponent >>= 1) {
+        bits.push_back(exponent & 1u);
+    }
+    BigInteger result;
+    bool odd = !bits.empty() && bits[0];
+    Limbs scratch, r;
+    slidingWindowPow(mag(scratch), bits, [](const Limbs &a, const Limbs &b, Limbs &r) {
+        mulMag(a, b, r);
+    }, r);
+    trim(r);
+    result.setMag(r, isNegative() && odd);
+    return result;
+}
+
+BigInteger BigInteger::operator^(const BigInteger &bi) const {
+    if (isZero()) {
+        if (bi.isNegative() || bi.isZero()) {
+            throw DivideByZero();
+        } else {
+            return BigInteger("0");
+        }
+    } else if (bi.isZero()) {
+        return BigInteger("1");
+    } else if (bi.isNegative()) {
+        std::cerr
+                << "Warning: Integer to negative power always evaluate to zero\n";
+        return BigInteger("0");
+    }
+
+    Bits bits;
+    Limbs scratch, r;
+    bitsOf(bi.mag(scratch), bits);
+    BigInteger result;
+    slidingWindowPow(mag(scratch), bits, [](const Limbs &a, const Limbs &b, Limbs &r) {
+        mulMag(a, b, r);
+    }, r);
+    result.setMag(r, isNegative() && bits[0]);
+    return result;
+}
+
+BigInteger BigInteger::modPow(const BigInteger &exp, const BigInteger &mod) const {
+    if (isZero() && (exp.isNegative() || exp.isZero())) {
+        throw DivideByZero();
+    }
+    if (mod.isZero()) {
+        throw DivideByZero();
+    }
+    if (exp.isNegative()) {
+        std::cerr
+                << "Warning: Integer to negative power always evaluate to zero\n";
+        return BigInteger("0");
+    }
+    BigInteger result;
+    if (!big && !exp.big && !mod.big) {
+        uint64_t m = mod.smallAbs(), b = smallAbs() % m, r = 1 % m;
+        for (uint64_t e = exp.smallAbs(); e; e >>= 1) {
+            if (e & 1u)
+                r = uint64_t((unsigned __int128) r * b % m);
+            b = uint64_t((unsigned __int128) b * b % m);
+        }
+        result.small = int64_t(r);
+        return (isNegative() && (exp.small & 1)) ? -result : result;
+    }
+    Limbs sa, sm, base, quotient, r;
+    const Limbs &m = mod.mag(sm);
+    divMag(mag(sa), m, quotient, base);
+    Barrett barrett(m);
+    Bits bits;
+    bitsOf(exp.mag(sa), bits);
+    slidingWindowPow(base, bits, [&barrett](const Limbs &a, const Limbs &b, Limbs &r) {
+        barrett.multiply(a, b, r);
+    }, r);
+    barrett.reduce(r);
+    trim(r);
+    result.setMag(r, isNegative() && !bits.empty() && bits[0]);
+    return result;
+}
+
+bool BigInteger::operator==(const BigInteger &bi) const {
+    return this->compare(bi) == 0;
+}
+
+std::ostream &operator<<(std::ostream &os, const BigInteger &bi) {
+    bi.show(os);
+    return os;
+}
+
+
+///------------------------ ExpressionExceptions ----------------------------///
+class UnidentifiedToken : public std::exception {
+public:
+    explicit UnidentifiedToken(char o) : op(o) {}
+
+    const char *what() const _NOEXCEPT override {
         des[0] = op;
         return des;
     }
@@ -369,127 +1744,1328 @@ public:
     }
 };
 
-class SyntaxError : public std::exception {
-public:
-    const char *what() const _NOEXCEPT override {
-        return "Expression has syntax error, please check.";
-    }
+class SyntaxError : public std::exception {
+public:
+    const char *what() const _NOEXCEPT override {
+        return "Expression has syntax error, please check.";
+    }
+};
+
+class EmptyExpression : public std::exception {
+public:
+    const char *what() const _NOEXCEPT override {
+        return "Expression is empty, please check.";
+    }
+};
+
+class CannotOpenFile : public std::exception {
+public:
+    const char *what() const _NOEXCEPT override {
+        return "Input file cannot be opened.";
+    }
+};
+
+class BadModulus : public std::exception {
+public:
+    const char *what() const _NOEXCEPT override {
+        return "Modulus must be an integer from 2 to 2^63-1.";
+    }
+};
+
+class NotInvertible : public std::exception {
+public:
+    const char *what() const _NOEXCEPT override {
+        return "Divisor has no inverse under the modulus.";
+    }
+};
+
+class ModularUndefined : public std::exception {
+public:
+    const char *what() const _NOEXCEPT override {
+        return "Expression cannot be evaluated under the modulus.";
+    }
+};
+
+
+///--------------------------------- Arena ----------------------------------///
+/// Bump allocator for the nodes of one parse. Objects are carved out of
+/// large blocks and all destroyed together, newest first, when the arena
+/// is cleared or goes away.
+class Arena {
+public:
+    Arena() = default;
+    Arena(Arena &&other) noexcept;
+    ~Arena() { clear(); }
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    template<class T, class... Args>
+    T *make(Args &&... args);
+    void clear();
+
+private:
+    static constexpr size_t BlockSize = 4096;
+    // Destructors to run, kept in the arena itself as a stack.
+    struct Finalizer {
+        void (*destroy)(void *);
+        void *object;
+        Finalizer *next;
+    };
+
+    std::vector<char *> blocks;
+    char *cursor = nullptr;
+    char *limit = nullptr;
+    Finalizer *finalizers = nullptr;
+
+    void *allocate(size_t size, size_t align);
+};
+
+constexpr size_t Arena::BlockSize;
+
+Arena::Arena(Arena &&other) noexcept :
+        blocks(std::move(other.blocks)), cursor(other.cursor),
+        limit(other.limit), finalizers(other.finalizers) {
+    other.blocks.clear();
+    other.cursor = other.limit = nullptr;
+    other.finalizers = nullptr;
+}
+
+void *Arena::allocate(size_t size, size_t align) {
+    auto address = reinterpret_cast<uintptr_t>(cursor);
+    size_t padding = (align - address % align) % align;
+    if (cursor == nullptr || padding + size > size_t(limit - cursor)) {
+        size_t length = std::max(BlockSize, size + align);
+        blocks.push_back(new char[length]);
+        cursor = blocks.back();
+        limit = cursor + length;
+        address = reinterpret_cast<uintptr_t>(cursor);
+        padding = (align - address % align) % align;
+    }
+    void *result = cursor + padding;
+    cursor += padding + size;
+    return result;
+}
+
+template<class T, class... Args>
+T *Arena::make(Args &&... args) {
+    T *object = new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    if (!std::is_trivially_destructible<T>::value) {
+        auto finalizer = new(allocate(sizeof(Finalizer), alignof(Finalizer))) Finalizer;
+        finalizer->destroy = [](void *p) { static_cast<T *>(p)->~T(); };
+        finalizer->object = object;
+        finalizer->next = finalizers;
+        finalizers = finalizer;
+    }
+    return object;
+}
+
+void Arena::clear() {
+    for (; finalizers; finalizers = finalizers->next) {
+        finalizers->destroy(finalizers->object);
+    }
+    for (char *block : blocks) {
+        delete[] block;
+    }
+    blocks.clear();
+    cursor = limit = nullptr;
+}
+
+
+///------------------------------- Program ----------------------------------///
+/// Postfix bytecode for one expression, run on a stack of BigIntegers.
+/// Each instruction is one word, the opcode in the low byte and, for Push,
+/// Keep, Load and Fork, an index above it. Values used more than once are
+/// kept in slots and loaded again instead of being recomputed. Two costly
+/// independent operands can be compiled into programs of their own that a
+/// Fork runs at the same time. A program does not refer to the tree it was
+/// compiled from, so it can be kept and run again.
+class Program {
+public:
+    enum OpCode {
+        Push, Add, Subtract, Multiply, Divide, Modulo, Power,
+        ModPower,                   // a b m -> a ^ b % m
+        Keep,                       // copies the top into a slot
+        Load,                       // pushes a copy of a slot
+        Fork                        // pushes the values of two parts
+    };
+
+    // Operands estimated to take at least threshold digit operations each
+    // are forked. Forks run on BigInteger::parallelPolicy().pool, from its
+    // own threads too, as in a batch; without a pool the parts run one
+    // after the other.
+    static double &forkThreshold() {
+        static double threshold = 1e8;
+        return threshold;
+    }
+
+    void push(const BigInteger &constant);
+    void emit(OpCode op);
+    // Keeps the top in a new slot and returns its index.
+    size_t keep();
+    void load(size_t slot);
+    void fork(Program &&left, Program &&right);
+    static OpCode opCodeOf(char op);
+
+    BigInteger run() const;
+    size_t length() const { return code.size(); }
+
+private:
+    std::vector<uint32_t> code;
+    std::vector<BigInteger> constants;
+    size_t depth = 0, maxDepth = 0;
+    size_t slots = 0;
+    std::vector<std::shared_ptr<const Program> > parts;
+};
+
+void Program::push(const BigInteger &constant) {
+    code.push_back(uint32_t(Push) | uint32_t(constants.size()) << 8);
+    constants.push_back(constant);
+    maxDepth = std::max(maxDepth, ++depth);
+}
+
+void Program::emit(OpCode op) {
+    code.push_back(uint32_t(op));
+    depth -= op == ModPower ? 2 : 1;
+}
+
+size_t Program::keep() {
+    code.push_back(uint32_t(Keep) | uint32_t(slots) << 8);
+    return slots++;
+}
+
+void Program::load(size_t slot) {
+    code.push_back(uint32_t(Load) | uint32_t(slot) << 8);
+    maxDepth = std::max(maxDepth, ++depth);
+}
+
+void Program::fork(Program &&left, Program &&right) {
+    code.push_back(uint32_t(Fork) | uint32_t(parts.size()) << 8);
+    parts.push_back(std::make_shared<const Program>(std::move(left)));
+    parts.push_back(std::make_shared<const Program>(std::move(right)));
+    depth += 2;
+    maxDepth = std::max(maxDepth, depth);
+}
+
+Program::OpCode Program::opCodeOf(char op) {
+    switch (op) {
+        case '+':
+            return Add;
+        case '-':
+            return Subtract;
+        case '*':
+            return Multiply;
+        case '/':
+            return Divide;
+        case '%':
+            return Modulo;
+        case '^':
+            return Power;
+        default:
+            throw UnidentifiedToken(op);
+    }
+}
+
+BigInteger Program::run() const {
+    if (code.empty())
+        throw SyntaxError();
+    std::vector<BigInteger> stack, kept(slots);
+    stack.reserve(maxDepth);
+    for (uint32_t word : code) {
+        if ((word & 0xff) == Push) {
+            stack.push_back(constants[word >> 8]);
+            continue;
+        } else if ((word & 0xff) == Keep) {
+            kept[word >> 8] = stack.back();
+            continue;
+        } else if ((word & 0xff) == Load) {
+            stack.push_back(kept[word >> 8]);
+            continue;
+        } else if ((word & 0xff) == Fork) {
+            const Program &left = *parts[word >> 8], &right = *parts[(word >> 8) + 1];
+            ThreadPool *pool = BigInteger::parallelPolicy().pool;
+            if (!pool) {
+                stack.push_back(left.run());
+                stack.push_back(right.run());
+                continue;
+            }
+            std::future<BigInteger> pending = pool->submit([&left] { return left.run(); });
+            // Wait for the left part even if the right one throws, and
+            // report its error first, as running them in order would.
+            std::exception_ptr error;
+            BigInteger value;
+            try {
+                value = right.run();
+            } catch (...) {
+                error = std::current_exception();
+            }
+            stack.push_back(pool->wait(pending));
+            if (error)
+                std::rethrow_exception(error);
+            stack.push_back(std::move(value));
+            continue;
+        }
+        // Operands are consumed from the top, the result replaces the
+        // left one in place.
+        BigInteger &right = stack.back();
+        BigInteger &left = stack[stack.size() - 2];
+        switch (word & 0xff) {
+            case Add:
+                left += right;
+                break;
+            case Subtract:
+                left -= right;
+                break;
+            case Multiply:
+                left *= right;
+                break;
+            case Divide:
+                left /= right;
+                break;
+            case Modulo:
+                left = left % right;
+                break;
+            case Power:
+                left = left ^ right;
+                break;
+            case ModPower: {
+                BigInteger &base = stack[stack.size() - 3];
+                // |modPow| < |modulus|, so % only applies the sign rule.
+                base = base.modPow(left, right) % right;
+                stack.pop_back();
+                break;
+            }
+            default:
+                throw SyntaxError();
+        }
+        stack.pop_back();
+    }
+    return std::move(stack.back());
+}
+
+
+///---------------------- ExpressionNode(abstract) --------------------------///
+class ExpressionNode {
+public:
+    ExpressionNode() = default;
+    virtual ~ExpressionNode() = default;
+
+    // calculating
+    virtual BigInteger evaluate() = 0;
+    // appends the postfix code of this subtree; a shared node is compiled
+    // once, later uses reload its value
+    void compile(Program &program);
+    // fills digits, work and shared of every node below, once
+    void estimate();
+    // visiting
+    virtual void prefixVisit(std::ostream &os) = 0;
+    virtual void postfixVisit(std::ostream &os) = 0;
+
+private:
+    friend class Optimizer;
+    friend class OperationNode;
+    // parents computing this node, set only in an optimized DAG
+    unsigned uses = 0;
+    long slot = -1;
+
+protected:
+    // Estimated decimal digits of the value and digit operations to
+    // compute it, from schoolbook bounds; -1 until estimated.
+    double digits = -1;
+    double work = 0;
+    // whether some node in this subtree is computed for several parents
+    bool shared = false;
+};
+
+///------------------------------ NumberNode --------------------------------///
+class NumberNode : public ExpressionNode {
+    // Tree leaves
+public:
+    explicit NumberNode(const BigInteger &bi) : num(bi) {}
+    ~NumberNode() override = default;
+
+    void negate() { num = -num; }
+    const BigInteger &value() const { return num; }
+
+    BigInteger evaluate() override;
+    void prefixVisit(std::ostream &os) override;
+    void postfixVisit(std::ostream &os) override;
+
+private:
+    BigInteger num;
+};
+
+BigInteger NumberNode::evaluate() {
+    return num;
+}
+
+void NumberNode::prefixVisit(std::ostream &os) {
+    os << num;
+}
+
+void NumberNode::postfixVisit(std::ostream &os) {
+    os << num;
+}
+
+///------------------------------ OperationNode -----------------------------///
+class OperationNode : public ExpressionNode {
+    // Tree parents, the children belong to the parser's arena
+public:
+    OperationNode(char o, ExpressionNode *left, ExpressionNode *right)
+            : op(o), leftChild(left), rightChild(right) { }
+    ~OperationNode() override = default;
+
+    BigInteger evaluate() override;
+    void prefixVisit(std::ostream &os) override;
+    void postfixVisit(std::ostream &os) override;
+
+private:
+    friend class ExpressionNode;
+    friend class Optimizer;
+    friend class Modular;
+    char op;
+    ExpressionNode *leftChild;
+    ExpressionNode *rightChild;
+
+    // the a ^ b of a ^ b % m, computed as one ModPower, else nullptr
+    OperationNode *modPowerOperand() const;
+    // fills digits, work and shared from those of the operands
+    void combineEstimates();
+};
+
+BigInteger OperationNode::evaluate() {
+    if (!leftChild || !rightChild)
+        throw SyntaxError();
+    // The left value becomes the result, updated in place.
+    BigInteger result;
+    switch (op) {
+        case '+':
+            result = leftChild->evaluate();
+            result += rightChild->evaluate();
+            break;
+        case '-':
+            result = leftChild->evaluate();
+            result -= rightChild->evaluate();
+            break;
+        case '*':
+            result = leftChild->evaluate();
+            result *= rightChild->evaluate();
+            break;
+        case '/':
+            result = leftChild->evaluate();
+            result /= rightChild->evaluate();
+            break;
+        case '%': {
+            // a ^ b % m: reduce while powering instead of building a ^ b.
+            auto power = dynamic_cast<OperationNode *>(leftChild);
+            if (power && power->op == '^' && power->leftChild && power->rightChild) {
+                BigInteger base = power->leftChild->evaluate();
+                BigInteger exponent = power->rightChild->evaluate();
+                BigInteger modulus = rightChild->evaluate();
+                // |modPow| < |modulus|, so % only applies the sign rule.
+                return base.modPow(exponent, modulus) % modulus;
+            }
+            return leftChild->evaluate() % rightChild->evaluate();
+        }
+        case '^':
+            return leftChild->evaluate() ^ rightChild->evaluate();
+        default:
+            throw UnidentifiedToken(op);
+    }
+    return result;
+}
+
+OperationNode *OperationNode::modPowerOperand() const {
+    auto power = dynamic_cast<OperationNode *>(leftChild);
+    if (op == '%' && power && power->op == '^' && power->leftChild && power->rightChild)
+        return power;
+    return nullptr;
+}
+
+void OperationNode::combineEstimates() {
+    const double l = leftChild->digits, r = rightChild->digits;
+    double own = 0;
+    switch (op) {
+        case '+':
+        case '-':
+            digits = std::max(l, r) + 1;
+            own = digits;
+            break;
+        case '*':
+            digits = l + r;
+            own = l * r;
+            break;
+        case '/':
+            digits = std::max(l - r, 0.0) + 1;
+            own = digits * r;
+            break;
+        case '%':
+            digits = r;
+            own = (std::max(l - r, 0.0) + 1) * r;
+            break;
+        case '^': {
+            // The exponent's value, when it is known, else its largest.
+            double exponent = std::pow(10.0, r);
+            auto number = dynamic_cast<NumberNode *>(rightChild);
+            if (number && r < 300) {
+                char text[310];
+                text[number->value().format(text)] = '\0';
+                exponent = std::strtod(text, nullptr);
+            }
+            digits = exponent > 0 ? l * exponent : 1;
+            own = digits * digits;
+            break;
+        }
+        default:
+            throw UnidentifiedToken(op);
+    }
+    work = leftChild->work + rightChild->work + own;
+    shared = uses > 1 || leftChild->shared || rightChild->shared;
+}
+
+// Postorder over an explicit stack, so depth costs no native stack: a
+// node's code follows that of its operands. Forked operands are compiled
+// into programs of their own.
+void ExpressionNode::compile(Program &program) {
+    struct Frame {
+        ExpressionNode *node;
+        bool ready;                 // operands compiled, the node's code is due
+    };
+    std::vector<Frame> stack(1, Frame{this, false});
+    while (!stack.empty()) {
+        const Frame frame = stack.back();
+        stack.pop_back();
+        ExpressionNode *node = frame.node;
+        auto operation = dynamic_cast<OperationNode *>(node);
+        if (frame.ready) {
+            program.emit(operation->modPowerOperand() ? Program::ModPower
+                                                      : Program::opCodeOf(operation->op));
+            if (node->uses > 1)
+                node->slot = long(program.keep());
+            continue;
+        }
+        if (node->slot >= 0) {
+            program.load(size_t(node->slot));
+            continue;
+        }
+        if (!operation) {
+            program.push(static_cast<NumberNode *>(node)->value());
+            continue;
+        }
+        ExpressionNode *left = operation->leftChild, *right = operation->rightChild;
+        if (!left || !right)
+            throw SyntaxError();
+        stack.push_back(Frame{node, true});
+        // Operands go on the stack last first, a ^ b % m pushes a, b and m.
+        OperationNode *power = operation->modPowerOperand();
+        if (power) {
+            stack.push_back(Frame{right, false});
+            stack.push_back(Frame{power->rightChild, false});
+            stack.push_back(Frame{power->leftChild, false});
+            continue;
+        }
+        // Costly operands that share nothing with the rest run side by side.
+        left->estimate();
+        right->estimate();
+        const double threshold = Program::forkThreshold();
+        if (left->work >= threshold && right->work >= threshold &&
+            !left->shared && !right->shared) {
+            Program first, second;
+            left->compile(first);
+            right->compile(second);
+            program.fork(std::move(first), std::move(second));
+        } else {
+            stack.push_back(Frame{right, false});
+            stack.push_back(Frame{left, false});
+        }
+    }
+}
+
+// Postorder over an explicit stack, each node once its operands are done.
+void ExpressionNode::estimate() {
+    std::vector<std::pair<ExpressionNode *, bool> > stack(1, std::make_pair(this, false));
+    while (!stack.empty()) {
+        ExpressionNode *node = stack.back().first;
+        const bool ready = stack.back().second;
+        stack.pop_back();
+        if (node->digits >= 0)
+            continue;
+        auto operation = dynamic_cast<OperationNode *>(node);
+        if (!operation) {
+            node->digits = double(static_cast<NumberNode *>(node)->value().length());
+        } else if (ready) {
+            operation->combineEstimates();
+        } else {
+            if (!operation->leftChild || !operation->rightChild)
+                throw SyntaxError();
+            stack.push_back(std::make_pair(node, true));
+            stack.push_back(std::make_pair(operation->rightChild, false));
+            stack.push_back(std::make_pair(operation->leftChild, false));
+        }
+    }
+}
+
+// Both visits keep the nodes still to print on an explicit stack, so
+// depth costs no native stack; nullptr stands for the blank between two
+// operands.
+void OperationNode::prefixVisit(std::ostream &os) {
+    std::vector<ExpressionNode *> stack(1, this);
+    while (!stack.empty()) {
+        ExpressionNode *node = stack.back();
+        stack.pop_back();
+        auto operation = dynamic_cast<OperationNode *>(node);
+        if (!node) {
+            os << ' ';
+        } else if (!operation) {
+            node->prefixVisit(os);
+        } else {
+            os << operation->op << ' ';
+            stack.push_back(operation->rightChild);
+            stack.push_back(nullptr);
+            stack.push_back(operation->leftChild);
+        }
+    }
+}
+
+void OperationNode::postfixVisit(std::ostream &os) {
+    // ready: the operands are printed, the operator is due
+    std::vector<std::pair<ExpressionNode *, bool> > stack(1, std::make_pair(this, false));
+    while (!stack.empty()) {
+        ExpressionNode *node = stack.back().first;
+        const bool ready = stack.back().second;
+        stack.pop_back();
+        auto operation = dynamic_cast<OperationNode *>(node);
+        if (!node) {
+            os << ' ';
+        } else if (!operation) {
+            node->postfixVisit(os);
+        } else if (ready) {
+            os << ' ' << operation->op << ' ';
+        } else {
+            stack.push_back(std::make_pair(node, true));
+            stack.push_back(std::make_pair(operation->rightChild, false));
+            stack.push_back(std::make_pair(nullptr, false));
+            stack.push_back(std::make_pair(operation->leftChild, false));
+        }
+    }
+}
+
+///------------------------------- Optimizer --------------------------------///
+/// Rebuilds a tree as a DAG in which structurally equal subtrees are one
+/// node, so compiling it computes each distinct subexpression once.
+/// Operations on constants are folded while they are cheap and can neither
+/// throw nor warn, so the order of errors and warnings is kept. Operands
+/// that fit in an int64_t are folded with checked machine arithmetic first;
+/// only an operation that overflows goes on to BigInteger.
+class Optimizer {
+public:
+    explicit Optimizer(Arena &a) : arena(a) {}
+
+    // The tree itself is left as it is, for the traversals.
+    ExpressionNode *optimize(ExpressionNode *tree);
+
+    ExpressionNode *number(const BigInteger &value);
+    ExpressionNode *operation(char op, ExpressionNode *left, ExpressionNode *right);
+
+    // Same result as the BigInteger operation, or false if it does not fit,
+    // would throw or would warn.
+    static bool foldWord(char op, int64_t left, int64_t right, int64_t &result);
+
+private:
+    // bound on the digits of folded products and powers
+    static constexpr size_t FoldDigits = 64;
+
+    Arena &arena;
+    std::unordered_map<int64_t, ExpressionNode *> words;
+    std::map<string, ExpressionNode *> numbers;
+    std::map<std::tuple<char, ExpressionNode *, ExpressionNode *>, ExpressionNode *> operations;
+
+    static bool foldable(char op, const BigInteger &left, const BigInteger &right);
+    static void countUses(ExpressionNode *root);
+};
+
+constexpr size_t Optimizer::FoldDigits;
+
+// Postorder over an explicit stack, so depth costs no native stack; the
+// DAG nodes of finished operands wait on done.
+ExpressionNode *Optimizer::optimize(ExpressionNode *tree) {
+    std::vector<std::pair<ExpressionNode *, bool> > stack(1, std::make_pair(tree, false));
+    std::vector<ExpressionNode *> done;
+    while (!stack.empty()) {
+        ExpressionNode *node = stack.back().first;
+        const bool ready = stack.back().second;
+        stack.pop_back();
+        auto parent = dynamic_cast<OperationNode *>(node);
+        if (!parent) {
+            done.push_back(number(static_cast<NumberNode *>(node)->value()));
+        } else if (ready) {
+            ExpressionNode *right = done.back();
+            done.pop_back();
+            done.back() = operation(parent->op, done.back(), right);
+        } else {
+            if (!parent->leftChild || !parent->rightChild)
+                throw SyntaxError();
+            stack.push_back(std::make_pair(node, true));
+            stack.push_back(std::make_pair(parent->rightChild, false));
+            stack.push_back(std::make_pair(parent->leftChild, false));
+        }
+    }
+    countUses(done.back());
+    return done.back();
+}
+
+ExpressionNode *Optimizer::number(const BigInteger &value) {
+    int64_t word;
+    if (value.toWord(word)) {
+        ExpressionNode *&node = words[word];
+        if (!node)
+            node = arena.make<NumberNode>(value);
+        return node;
+    }
+    string key(value.length(), '\0');
+    key.resize(value.format(&key[0]));
+    ExpressionNode *&node = numbers[key];
+    if (!node)
+        node = arena.make<NumberNode>(value);
+    return node;
+}
+
+ExpressionNode *Optimizer::operation(char op, ExpressionNode *left, ExpressionNode *right) {
+    auto a = dynamic_cast<NumberNode *>(left);
+    auto b = dynamic_cast<NumberNode *>(right);
+    if (a && b) {
+        int64_t x, y, word;
+        if (a->value().toWord(x) && b->value().toWord(y) && foldWord(op, x, y, word))
+            return number(BigInteger(word));
+        if (foldable(op, a->value(), b->value()))
+            return number(OperationNode(op, a, b).evaluate());
+    }
+    ExpressionNode *&node = operations[std::make_tuple(op, left, right)];
+    if (!node)
+        node = arena.make<OperationNode>(op, left, right);
+    return node;
+}
+
+bool Optimizer::foldWord(char op, int64_t left, int64_t right, int64_t &result) {
+    switch (op) {
+        case '+':
+            return !__builtin_add_overflow(left, right, &result);
+        case '-':
+            return !__builtin_sub_overflow(left, right, &result);
+        case '*':
+            return !__builtin_mul_overflow(left, right, &result);
+        case '/':
+            if (right == 0 || (left == INT64_MIN && right == -1))
+                return false;
+            result = left / right;
+            return true;
+        case '%': {
+            // Of the two remainders r and r + right, the one nearer zero,
+            // the later one on a tie.
+            if (right == 0)
+                return false;
+            int64_t r = right == -1 ? 0 : left % right, other;
+            if (__builtin_add_overflow(r, right, &other)) {
+                result = r;
+                return true;
+            }
+            auto magnitude = [](int64_t v) { return v < 0 ? 0 - uint64_t(v) : uint64_t(v); };
+            result = magnitude(r) < magnitude(other) ? r : other;
+            return true;
+        }
+        case '^': {
+            // 0 ^ 0 throws and negative exponents warn.
+            if (right <= 0)
+                return false;
+            int64_t base = left;
+            result = 1;
+            for (uint64_t e = uint64_t(right);; e >>= 1) {
+                if ((e & 1u) && __builtin_mul_overflow(result, base, &result))
+                    return false;
+                if (e == 1)
+                    return true;
+                if (__builtin_mul_overflow(base, base, &base))
+                    return false;
+            }
+        }
+        default:
+            return false;
+    }
+}
+
+bool Optimizer::foldable(char op, const BigInteger &left, const BigInteger &right) {
+    const BigInteger zero(0);
+    switch (op) {
+        case '+':
+        case '-':
+            return true;
+        case '*':
+            return left.length() + right.length() <= FoldDigits;
+        case '/':
+        case '%':
+            return !(right == zero) && left.length() <= FoldDigits;
+        case '^': {
+            // 0 ^ 0 throws and negative exponents warn.
+            int64_t exponent;
+            if (!right.toWord(exponent) || exponent <= 0 || uint64_t(exponent) > FoldDigits)
+                return false;
+            return left.length() * size_t(exponent) <= FoldDigits;
+        }
+        default:
+            return false;
+    }
+}
+
+// Counts, for every operation, the parents that compute it, following the same
+// edges as compile: a ^ b % m computes a and b but not a ^ b. Operands
+// wait on an explicit stack and are followed from their first use only.
+void Optimizer::countUses(ExpressionNode *root) {
+    std::vector<ExpressionNode *> stack(1, root);
+    while (!stack.empty()) {
+        auto parent = dynamic_cast<OperationNode *>(stack.back());
+        stack.pop_back();
+        // Literals are pushed again rather than kept.
+        if (!parent || parent->uses++ > 0)
+            continue;
+        stack.push_back(parent->rightChild);
+        OperationNode *power = parent->modPowerOperand();
+        if (power) {
+            stack.push_back(power->rightChild);
+            stack.push_back(power->leftChild);
+        } else {
+            stack.push_back(parent->leftChild);
+        }
+    }
+}
+
+
+///------------------------------ ResultCache -------------------------------///
+/// Results of earlier expressions, keyed by the prefix form of their tree,
+/// which has neither blanks nor redundant parentheses. The least recently
+/// used results go first once their estimated size passes the capacity.
+class ResultCache {
+public:
+    static constexpr size_t DefaultCapacity = size_t(64) << 20;
+
+    struct Stats {
+        size_t hits, misses, entries, bytes, capacity;
+    };
+
+    explicit ResultCache(size_t capacity = DefaultCapacity) : limit(capacity) {}
+
+    bool find(const string &key, BigInteger &result);
+    void insert(const string &key, const BigInteger &result);
+    Stats stats();
+
+private:
+    struct Entry {
+        string key;
+        BigInteger result;
+        size_t bytes;
+    };
+
+    std::list<Entry> entries;       // most recently used first
+    std::unordered_map<string, std::list<Entry>::iterator> index;
+    size_t bytes = 0, limit;
+    size_t hits = 0, misses = 0;
+    std::mutex lock;
+};
+
+constexpr size_t ResultCache::DefaultCapacity;
+
+bool ResultCache::find(const string &key, BigInteger &result) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto found = index.find(key);
+    if (found == index.end()) {
+        ++misses;
+        return false;
+    }
+    ++hits;
+    entries.splice(entries.begin(), entries, found->second);
+    result = found->second->result;
+    return true;
+}
+
+void ResultCache::insert(const string &key, const BigInteger &result) {
+    // The key is held twice, the digits about once, plus the nodes.
+    const size_t size = 2 * key.size() + result.length() + 128;
+    std::lock_guard<std::mutex> guard(lock);
+    if (size > limit || index.count(key))
+        return;
+    while (bytes + size > limit) {
+        bytes -= entries.back().bytes;
+        index.erase(entries.back().key);
+        entries.pop_back();
+    }
+    entries.push_front(Entry{key, result, size});
+    index[key] = entries.begin();
+    bytes += size;
+}
+
+ResultCache::Stats ResultCache::stats() {
+    std::lock_guard<std::mutex> guard(lock);
+    return Stats{hits, misses, entries.size(), bytes, limit};
+}
+
+
+///-------------------------------- Modular ---------------------------------///
+/// Arithmetic modulo a word below 2^63. Odd moduli use Montgomery
+/// reduction, so a product costs multiplications and no division; even
+/// ones divide the 128 bit product.
+class Montgomery {
+public:
+    explicit Montgomery(uint64_t m);
+
+    uint64_t modulus() const { return mod; }
+    // a * b and base ^ exponent for residues in [0, modulus)
+    uint64_t multiply(uint64_t a, uint64_t b) const;
+    uint64_t power(uint64_t base, uint64_t exponent) const;
+
+private:
+    uint64_t mod;
+    bool odd;
+    uint64_t inverse = 0;           // -mod^-1 mod 2^64
+    uint64_t square = 0;            // 2^128 mod mod
+
+    // t * 2^-64 mod mod, for t < mod * 2^64
+    uint64_t reduce(unsigned __int128 t) const;
 };
 
-class EmptyExpression : public std::exception {
-public:
-    const char *what() const _NOEXCEPT override {
-        return "Expression is empty, please check.";
+Montgomery::Montgomery(uint64_t m) : mod(m), odd(m % 2 == 1 && m > 1) {
+    if (!odd)
+        return;
+    // Each Newton step doubles the correct low bits of m^-1.
+    uint64_t x = m;
+    for (int i = 0; i < 5; ++i) {
+        x *= 2 - m * x;
     }
-};
+    inverse = 0 - x;
+    uint64_t r = (0 - m) % m;
+    square = uint64_t((unsigned __int128) r * r % m);
+}
 
+uint64_t Montgomery::reduce(unsigned __int128 t) const {
+    uint64_t k = uint64_t(t) * inverse;
+    uint64_t r = uint64_t((t + (unsigned __int128) k * mod) >> 64);
+    return r >= mod ? r - mod : r;
+}
 
-///---------------------- ExpressionNode(abstract) --------------------------///
-class ExpressionNode {
-public:
-    ExpressionNode() = default;
-    virtual ~ExpressionNode() = default;
+uint64_t Montgomery::multiply(uint64_t a, uint64_t b) const {
+    if (!odd)
+        return uint64_t((unsigned __int128) a * b % mod);
+    return reduce((unsigned __int128) reduce((unsigned __int128) a * b) * square);
+}
 
-    // calculating
-    virtual BigInteger evaluate() = 0;
-    // visiting
-    virtual void prefixVisit(std::ostream &os) = 0;
-    virtual void postfixVisit(std::ostream &os) = 0;
-};
+uint64_t Montgomery::power(uint64_t base, uint64_t exponent) const {
+    if (!odd) {
+        uint64_t r = 1 % mod;
+        for (; exponent; exponent >>= 1) {
+            if (exponent & 1u)
+                r = multiply(r, base);
+            base = multiply(base, base);
+        }
+        return r;
+    }
+    // In Montgomery form x * 2^64 throughout, one reduction a product.
+    uint64_t x = reduce((unsigned __int128) base * square), r = reduce(square);
+    for (; exponent; exponent >>= 1) {
+        if (exponent & 1u)
+            r = reduce((unsigned __int128) r * x);
+        x = reduce((unsigned __int128) x * x);
+    }
+    return reduce(r);
+}
 
-///------------------------------ NumberNode --------------------------------///
-class NumberNode : public ExpressionNode {
-    // Tree leaves
+/// Evaluates a tree in Z/pZ, every value a residue in [0, p), so nothing
+/// grows past a word however large the exact value would be.
+///   a / b is a times the inverse of b, which must exist; a quotient of
+///         known integers that divide exactly is kept as it is.
+///   a % b needs integers known exactly, or a multiple of p as b, which
+///         leaves a as it is.
+///   a ^ e reduces e modulo phi(p), evaluating e's subtree in Z/phi(p)Z;
+///         a negative e raises the inverse of a.
+/// Besides its residue a value keeps its integer while that fits in an
+/// int64_t, else its sign and a lower bound on its bits when they are
+/// known. An exponent known only modulo phi(p) must be positive and above
+/// log2 p, where a ^ e is a ^ (e mod phi(p) + phi(p)) for every a.
+class Modular {
 public:
-    explicit NumberNode(const BigInteger &bi) : num(bi) {}
-    ~NumberNode() override = default;
+    explicit Modular(uint64_t m) : modulus(m) {}
 
-    BigInteger evaluate() override;
-    void prefixVisit(std::ostream &os) override;
-    void postfixVisit(std::ostream &os) override;
+    // Reads a modulus, from 2 to INT64_MAX.
+    static uint64_t modulusOf(const string &text);
+
+    uint64_t getModulus() const { return modulus; }
+    BigInteger evaluate(ExpressionNode *tree);
+    uint64_t phi(uint64_t n);
 
 private:
-    BigInteger num;
+    struct Value {
+        uint64_t residue;
+        bool exact;                 // word is the integer itself
+        int64_t word;
+        int sign;                   // of the integer, 0 if not known
+        double bits;                // its magnitude is at least 2 ^ bits
+    };
+
+    uint64_t modulus;
+    std::map<uint64_t, uint64_t> totients;
+    // exponents being evaluated, where a quotient has no meaning
+    unsigned exponents = 0;
+
+    // base ^ e, e evaluated in Z/phi(p)Z
+    Value power(const Value &base, const Value &e, const Montgomery &ring);
+    static Value number(const BigInteger &value, const Montgomery &ring);
+    static Value word(int64_t w, const Montgomery &ring);
+    static Value inexact(uint64_t residue, int sign, double bits);
+    static Value add(const Value &a, const Value &b, bool subtract, const Montgomery &ring);
+    static Value multiply(const Value &a, const Value &b, const Montgomery &ring);
+    Value divide(const Value &a, const Value &b, const Montgomery &ring);
+    static Value modulo(const Value &a, const Value &b, const Montgomery &ring);
+
+    static uint64_t inverse(uint64_t a, uint64_t m);
+    static bool isPrime(uint64_t n);
+    static uint64_t divisorOf(uint64_t n);
+    static void factor(uint64_t n, std::vector<uint64_t> &primes);
 };
 
-BigInteger NumberNode::evaluate() {
-    return num;
+uint64_t Modular::modulusOf(const string &text) {
+    try {
+        BigInteger value(text);
+        int64_t word;
+        if (value.toWord(word) && word >= 2)
+            return uint64_t(word);
+    } catch (ParseError &) {
+    }
+    throw BadModulus();
 }
 
-void NumberNode::prefixVisit(std::ostream &os) {
-    os << num;
+// Postorder over an explicit stack, so depth costs no native stack; the
+// values of finished operands wait on done. An exponent is evaluated in
+// the ring of the totient of its base's modulus, each ring made once.
+BigInteger Modular::evaluate(ExpressionNode *tree) {
+    struct Frame {
+        ExpressionNode *node;
+        const Montgomery *ring;
+        int stage;                  // operands evaluated so far
+    };
+    exponents = 0;
+    std::map<uint64_t, Montgomery> rings;
+    auto ringOf = [&rings](uint64_t m) -> const Montgomery * {
+        return &rings.emplace(m, Montgomery(m)).first->second;
+    };
+    std::vector<Frame> stack(1, Frame{tree, ringOf(modulus), 0});
+    std::vector<Value> done;
+    while (!stack.empty()) {
+        Frame frame = stack.back();
+        stack.pop_back();
+        const Montgomery &ring = *frame.ring;
+        auto operation = dynamic_cast<OperationNode *>(frame.node);
+        if (!operation) {
+            done.push_back(number(static_cast<NumberNode *>(frame.node)->value(), ring));
+            continue;
+        }
+        if (frame.stage == 0) {
+            if (!operation->leftChild || !operation->rightChild)
+                throw SyntaxError();
+            stack.push_back(Frame{frame.node, frame.ring, 1});
+            stack.push_back(Frame{operation->leftChild, frame.ring, 0});
+            continue;
+        }
+        if (frame.stage == 1) {
+            const Montgomery *operandRing = frame.ring;
+            if (operation->op == '^') {
+                operandRing = ringOf(phi(ring.modulus()));
+                ++exponents;
+            }
+            stack.push_back(Frame{frame.node, frame.ring, 2});
+            stack.push_back(Frame{operation->rightChild, operandRing, 0});
+            continue;
+        }
+        const Value right = done.back();
+        done.pop_back();
+        Value &left = done.back();
+        switch (operation->op) {
+            case '+':
+                left = add(left, right, false, ring);
+                break;
+            case '-':
+                left = add(left, right, true, ring);
+                break;
+            case '*':
+                left = multiply(left, right, ring);
+                break;
+            case '/':
+                left = divide(left, right, ring);
+                break;
+            case '%':
+                left = modulo(left, right, ring);
+                break;
+            case '^':
+                --exponents;
+                left = power(left, right, ring);
+                break;
+            default:
+                throw UnidentifiedToken(operation->op);
+        }
+    }
+    return BigInteger(int64_t(done.back().residue));
 }
 
-void NumberNode::postfixVisit(std::ostream &os) {
-    os << num;
+Modular::Value Modular::number(const BigInteger &value, const Montgomery &ring) {
+    int64_t w;
+    if (value.toWord(w))
+        return word(w, ring);
+    // Out of the int64_t range, so at least 2 ^ 63 in magnitude.
+    const BigInteger m(int64_t(ring.modulus()));
+    (value % m).toWord(w);
+    return inexact(uint64_t(w < 0 ? w + int64_t(ring.modulus()) : w),
+                   value.compare(BigInteger(0)), 63);
 }
 
-///------------------------------ OperationNode -----------------------------///
-class OperationNode : public ExpressionNode {
-    // Tree parents
-public:
-    OperationNode(char o, ExpressionNode *left, ExpressionNode *right)
-            : op(o), leftChild(left), rightChild(right) { }
-    ~OperationNode() override;
+Modular::Value Modular::word(int64_t w, const Montgomery &ring) {
+    const uint64_t m = ring.modulus();
+    const uint64_t magnitude = w < 0 ? 0 - uint64_t(w) : uint64_t(w);
+    const uint64_t r = magnitude % m;
+    return Value{w < 0 && r ? m - r : r, true, w, (w > 0) - (w < 0),
+                 magnitude ? double(63 - __builtin_clzll(magnitude)) : 0.0};
+}
 
-    BigInteger evaluate() override;
-    void prefixVisit(std::ostream &os) override;
-    void postfixVisit(std::ostream &os) override;
+// An integer of unknown sign may be zero, so nothing is known of its bits.
+Modular::Value Modular::inexact(uint64_t residue, int sign, double bits) {
+    return Value{residue, false, 0, sign, sign ? bits : 0.0};
+}
 
-private:
-    char op;
-    ExpressionNode *leftChild;
-    ExpressionNode *rightChild;
-};
+Modular::Value Modular::add(const Value &a, const Value &b, bool subtract,
+                            const Montgomery &ring) {
+    const uint64_t m = ring.modulus();
+    const uint64_t r = subtract ? (a.residue >= b.residue ? a.residue - b.residue
+                                                          : a.residue + (m - b.residue))
+                                : (a.residue + b.residue) % m;
+    int64_t w;
+    if (a.exact && b.exact) {
+        if (Optimizer::foldWord(subtract ? '-' : '+', a.word, b.word, w))
+            return word(w, ring);
+        // Only operands of one sign overflow, the sum keeps it.
+        return inexact(r, a.sign, 63);
+    }
+    const int bSign = subtract ? -b.sign : b.sign;
+    if (b.exact && b.word == 0)
+        return inexact(r, a.sign, a.bits);
+    if (a.exact && a.word == 0)
+        return inexact(r, bSign, b.bits);
+    if (a.sign != 0 && a.sign == bSign)
+        return inexact(r, a.sign, std::max(a.bits, b.bits));
+    // Less than 2 ^ 63 away from a value of 2 ^ 64 or more.
+    if (b.exact && a.bits >= 64)
+        return inexact(r, a.sign, a.bits - 1);
+    if (a.exact && b.bits >= 64)
+        return inexact(r, bSign, b.bits - 1);
+    return inexact(r, 0, 0);
+}
 
-OperationNode::~OperationNode() {
-    delete leftChild;
-    delete rightChild;
+Modular::Value Modular::multiply(const Value &a, const Value &b, const Montgomery &ring) {
+    const uint64_t r = ring.multiply(a.residue, b.residue);
+    int64_t w;
+    if (a.exact && b.exact) {
+        if (Optimizer::foldWord('*', a.word, b.word, w))
+            return word(w, ring);
+        return inexact(r, a.sign * b.sign, 63);
+    }
+    if ((a.exact && a.word == 0) || (b.exact && b.word == 0))
+        return word(0, ring);
+    return inexact(r, a.sign * b.sign, a.bits + b.bits);
 }
 
-BigInteger OperationNode::evaluate() {
-    if (!leftChild || !rightChild)
-        throw SyntaxError();
-    switch (op) {
-        case '+':
-            return leftChild->evaluate() + rightChild->evaluate();
-        case '-':
-            return leftChild->evaluate() - rightChild->evaluate();
-        case '*':
-            return leftChild->evaluate() * rightChild->evaluate();
-        case '/':
-            return leftChild->evaluate() / rightChild->evaluate();
-        case '%':
-            return leftChild->evaluate() % rightChild->evaluate();
-        case '^':
-            return leftChild->evaluate() ^ rightChild->evaluate();
-        default:
-            throw UnidentifiedToken(op);
+Modular::Value Modular::divide(const Value &a, const Value &b, const Montgomery &ring) {
+    if (b.exact && b.word == 0)
+        throw DivideByZero();
+    int64_t w;
+    if (a.exact && b.exact && Optimizer::foldWord('%', a.word, b.word, w) && w == 0 &&
+        Optimizer::foldWord('/', a.word, b.word, w))
+        return word(w, ring);
+    if (exponents > 0)
+        throw ModularUndefined();
+    return inexact(ring.multiply(a.residue, inverse(b.residue, ring.modulus())), 0, 0);
+}
+
+Modular::Value Modular::modulo(const Value &a, const Value &b, const Montgomery &ring) {
+    if (b.exact && b.word == 0)
+        throw DivideByZero();
+    int64_t w;
+    if (a.exact && b.exact && Optimizer::foldWord('%', a.word, b.word, w))
+        return word(w, ring);
+    if (b.residue != 0)
+        throw ModularUndefined();
+    // The remainder differs from a by a multiple of b, so of the modulus.
+    return inexact(a.residue, 0, 0);
+}
+
+Modular::Value Modular::power(const Value &base, const Value &e, const Montgomery &ring) {
+    const uint64_t m = ring.modulus();
+    if (e.exact) {
+        if (e.word <= 0 && base.exact && base.word == 0)
+            throw DivideByZero();
+        const uint64_t magnitude = e.word < 0 ? 0 - uint64_t(e.word) : uint64_t(e.word);
+        const uint64_t r = ring.power(e.word < 0 ? inverse(base.residue, m) : base.residue,
+                                      magnitude);
+        int64_t w;
+        if (e.word == 0 || (base.exact && Optimizer::foldWord('^', base.word, e.word, w)))
+            return word(e.word == 0 ? 1 : w, ring);
+        if (e.word < 0)
+            return inexact(r, 0, 0);
+        // Overflowed, or a power of a value out of the int64_t range.
+        const int sign = base.sign > 0 || e.word % 2 == 0 ? 1 : -1;
+        return inexact(r, base.sign ? sign : 0, std::max(63.0, base.bits * double(e.word)));
+    }
+    if (e.sign == 0 || e.bits < 63)
+        throw ModularUndefined();
+    if (base.exact && base.word == 0) {
+        if (e.sign < 0)
+            throw DivideByZero();
+        return word(0, ring);
+    }
+    if (base.exact && base.word == 1)
+        return word(1, ring);
+    const uint64_t f = phi(m);
+    if (e.sign < 0) {
+        // Only an invertible base has a negative power, and for it
+        // Euler's theorem needs no offset.
+        const uint64_t r = ring.power(inverse(base.residue, m), (f - e.residue) % f);
+        return inexact(r, 0, 0);
     }
+    const uint64_t r = ring.power(base.residue, e.residue + f);
+    return inexact(r, base.sign > 0 ? 1 : 0, base.bits > 0 ? base.bits * e.bits : 0);
 }
 
-void OperationNode::prefixVisit(std::ostream &os) {
-    os << op << ' ';
-    leftChild->prefixVisit(os);
-    os << ' ';
-    rightChild->prefixVisit(os);
+uint64_t Modular::phi(uint64_t n) {
+    auto found = totients.find(n);
+    if (found != totients.end())
+        return found->second;
+    std::vector<uint64_t> primes;
+    factor(n, primes);
+    std::sort(primes.begin(), primes.end());
+    primes.erase(std::unique(primes.begin(), primes.end()), primes.end());
+    uint64_t result = n;
+    for (uint64_t p : primes) {
+        result = result / p * (p - 1);
+    }
+    return totients[n] = result;
 }
 
-void OperationNode::postfixVisit(std::ostream &os) {
-    leftChild->postfixVisit(os);
-    os << ' ';
-    rightChild->postfixVisit(os);
-    os << ' ' << op << ' ';
+// Extended Euclid, for a and m below 2^63.
+uint64_t Modular::inverse(uint64_t a, uint64_t m) {
+    int64_t t = 0, nextT = 1, r = int64_t(m), nextR = int64_t(a);
+    while (nextR != 0) {
+        const int64_t q = r / nextR;
+        t -= q * nextT;
+        std::swap(t, nextT);
+        r -= q * nextR;
+        std::swap(r, nextR);
+    }
+    if (r != 1)
+        throw NotInvertible();
+    return uint64_t(t < 0 ? t + int64_t(m) : t);
+}
+
+// Miller-Rabin with bases that decide every n below 2^64.
+bool Modular::isPrime(uint64_t n) {
+    const uint64_t bases[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+    if (n < 2)
+        return false;
+    for (uint64_t p : bases) {
+        if (n % p == 0)
+            return n == p;
+    }
+    int s = __builtin_ctzll(n - 1);
+    const uint64_t d = (n - 1) >> s;
+    const Montgomery ring(n);
+    for (uint64_t a : bases) {
+        uint64_t x = ring.power(a, d);
+        if (x == 1 || x == n - 1)
+            continue;
+        int i = 1;
+        for (; i < s; ++i) {
+            x = ring.multiply(x, x);
+            if (x == n - 1)
+                break;
+        }
+        if (i == s)
+            return false;
+    }
+    return true;
+}
+
+// Pollard's rho on an odd composite n, a proper divisor of it. The
+// differences are multiplied together and their gcd with n taken once a
+// round; a round that finds all of n is taken again a step at a time.
+uint64_t Modular::divisorOf(uint64_t n) {
+    const Montgomery ring(n);
+    auto gcd = [](uint64_t a, uint64_t b) {
+        while (a) {
+            b %= a;
+            std::swap(a, b);
+        }
+        return b;
+    };
+    for (uint64_t c = 1;; ++c) {
+        auto next = [&](uint64_t x) {
+            const uint64_t y = ring.multiply(x, x) + c;
+            return y >= n ? y - n : y;
+        };
+        uint64_t x = 2, y = 2, d = 1;
+        while (d == 1) {
+            const uint64_t startX = x, startY = y;
+            uint64_t product = 1;
+            for (int i = 0; i < 128; ++i) {
+                x = next(x);
+                y = next(next(y));
+                product = ring.multiply(product, x > y ? x - y : y - x);
+            }
+            d = gcd(product, n);
+            if (d == n) {
+                x = startX;
+                y = startY;
+                do {
+                    x = next(x);
+                    y = next(next(y));
+                    d = gcd(x > y ? x - y : y - x, n);
+                } while (d == 1);
+            }
+        }
+        if (d != n)
+            return d;
+    }
+}
+
+void Modular::factor(uint64_t n, std::vector<uint64_t> &primes) {
+    for (uint64_t p = 2; p < 64 && p * p <= n; ++p) {
+        for (; n % p == 0; n /= p) {
+            primes.push_back(p);
+        }
+    }
+    if (n == 1)
+        return;
+    if (isPrime(n)) {
+        primes.push_back(n);
+        return;
+    }
+    const uint64_t d = divisorOf(n);
+    factor(d, primes);
+    factor(n / d, primes);
 }
 
 
 ///--------------------------- ExpressionParser -----------------------------///
 class ExpressionParser {
-    class StringHandler { // handler for string
+    // Tokenizer over the expression text, which it never copies or edits.
+    // The * implied before a parenthesis is produced as a token of its own.
+    class StringHandler {
     public:
         explicit StringHandler(string expr)
-                : expression(std::move(expr)), curPos(0),
+                : expression(std::move(expr)), length(expression.size()),
                   curOp('\0') { next(); };
+        StringHandler(const char *s, size_t count)
+                : text(s), length(count), curOp('\0') { next(); };
 
         void preprocess();
         void next();
@@ -497,30 +3073,43 @@ class ExpressionParser {
         bool isNum() { return status == Number; }
         bool isEnd() { return status == End; }
 
+    private:
+        string expression;          // owned text, used unless text is set
+        const char *text = nullptr;
+        // the expression is [first, length) of the text
+        size_t first = 0, length;
+        size_t curPos = 0;
+
+        const char *data() const { return text ? text : expression.data(); }
+        size_t parseInteger();
+
     public:
-        string expression;
-        unsigned int curPos;
         char curOp;
         BigInteger curNum;
         enum Status {
             Number, Operator, End
-        } status = Number;
-
-    private:
-        unsigned parseInteger();
+        } status = End;
     };
 
 public:
     explicit ExpressionParser(string expr) : handler(std::move(expr)) {};
+    // Parses text in place, text must outlive the parser.
+    ExpressionParser(const char *text, size_t length) : handler(text, length) {};
+    ExpressionParser(ExpressionParser &&) = default;
     ~ExpressionParser() = default;
 
-    // parse
-    ExpressionNode *parse(int precedence);
-    ExpressionNode *unaryParse();
+    // parse, nullptr where an operand is missing
+    ExpressionNode *parse();
 
-    // result
-    void calculate();
+    // result; with a cache, a result found there is not recomputed and the
+    // program is left empty
+    void calculate(ResultCache *cache = nullptr);
+    // result in Z/pZ for the modulus p of modular, see Modular; no program
+    // is compiled
+    void calculate(Modular &modular);
     const BigInteger &getResult() { return result; }
+    // the compiled form of the expression, valid after calculate
+    const Program &getProgram() { return program; }
 
     // visit
     void prefixTraverse(std::ostream &os);
@@ -539,22 +3128,36 @@ private:
 
     StringHandler handler;
     BigInteger result;
+    // every node of tree, released with the parser
+    Arena nodes;
     ExpressionNode *tree = nullptr;
+    Program program;
+
+    // marks a unary minus on the operator stack of parse
+    static constexpr char Negate = '~';
 
     // operation rules
     static Precedence precedenceOf(char op);
     static Associativity associativityOf(char op);
+    // a negated literal, or 0 - operand, evaluated with the rest
+    ExpressionNode *negate(ExpressionNode *operand);
 };
 
+constexpr char ExpressionParser::Negate;
 
 void ExpressionParser::StringHandler::next() {
-    while (expression[curPos] == ' ') { ++curPos; }
-    if (expression[curPos] != '\0') {
-        char temp = expression[curPos];
+    const char *s = data();
+    while (curPos < length && s[curPos] == ' ') { ++curPos; }
+    if (curPos < length && s[curPos] != '\0') {
+        char temp = s[curPos];
         if ('0' <= temp && temp <= '9') {
             curPos = parseInteger();
             // curNum assigned here
             status = Number;
+        } else if (temp == '(' && (status == Number || (status == Operator && curOp == ')'))) {
+            // the implicit * of 2(3) or (2)(3), the ( stays for later
+            curOp = '*';
+            status = Operator;
         } else if (std::strchr("+-*/%^()", temp) != nullptr) {
             curOp = temp;
             ++curPos;
@@ -567,34 +3170,42 @@ void ExpressionParser::StringHandler::next() {
     }
 }
 
-unsigned ExpressionParser::StringHandler::parseInteger() {
-    if (expression[curPos] < '0' || expression[curPos] > '9') {
+size_t ExpressionParser::StringHandler::parseInteger() {
+    const char *s = data();
+    if (s[curPos] < '0' || s[curPos] > '9') {
         throw ParseError();
     }
-    unsigned temp = curPos;
-    while (expression[temp] >= '0' && expression[temp] <= '9') {
+    size_t temp = curPos;
+    while (temp < length && s[temp] >= '0' && s[temp] <= '9') {
         ++temp;
     }
-    curNum = BigInteger(expression.substr(curPos, temp - curPos));
+    curNum = BigInteger(s + curPos, temp - curPos);
     return temp;
 }
 
+// Checks the whole expression before parsing starts, then tokenizing
+// starts over from its first non-blank char.
 void ExpressionParser::StringHandler::preprocess() {
-    if (expression[expression.length() - 1] == '=') {
-        expression = expression.substr(0, expression.length() - 1);
+    const char *s = data();
+    if (length > 0 && s[length - 1] == '=') {
+        --length;
     }
-    if (expression.empty()) {
+    if (length == 0) {
         throw EmptyExpression();
     }
     enum {
         cDigit, cParenthesis, cWhiteSpace, cOperator, cOpen, cClose
     } lastChar = cDigit, lastNonSpace = cDigit;
-    expression = expression.substr(expression.find_first_not_of(' '));
+    first = 0;
+    while (first < length && s[first] == ' ') { ++first; }
+    if (first == length) {
+        throw EmptyExpression();
+    }
 
-    for (int i = 0; i < expression.length(); ++i) {
-        char c = expression[i];
+    for (size_t i = first; i < length; ++i) {
+        char c = s[i];
         if (c >= '0' && c <= '9') {
-            if (i != 0) {
+            if (i != first) {
                 if ((lastChar == cWhiteSpace && lastNonSpace == cDigit)
                     || lastNonSpace == cClose) {
                     throw SyntaxError();
@@ -602,7 +3213,7 @@ void ExpressionParser::StringHandler::preprocess() {
                 lastChar = cDigit;
                 lastNonSpace = cDigit;
             }
-        } else if (string("+-*/%^() ").find_first_of(c) == string::npos) {
+        } else if (std::strchr("+-*/%^() ", c) == nullptr || c == '\0') {
             throw UnidentifiedToken(c);
         } else {
             if (lastNonSpace == cOperator && c != ' ' && c != '(' && c != '+' && c != '-') {
@@ -612,13 +3223,6 @@ void ExpressionParser::StringHandler::preprocess() {
             if (c == ' ') {
                 lastChar = cWhiteSpace;
             } else if (c == '(') {
-                if (i != 0 &&
-                    (lastNonSpace == cDigit || lastNonSpace == cClose)) {
-                    auto len = expression.length();
-                    expression = expression.substr(0, i) + "*" +
-                                 expression.substr(i, len - i);
-                    i++;
-                }
                 lastNonSpace = cOpen;
                 lastChar = cOpen;
             } else if (c == ')') {
@@ -630,6 +3234,9 @@ void ExpressionParser::StringHandler::preprocess() {
             }
         }
     }
+    curPos = first;
+    status = End;
+    next();
 }
 
 ExpressionParser::Precedence ExpressionParser::precedenceOf(char op) {
@@ -654,62 +3261,116 @@ ExpressionParser::Associativity ExpressionParser::associativityOf(char op) {
     return Left;
 }
 
-ExpressionNode *ExpressionParser::parse(int precedence) {
-    if (precedence >= UnaryPrecedence) {
-        return unaryParse();
-    }
-    auto leftOperand = parse(precedence + 1);
-    if (handler.isEnd())
-        return leftOperand;
-    char op = handler.curOp;
-    if (associativityOf(op) == Right) {
-        handler.next();
-        return new OperationNode(op, leftOperand, parse(precedence));
-    } else {
-        while (precedenceOf(op) == precedence && !handler.isEnd()) {
+// Shunting-yard over an explicit stack, so nesting costs no native stack.
+// Operators wait on ops with '(' and Negate, operands wait on operands.
+// Unary signs and '(' are read where an operand is due; the unary minuses
+// right below it apply as soon as an operand is complete.
+ExpressionNode *ExpressionParser::parse() {
+    std::vector<char> ops;
+    std::vector<ExpressionNode *> operands;
+    size_t open = 0;
+    auto reduce = [&]() {
+        ExpressionNode *right = operands.back();
+        operands.pop_back();
+        operands.back() = nodes.make<OperationNode>(ops.back(), operands.back(), right);
+        ops.pop_back();
+    };
+    while (true) {
+        while (handler.isOp() && std::strchr("(-+", handler.curOp)) {
+            if (handler.curOp == '(') {
+                ops.push_back('(');
+                ++open;
+            } else if (handler.curOp == '-') {
+                ops.push_back(Negate);
+            }
+            handler.next();
+        }
+        ExpressionNode *operand = nullptr;
+        if (handler.isNum()) {
+            operand = nodes.make<NumberNode>(handler.curNum);
+            handler.next();
+        }
+        while (true) {
+            for (; !ops.empty() && ops.back() == Negate; ops.pop_back()) {
+                operand = negate(operand);
+            }
+            operands.push_back(operand);
+            if (!handler.isOp() || handler.curOp != ')' || open == 0)
+                break;
+            // the operand ends a parenthesis
+            while (ops.back() != '(') {
+                reduce();
+            }
+            ops.pop_back();
+            --open;
             handler.next();
-            auto rightOperand = parse(precedence + 1);
-            leftOperand = new OperationNode(op, leftOperand, rightOperand);
-            op = handler.curOp;
+            operand = operands.back();
+            operands.pop_back();
+        }
+
+        char op = handler.curOp;
+        if (handler.isEnd() || !handler.isOp() || precedenceOf(op) == UnaryPrecedence) {
+            // Whatever is left closes the expression; the caller checks
+            // that the input ends here.
+            while (!ops.empty() && ops.back() != '(') {
+                reduce();
+            }
+            if (!ops.empty())
+                throw ParenthesesNotMatch();
+            return operands.back();
         }
-        return leftOperand;
+        while (!ops.empty() && ops.back() != '(' &&
+               (precedenceOf(ops.back()) > precedenceOf(op) ||
+                (precedenceOf(ops.back()) == precedenceOf(op) && associativityOf(op) == Left))) {
+            reduce();
+        }
+        ops.push_back(op);
+        handler.next();
     }
 }
 
-ExpressionNode *ExpressionParser::unaryParse() {
-    ExpressionNode *ret = nullptr;
-    if (handler.isOp() && handler.curOp == '(') {
-        handler.next();
-        ret = parse(AddPrecedence);
-        if (handler.status != StringHandler::Operator || handler.curOp != ')') {
-            throw ParenthesesNotMatch();
+ExpressionNode *ExpressionParser::negate(ExpressionNode *operand) {
+    if (!operand)
+        throw SyntaxError();
+    auto number = dynamic_cast<NumberNode *>(operand);
+    if (number) {
+        number->negate();
+        return number;
+    }
+    return nodes.make<OperationNode>('-', nodes.make<NumberNode>(BigInteger(0)), operand);
+}
+
+void ExpressionParser::calculate(ResultCache *cache) {
+    if (tree == nullptr) {
+        handler.preprocess();
+        tree = parse();
+        if (!handler.isEnd() || tree == nullptr) {
+            throw SyntaxError();
         }
-        handler.next();
-    } else {
-        if (handler.isOp() && handler.curOp == '-') {
-            handler.next();
-            auto temp = unaryParse();
-            ret = new NumberNode(-temp->evaluate());
-            delete temp;
-        } else if (handler.isOp() && handler.curOp == '+') {
-            handler.next();
-            ret = unaryParse();
-        } else if (handler.isNum()) {
-            ret = new NumberNode(handler.curNum);
-            handler.next();
+        // Also checks that no operand is missing, before tree is printed.
+        Optimizer optimizer(nodes);
+        ExpressionNode *dag = optimizer.optimize(tree);
+        std::ostringstream key;
+        if (cache) {
+            tree->prefixVisit(key);
+            if (cache->find(key.str(), result))
+                return;
         }
+        dag->compile(program);
+        result = program.run();
+        if (cache)
+            cache->insert(key.str(), result);
     }
-    return ret;
 }
 
-void ExpressionParser::calculate() {
+void ExpressionParser::calculate(Modular &modular) {
     if (tree == nullptr) {
         handler.preprocess();
-        tree = parse(AddPrecedence);
-        if (!handler.isEnd()) {
+        tree = parse();
+        if (!handler.isEnd() || tree == nullptr) {
             throw SyntaxError();
         }
-        result = tree->evaluate();
+        result = modular.evaluate(tree);
     }
 }
 
@@ -724,6 +3385,125 @@ void ExpressionParser::postfixTraverse(std::ostream &os) {
 }
 
 
+///--------------------------------- Batch ----------------------------------///
+/// A read-only mapping of a whole file.
+class MappedFile {
+public:
+    explicit MappedFile(const char *path);
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const { return begin; }
+    size_t size() const { return length; }
+
+private:
+    const char *begin = nullptr;
+    size_t length = 0;
+};
+
+MappedFile::MappedFile(const char *path) {
+    int fd = open(path, O_RDONLY);
+    struct stat status;
+    if (fd < 0 || fstat(fd, &status) != 0) {
+        if (fd >= 0)
+            close(fd);
+        throw CannotOpenFile();
+    }
+    length = size_t(status.st_size);
+    if (length > 0) {
+        void *p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            close(fd);
+            throw CannotOpenFile();
+        }
+        madvise(p, length, MADV_SEQUENTIAL);
+        begin = static_cast<const char *>(p);
+    }
+    close(fd);                      // the mapping stays valid
+}
+
+MappedFile::~MappedFile() {
+    if (begin)
+        munmap(const_cast<char *>(begin), length);
+}
+
+/// Evaluates one expression per line on a thread pool and writes one line
+/// per input line, in input order: the result or the error met.
+/// Lines are handed out in chunks of about ChunkSize bytes; finished chunks
+/// wait in a window of futures until every earlier chunk is written.
+/// A nonzero modulus evaluates every line in Z/modulus Z, see Modular.
+class Batch {
+public:
+    static constexpr size_t ChunkSize = 1 << 16;
+
+    static void run(const char *text, size_t size, std::ostream &out, ThreadPool &pool,
+                    uint64_t modulus = 0);
+    static void run(const char *path, std::ostream &out, ThreadPool &pool,
+                    uint64_t modulus = 0);
+
+private:
+    static string evaluate(const char *begin, const char *end, uint64_t modulus);
+};
+
+constexpr size_t Batch::ChunkSize;
+
+string Batch::evaluate(const char *begin, const char *end, uint64_t modulus) {
+    std::ostringstream out;
+    Modular modular(modulus);
+    while (begin < end) {
+        auto eol = static_cast<const char *>(std::memchr(begin, '\n', end - begin));
+        const char *next = eol ? eol + 1 : end;
+        const char *last = eol ? eol : end;
+        if (last > begin && last[-1] == '\r')
+            --last;
+        try {
+            ExpressionParser parser(begin, size_t(last - begin));
+            if (modulus)
+                parser.calculate(modular);
+            else
+                parser.calculate();
+            out << parser.getResult() << '\n';
+        } catch (std::exception &e) {
+            out << "Error occur: " << e.what() << '\n';
+        }
+        begin = next;
+    }
+    return out.str();
+}
+
+void Batch::run(const char *text, size_t size, std::ostream &out, ThreadPool &pool,
+                uint64_t modulus) {
+    std::deque<std::future<string> > inFlight;
+    const size_t window = 2 * pool.size();
+    auto writeOldest = [&]() {
+        out << inFlight.front().get();
+        inFlight.pop_front();
+    };
+    const char *end = text + size;
+    for (const char *begin = text; begin < end;) {
+        // Chunks end just after a newline, or at the end of the text.
+        const char *cut = begin + std::min(ChunkSize, size_t(end - begin));
+        auto eol = static_cast<const char *>(std::memchr(cut - 1, '\n', end - cut + 1));
+        cut = eol ? eol + 1 : end;
+        if (inFlight.size() == window)
+            writeOldest();
+        inFlight.push_back(pool.submit([begin, cut, modulus]() {
+            return evaluate(begin, cut, modulus);
+        }));
+        begin = cut;
+    }
+    while (!inFlight.empty())
+        writeOldest();
+    out.flush();
+}
+
+void Batch::run(const char *path, std::ostream &out, ThreadPool &pool, uint64_t modulus) {
+    MappedFile file(path);
+    run(file.data(), file.size(), out, pool, modulus);
+}
+
+
 class TestCases {
 public:
     typedef BigInteger BI;
@@ -732,9 +3512,17 @@ public:
 
     void compareResults();
     void exceptionTests();
+    void multiplyTests();
+    void programTests();
+    void optimizerTests();
+    void wordTests();
+    void batchTests();
+    void nestingTests();
+    void cacheTests();
+    void modularTests();
 
 private:
-    static constexpr int testNum = 11;
+    static constexpr int testNum = 14;
     static constexpr int exceptionNum = 6;
     EP testCases[testNum] = {
             EP("((((1))))="),     // parentheses
@@ -748,6 +3536,9 @@ private:
             EP("3^3^3"),          // right association power
             EP("8+-5--4++73"),    // unary operation
             EP("847(8374)"),
+            EP("10293^253%1000007"),       // modular power
+            EP("(-7)^12345%1000000007"),
+            EP("2^(10^18+3)%998244353"),
     };
     BI answers[testNum] = {
             BI("1"),
@@ -779,7 +3570,10 @@ private:
             BI("11"),
             BI("7625597484987"),
             BI("80"),
-            BI("7092778")
+            BI("7092778"),
+            BI("460634"),
+            BI("290706561"),
+            BI("939353791")
     };
     EP exceptionCases[exceptionNum] = {
             EP("2837&4$5=1"),
@@ -802,6 +3596,14 @@ private:
 void TestCases::run() {
     compareResults();
     exceptionTests();
+    multiplyTests();
+    programTests();
+    optimizerTests();
+    wordTests();
+    batchTests();
+    nestingTests();
+    cacheTests();
+    modularTests();
 }
 
 void TestCases::compareResults() {
@@ -836,22 +3638,359 @@ void TestCases::exceptionTests() {
     }
 }
 
+// Big products evaluated six times: default dispatch, schoolbook only,
+// NTT forced, products on a pool, every operand pair forked, and all of it
+// again from inside a pool task, as a batch line does. All six must agree.
+void TestCases::multiplyTests() {
+    using std::cout;
+    const int caseNum = 4;
+    string exprs[caseNum] = {
+            "7^20000",
+            "(10^30000-1)*(10^30000-1)",
+            "123456789^3000*(-987654321)^2500",
+            "3^3^3*2^100000"
+    };
+    BI::Thresholds &t = BI::multiplyThresholds();
+    const BI::Thresholds saved = t;
+    BI::Parallel &policy = BI::parallelPolicy();
+    const BI::Parallel single = policy;
+    double &fork = Program::forkThreshold();
+    const double serial = fork;
+    ThreadPool pool(4);
+    int agreed = 0;
+    for (int i = 0; i < caseNum; ++i) {
+        BI results[6];
+        for (int mode = 0; mode < 6; ++mode) {
+            t = saved;
+            policy = single;
+            fork = serial;
+            if (mode == 1) {
+                t.karatsuba = t.toom3 = t.ntt = size_t(-1);
+            } else if (mode == 2) {
+                t.ntt = 1;
+            } else if (mode == 3) {
+                policy.pool = &pool;
+                policy.cutoff = 1;
+            } else if (mode >= 4) {
+                policy.pool = &pool;
+                fork = 0;
+            }
+            if (mode == 5) {
+                policy.cutoff = 1;
+                t.ntt = 1;
+                const string &expr = exprs[i];
+                std::future<BI> nested = pool.submit([&expr] {
+                    EP parser(expr);
+                    parser.calculate();
+                    return parser.getResult();
+                });
+                results[mode] = nested.get();
+                continue;
+            }
+            EP parser(exprs[i]);
+            parser.calculate();
+            results[mode] = parser.getResult();
+        }
+        if (results[0] == results[1] && results[2] == results[1] &&
+            results[3] == results[1] && results[4] == results[1] &&
+            results[5] == results[1]) {
+            ++agreed;
+        } else {
+            cout << "Multiplication paths disagree on " << exprs[i] << '\n';
+        }
+    }
+    t = saved;
+    policy = single;
+    fork = serial;
+    cout << agreed << " / " << caseNum << " agree with schoolbook multiplication."
+         << std::endl;
+}
+
+// A compiled program must give the same answer every time it runs.
+void TestCases::programTests() {
+    using std::cout;
+    int agreed = 0;
+    for (int i = 0; i < testNum; ++i) {
+        const Program &program = testCases[i].getProgram();
+        BI first = program.run(), second = program.run();
+        if (first == answers[i] && second == answers[i])
+            ++agreed;
+        else
+            cout << "Program " << i << " gives " << first << " then " << second << '\n';
+    }
+    cout << agreed << " / " << testNum << " compiled programs rerun correctly." << std::endl;
+}
+
+// Constants fold to one push and a repeated subterm is computed once,
+// where the plain tree would need 19 instructions.
+void TestCases::optimizerTests() {
+    using std::cout;
+    EP folded("(8+6*(5+4)^3)%31"), shared("(5^3000+1)*(5^3000+1)-(5^3000+1)^2");
+    folded.calculate();
+    shared.calculate();
+    int passed = (folded.getProgram().length() == 1 && folded.getResult() == BI(11)) +
+                 (shared.getProgram().length() < 19 && shared.getResult() == BI(0));
+    cout << passed << " / 2 optimized programs are shorter and still correct." << std::endl;
+}
+
+// Every int64 fold must give what BigInteger gives, around the int64
+// limits and the signs of / and %.
+void TestCases::wordTests() {
+    using std::cout;
+    const int64_t values[] = {
+            0, 1, -1, 2, -2, 3, -3, 7, -7, 63, 675, -8764, 3037000499, -3037000500,
+            INT64_MAX / 2, INT64_MIN / 2, INT64_MAX - 1, INT64_MIN + 1, INT64_MAX, INT64_MIN
+    };
+    int folded = 0, agreed = 0;
+    for (int64_t x : values) {
+        for (int64_t y : values) {
+            for (char op : string("+-*/%^")) {
+                int64_t word;
+                if (!Optimizer::foldWord(op, x, y, word))
+                    continue;
+                BI a(x), b(y), exact;
+                switch (op) {
+                    case '+':
+                        exact = a + b;
+                        break;
+                    case '-':
+                        exact = a - b;
+                        break;
+                    case '*':
+                        exact = a * b;
+                        break;
+                    case '/':
+                        exact = a / b;
+                        break;
+                    case '%':
+                        exact = a % b;
+                        break;
+                    default:
+                        exact = a ^ b;
+                }
+                ++folded;
+                if (exact == BI(word))
+                    ++agreed;
+                else
+                    cout << x << ' ' << op << ' ' << y << " folds to " << word << '\n';
+            }
+        }
+    }
+    cout << agreed << " / " << folded << " int64 folds agree with BigInteger." << std::endl;
+}
+
+// Many small chunks on four threads still come out in input order, with
+// errors in place.
+void TestCases::batchTests() {
+    using std::cout;
+    std::ostringstream text, expected, out;
+    const std::exception &divide = DivideByZero(), &syntax = SyntaxError();
+    for (int i = 0; i < 20000; ++i) {
+        if (i % 1000 == 7) {
+            text << i << "/0\n";
+            expected << "Error occur: " << divide.what() << '\n';
+        } else if (i % 1000 == 8) {
+            text << i << " " << i << "\r\n";
+            expected << "Error occur: " << syntax.what() << '\n';
+        } else {
+            text << "(" << i << "+1)^2\n";
+            expected << BI(i + 1) * BI(i + 1) << '\n';
+        }
+    }
+    ThreadPool pool(4);
+    string input = text.str();
+    Batch::run(input.data(), input.size(), out, pool);
+    cout << (out.str() == expected.str() ? "Batch output in order." : "Batch output differs.")
+         << std::endl;
+}
+
+// Nesting far deeper than the native stack would allow a recursive parser,
+// or any recursive pass after it: 3^200 is too big to fold, so the last two
+// keep an operation a level and go through the optimizer, the compiler,
+// the program and both traversals. A deep sum is also taken modulo 97.
+void TestCases::nestingTests() {
+    using std::cout;
+    const size_t depth = 100000;
+    EP parentheses(string(depth, '(') + "7" + string(depth, ')'));
+    string negations, differences, negatedDifferences, sums;
+    for (size_t i = 0; i < depth; ++i) {
+        negations += "-(";
+        differences += "(3^200-";
+        negatedDifferences += "-(3^200-";
+        sums += "(1+";
+    }
+    EP signs(negations + "7" + string(depth, ')'));
+    // x - 3^200 a level, and 3^200 - x twice is x again
+    EP operations(differences + "1" + string(depth, ')'));
+    EP negated(negatedDifferences + "1" + string(depth, ')'));
+    parentheses.calculate();
+    signs.calculate();
+    operations.calculate();
+    negated.calculate();
+    Modular modular(97);
+    EP sum(sums + "1" + string(depth, ')'));
+    sum.calculate(modular);
+    std::ostringstream prefix, postfix;
+    negated.prefixTraverse(prefix);
+    negated.postfixTraverse(postfix);
+    bool passed = parentheses.getResult() == BI(7) && signs.getResult() == BI(7) &&
+                  operations.getResult() == BI(1) &&
+                  negated.getResult() == BI(1) - BI(int64_t(depth)) * (BI(3) ^ BI(200)) &&
+                  // a postfix operator takes one more blank, three a level
+                  postfix.str().size() == prefix.str().size() + 3 * depth &&
+                  sum.getResult() == BI(int64_t(depth + 1) % 97);
+    cout << (passed ? "Deep nesting parses." : "Deep nesting fails.") << std::endl;
+}
+
+// The same expression written differently is a hit; older results make
+// way once the capacity is reached.
+void TestCases::cacheTests() {
+    using std::cout;
+    const size_t capacity = 1000;
+    ResultCache cache(capacity);
+    EP first("10293^253%77777"), same(" (10293) ^ ((253)) % 77777=");
+    first.calculate(&cache);
+    same.calculate(&cache);
+    bool passed = cache.stats().hits == 1 && same.getResult() == first.getResult();
+    for (int i = 0; i < 20; ++i) {
+        EP filler(std::to_string(i) + "*7");
+        filler.calculate(&cache);
+        passed = passed && filler.getResult() == BI(i * 7);
+    }
+    EP again("10293^253%77777");
+    again.calculate(&cache);
+    ResultCache::Stats stats = cache.stats();
+    passed = passed && stats.hits == 1 && stats.misses == 22 && stats.bytes <= capacity &&
+             again.getResult() == first.getResult();
+    cout << (passed ? "Result cache hits and evicts." : "Result cache fails.") << std::endl;
+}
+
+// Towers whose exact value is out of reach, checked with modPow, and
+// expressions whose exact value is not, taken modulo odd, even and
+// composite moduli; / and % as Modular defines them.
+void TestCases::modularTests() {
+    using std::cout;
+    auto residue = [](const BI &exact, int64_t m) {
+        BI r = exact % BI(m);
+        return r.compare(BI(0)) < 0 ? r + BI(m) : r;
+    };
+    const int64_t prime = 1000000007, even = int64_t(1) << 40, composite = 1000000000000000000;
+    struct Case {
+        string expr;
+        int64_t modulus;
+        BI expected;
+    } cases[] = {
+            {"3^3^3^3", prime, BI(3).modPow(BI(3) ^ BI(27), BI(prime))},
+            {"2^3^4^5", composite, BI(2).modPow(BI(3) ^ BI(1024), BI(composite))},
+            {"-(6^(2^70))+5", 360, residue(BI(5) - BI(6).modPow(BI(2) ^ BI(70), BI(360)), 360)},
+            {"10293^253-8764*675", 998244353,
+             residue((BI(10293) ^ BI(253)) - BI(8764 * 675), 998244353)},
+            {"(-7)^12345", even, residue(BI(-7) ^ BI(12345), even)},
+            {"3^3^3^3 % 1000000007 + 7 % 3", prime,
+             BI(3).modPow(BI(3) ^ BI(27), BI(prime)) + BI(1)},
+            {"1/3", 7, BI(5)},
+            {"2^-1 + 10/4", prime, BI(3)},
+            {"12/4*5", 8, BI(7)},
+    };
+    int agreed = 0;
+    for (const Case &c : cases) {
+        Modular modular(uint64_t(c.modulus));
+        EP parser(c.expr);
+        parser.calculate(modular);
+        if (parser.getResult() == c.expected)
+            ++agreed;
+        else
+            cout << c.expr << " gives " << parser.getResult() << '\n';
+    }
+    // No inverse, a % by a stranger to the modulus, an exponent of unknown
+    // size and 0 ^ 0.
+    const string failing[] = {"2/4", "5^100 % 7", "2^(2^64-2^64)", "0^(1-1)"};
+    const uint64_t moduli[] = {8, 11, 11, 11};
+    int raised = 0;
+    for (int i = 0; i < 4; ++i) {
+        Modular modular(moduli[i]);
+        EP parser(failing[i]);
+        try {
+            parser.calculate(modular);
+        } catch (std::exception &) {
+            ++raised;
+        }
+    }
+    cout << agreed << " / " << sizeof(cases) / sizeof(Case) << " modular results agree, "
+         << raised << " / 4 undefined ones raise." << std::endl;
+}
+
 //#define CASE_TEST
 
-int main() {
+// "--batch <file>" evaluates every line of file, otherwise expressions are
+// read interactively. "--mod <p>" gives every result modulo p.
+int main(int argc, char *argv[]) {
     using std::cout;
     using std::cin;
 #ifdef CASE_TEST
     TestCases tc;
     tc.run();
 #else
+    // Huge products use every core.
+    ThreadPool pool;
+    BigInteger::parallelPolicy().pool = &pool;
+    const char *batch = nullptr;
+    // Results are exact while no modulus is given; ":mod <p>" sets one.
+    std::unique_ptr<Modular> modular;
+    try {
+        for (int i = 1; i + 1 < argc; i += 2) {
+            if (std::strcmp(argv[i], "--batch") == 0)
+                batch = argv[i + 1];
+            else if (std::strcmp(argv[i], "--mod") == 0)
+                modular.reset(new Modular(Modular::modulusOf(argv[i + 1])));
+        }
+        if (batch) {
+            Batch::run(batch, cout, pool, modular ? modular->getModulus() : 0);
+            return 0;
+        }
+    } catch (std::exception &e) {
+        std::cerr << "Error occur: " << e.what() << std::endl;
+        return 1;
+    }
+    // Repeated expressions are answered from here; ":cache" shows its use.
+    ResultCache cache;
     string expr = "000";
     cout << "Enter your expression with an enter/return marking the end.\n";
     std::getline(cin, expr);
     while (!expr.empty()) {
+        if (expr == ":cache") {
+            ResultCache::Stats stats = cache.stats();
+            cout << "Cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+                 << stats.entries << " results in " << stats.bytes << " / "
+                 << stats.capacity << " bytes\n" << std::endl;
+            cout << "Enter your expression with an enter/return marking the end.\n";
+            std::getline(cin, expr);
+            continue;
+        }
+        if (expr.compare(0, 4, ":mod") == 0) {
+            std::istringstream words(expr.substr(4));
+            string text;
+            words >> text;
+            try {
+                modular.reset(text.empty() ? nullptr : new Modular(Modular::modulusOf(text)));
+                if (modular)
+                    cout << "Results are taken modulo " << modular->getModulus() << '\n'
+                         << std::endl;
+                else
+                    cout << "Results are exact\n" << std::endl;
+            } catch (std::exception &e) {
+                cout << "Error occur: " << e.what() << '\n' << std::endl;
+            }
+            cout << "Enter your expression with an enter/return marking the end.\n";
+            std::getline(cin, expr);
+            continue;
+        }
         try {
             ExpressionParser parser = ExpressionParser(expr);
-            parser.calculate();
+            if (modular)
+                parser.calculate(*modular);
+            else
+                parser.calculate(&cache);
             cout << "Prefix traverse:  ";
             parser.prefixTraverse(cout);
             cout << "Postfix traverse: ";
@@ -3,6 +3,10 @@
 #include <string>
 #include <exception>
 #include <cstring>
+#include <cstdlib>
+#include <utility>
+#include <algorithm>
+#include <atomic>
 
 #ifndef _NOEXCEPT
 #define _NOEXCEPT noexcept
@@ -242,6 +246,83 @@ std::ostream &Vector<ElemType>::show(std::ostream &os) const {
 
 
 
+///------------------------ BufferedWriter ---------------------------------///
+
+/// Collects output in a fixed buffer and hands it to the stream in big
+/// chunks, so printing millions of short lines does not flush per line.
+class BufferedWriter {
+public:
+    explicit BufferedWriter(std::ostream &o) : os(o), used(0) { }
+    ~BufferedWriter() { flush(); }
+
+    BufferedWriter(const BufferedWriter &) = delete;
+    BufferedWriter &operator=(const BufferedWriter &) = delete;
+
+    void write(const char *s, size_t n);
+    void put(char c);
+    void flush();
+
+    BufferedWriter &operator<<(char c) { put(c); return *this; }
+    BufferedWriter &operator<<(const char *s) { write(s, std::strlen(s)); return *this; }
+    BufferedWriter &operator<<(const std::string &s) { write(s.data(), s.length()); return *this; }
+    BufferedWriter &operator<<(long long i);
+    BufferedWriter &operator<<(int i) { return *this << (long long) i; }
+
+    // Anything else is printed by the stream itself, after what we hold.
+    template<class T>
+    BufferedWriter &operator<<(const T &t) {
+        flush();
+        os << t;
+        return *this;
+    }
+
+private:
+    static constexpr size_t BufferSize = 1 << 16;
+    std::ostream &os;
+    size_t used;
+    char buffer[BufferSize];
+};
+
+inline void BufferedWriter::write(const char *s, size_t n) {
+    if (used + n > BufferSize) {
+        flush();
+        if (n > BufferSize) {
+            os.write(s, n);
+            return;
+        }
+    }
+    std::memcpy(buffer + used, s, n);
+    used += n;
+}
+
+inline void BufferedWriter::put(char c) {
+    if (used == BufferSize)
+        flush();
+    buffer[used++] = c;
+}
+
+inline void BufferedWriter::flush() {
+    if (used > 0) {
+        os.write(buffer, used);
+        used = 0;
+    }
+}
+
+inline BufferedWriter &BufferedWriter::operator<<(long long i) {
+    char digits[24];
+    int n = 0;
+    unsigned long long u = i < 0 ? 0ull - (unsigned long long) i : i;
+    do {
+        digits[n++] = char('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (i < 0)
+        put('-');
+    while (n > 0)
+        put(digits[--n]);
+    return *this;
+}
+
 
 ///------------------------- MultiTree --------------------------------------///
 
@@ -255,14 +336,27 @@ public:
     const char* content;
 };
 
+// Summary kept for every subtree besides its size and height. Plug in a
+// commutative monoid: identity(), of(data) and combine(a, b).
 template <class Type>
+struct NoAggregate {
+    struct Value { };
+    static Value identity() { return Value(); }
+    static Value of(const Type &) { return Value(); }
+    static Value combine(const Value &, const Value &) { return Value(); }
+};
+
+template <class Type, class Aggregate = NoAggregate<Type> >
 class MultiTree {
 public:
     struct Node {
         Node(const Type& d, Node* par,
              Node * child = nullptr, Node * sib = nullptr) :
                 data(d), firstChild(child),
-                sibling(sib), parent(par) { }
+                sibling(sib), parent(par),
+                depth(-1), jump(nullptr),
+                descendants(0), height(0), summary(Aggregate::of(d)) { }
+        ~Node() { delete[] jump; }
         Type data;
         Node * firstChild;
         Node * sibling;
@@ -271,6 +365,77 @@ public:
         Node * insertSibling(const Type &d);
         Node *leftMostOf();
         Node *rightMostOf();
+
+        // Ancestor index, only filled once enabled on the tree:
+        // depth is -1 before that, jump[k] is the 2^k-th ancestor.
+        int depth;
+        Node ** jump;
+        void buildJumps(Node *father);
+
+        // Subtree aggregates, kept up to date on insert and dismiss.
+        int descendants;
+        int height;
+        typename Aggregate::Value summary;
+    };
+
+    // Traversals keep their own stack, so neither deep nor wide families
+    // can overflow the call stack. Constructed with a node, they walk its
+    // subtree; with withSiblings set they also walk the following siblings
+    // (the whole forest when started from the root).
+    class PreorderIterator {
+    public:
+        explicit PreorderIterator(Node *start, bool withSiblings = false);
+        PreorderIterator(const PreorderIterator &) = delete;
+        PreorderIterator &operator=(const PreorderIterator &) = delete;
+
+        Node *operator*() const { return cur; }
+        Node *operator->() const { return cur; }
+        PreorderIterator &operator++();
+        bool isEnd() const { return cur == nullptr; }
+
+    private:
+        Node *cur;
+        Node *top;
+        bool siblings;
+        Vector<Node *> pending;
+    };
+
+    class PostorderIterator {
+    public:
+        explicit PostorderIterator(Node *start, bool withSiblings = false);
+        PostorderIterator(const PostorderIterator &) = delete;
+        PostorderIterator &operator=(const PostorderIterator &) = delete;
+
+        Node *operator*() const { return cur; }
+        Node *operator->() const { return cur; }
+        PostorderIterator &operator++();
+        bool isEnd() const { return cur == nullptr; }
+
+    private:
+        Node *cur;
+        Node *top;
+        bool siblings;
+        Vector<Node *> pending;
+        void pushLeft(Node *p);
+        void popNext();
+    };
+
+    class LevelOrderIterator {
+    public:
+        explicit LevelOrderIterator(Node *start, bool withSiblings = false);
+        LevelOrderIterator(const LevelOrderIterator &) = delete;
+        LevelOrderIterator &operator=(const LevelOrderIterator &) = delete;
+
+        Node *operator*() const { return cur; }
+        Node *operator->() const { return cur; }
+        LevelOrderIterator &operator++();
+        bool isEnd() const { return cur == nullptr; }
+
+    private:
+        Node *cur;
+        size_t pos;
+        Vector<Node *> level;       // generation being visited
+        Vector<Node *> nextLevel;   // their children, in order
     };
 
 public:
@@ -285,24 +450,46 @@ public:
     int dismissSubTree(Node *&node);
     int dismissSubTree(Node *&node, Vector<Type> &valList);
     Node *getRoot() const;
-    void showNode(struct Node* node, int indent);
+
+    // Genealogy queries, O(log n) with the ancestor index enabled.
+    void enableAncestorIndex();
+    bool hasAncestorIndex() const;
+    static Node *parentOf(Node *node);
+    static int depthOf(Node *node);
+    static Node *kthAncestor(Node *node, int k);
+    static Node *lowestCommonAncestor(Node *a, Node *b);
+    static bool isDescendantOf(Node *node, Node *ancestor);
+
+    // Subtree aggregates, O(1).
+    static int familySize(Node *node) { return node->descendants + 1; }
+    static int descendantCount(Node *node) { return node->descendants; }
+    static int heightOf(Node *node) { return node->height; }
+    static const typename Aggregate::Value &summaryOf(Node *node) {
+        return node->summary;
+    }
+    static void setData(Node *node, const Type &d);
+    void showNode(Node *node, BufferedWriter &out);
+    void reset(const Type &d);
 
 private:
     Node * root;
     Vector<int> indentVec;
     static bool deleteLeave(Node *&node, Node *&parent);
-    static Node *recursiveFind(Node *, const Type &d);
-    static void showNode(Node *, std::ostream & os);
+    static void growAncestors(Node *father, Node *leaf);
+    static void shrinkAncestors(Node *father, int removed);
+    static void recompute(Node *node);
 };
 
-template<class Type>
+template<class Type, class Aggregate>
 int
-MultiTree<Type>::dismissSubTree(Node *&node, Vector<Type> &valList) {
+MultiTree<Type, Aggregate>::dismissSubTree(Node *&node, Vector<Type> &valList) {
     if (node == nullptr)
         return 0;
     if (node == root && root->sibling == nullptr) {
         throw MultiTreeException("Cannot delete only root");
     }
+    Node *father = parentOf(node);
+    valList.reserve(familySize(node));
     auto *child = node->firstChild;
     auto *p = child;
     Node *temp;
@@ -329,31 +516,36 @@ MultiTree<Type>::dismissSubTree(Node *&node, Vector<Type> &valList) {
         deleteLeave(child, temp);
         ++count;
     }
-    if (node->sibling) {
-        if (node->parent)
-            node->parent->sibling = node->sibling;
-        else
-            root = node->sibling;
-        node->sibling = nullptr;
-    } else {
-        node->parent->sibling = nullptr;
-    }
-    valList.pushBack(node->data);
-    node->parent = nullptr;
-    deleteLeave(node, temp);
+    // node may alias the link we are about to rewrite
+    Node *target = node;
+    Node *next = target->sibling;
+    if (target->parent == nullptr)
+        root = next;
+    else if (target->parent->firstChild == target)
+        target->parent->firstChild = next;
+    else
+        target->parent->sibling = next;
+    if (next)
+        next->parent = target->parent;
+    target->sibling = nullptr;
+    valList.pushBack(target->data);
+    target->parent = nullptr;
+    deleteLeave(target, temp);
     ++count;
-    node = nullptr;
+    if (node == target)
+        node = nullptr;
+    shrinkAncestors(father, count);
     return count;
 }
 
-template<class Type>
-int MultiTree<Type>::dismissSubTree(Node *&node) {
+template<class Type, class Aggregate>
+int MultiTree<Type, Aggregate>::dismissSubTree(Node *&node) {
     Vector<Type> temp;
     return dismissSubTree(node, temp);
 }
 
-template<class Type>
-bool MultiTree<Type>::deleteLeave(Node *&node, Node *&parent) {
+template<class Type, class Aggregate>
+bool MultiTree<Type, Aggregate>::deleteLeave(Node *&node, Node *&parent) {
     if (node->firstChild == nullptr && node->sibling == nullptr) {
         parent = node->parent;
         if (parent) {
@@ -367,9 +559,9 @@ bool MultiTree<Type>::deleteLeave(Node *&node, Node *&parent) {
     return false;
 }
 
-template<class Type>
-typename MultiTree<Type>::Node *
-MultiTree<Type>::insertChild(MultiTree::Node *node, const Type &d) {
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::Node *
+MultiTree<Type, Aggregate>::insertChild(MultiTree::Node *node, const Type &d) {
     auto child = node->firstChild;
     Node* ret;
     if (!child) {
@@ -383,9 +575,9 @@ MultiTree<Type>::insertChild(MultiTree::Node *node, const Type &d) {
     return ret;
 }
 
-template<class Type>
-typename MultiTree<Type>::Node *
-MultiTree<Type>::insertSibling(MultiTree::Node *node, const Type &d) {
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::Node *
+MultiTree<Type, Aggregate>::insertSibling(MultiTree::Node *node, const Type &d) {
     auto sib = node->rightMostOf();
     auto ret = sib->insertSibling(d);
     if (ret == nullptr)
@@ -393,108 +585,267 @@ MultiTree<Type>::insertSibling(MultiTree::Node *node, const Type &d) {
     return ret;
 }
 
-template<class Type>
-typename MultiTree<Type>::Node *MultiTree<Type>::trivialFind(const Type &d) {
-    return recursiveFind(root, d);
-}
-
-template<class Type>
-typename MultiTree<Type>::Node *
-MultiTree<Type>::recursiveFind(MultiTree::Node *node, const Type &d) {
-    if (node->data == d) return node;
-    Node *ret = nullptr;
-    if (node->sibling)
-        ret = recursiveFind(node->sibling, d);
-    if (!ret && node->firstChild)
-        ret = recursiveFind(node->firstChild, d);
-    return ret;
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::Node *MultiTree<Type, Aggregate>::trivialFind(const Type &d) {
+    for (PreorderIterator it(root, true); !it.isEnd(); ++it) {
+        if (it->data == d)
+            return *it;
+    }
+    return nullptr;
 }
 
-template<class Type>
-std::ostream &MultiTree<Type>::show(std::ostream &os) {
+template<class Type, class Aggregate>
+std::ostream &MultiTree<Type, Aggregate>::show(std::ostream &os) {
+    BufferedWriter out(os);
     indentVec.clear();
-    showNode(root, 0);
+    showNode(root, out);
     return os;
 }
 
-template<class Type>
-void MultiTree<Type>::showNode(MultiTree::Node *node, std::ostream &os) {
-    os << node->data << '\t';
-    if (node->sibling) {
-        showNode(node->sibling, os);
-    } else {
-        os << '\n';
-    }
-    if (node->firstChild) {
-        showNode(node->firstChild, os);
+template<class Type, class Aggregate>
+MultiTree<Type, Aggregate>::~MultiTree() {
+    // Children always come before their parent in postorder.
+    PostorderIterator it(root, true);
+    while (!it.isEnd()) {
+        Node *p = *it;
+        ++it;
+        delete p;
     }
+    root = nullptr;
 }
 
-template<class Type>
-MultiTree<Type>::~MultiTree() {
-    Node temp("", nullptr, root, nullptr);
-    root->parent = &temp; root = &temp;
-    dismissSubTree(temp.firstChild);
-    root = nullptr;
+// Drops every member and starts over with a single root.
+template<class Type, class Aggregate>
+void MultiTree<Type, Aggregate>::reset(const Type &d) {
+    bool indexed = hasAncestorIndex();
+    PostorderIterator it(root, true);
+    while (!it.isEnd()) {
+        Node *p = *it;
+        ++it;
+        delete p;
+    }
+    root = new Node(d, nullptr);
+    if (indexed)
+        root->buildJumps(nullptr);
 }
 
-template<class Type>
-typename MultiTree<Type>::Node *MultiTree<Type>::getRoot() const {
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::Node *MultiTree<Type, Aggregate>::getRoot() const {
     if (root == nullptr)
         throw MultiTreeException("Root deleted.");
     return root;
 }
 
-template<class Type>
-void MultiTree<Type>::showNode(MultiTree::Node *node, int indent) {
-    if (indent > 0) {
-        for (int i = 0; i < indent - 1; ++i) {
-            std::cout << (indentVec[i] ? "│   " : "    ");
+// Draws every member below its parent, siblings at the same indent: all
+// but the last behind "├── ", the last behind "└── ". Frames are kept on
+// our own stack, and each member takes one line of at most one column per
+// generation, so a family a million wide is a million short lines.
+template<class Type, class Aggregate>
+void MultiTree<Type, Aggregate>::showNode(MultiTree::Node *node, BufferedWriter &out) {
+    struct Frame {
+        Node *node;
+        int indent;
+    };
+    Vector<Frame> frames;
+    if (node)
+        frames.pushBack(Frame{node, 0});
+    while (!frames.isEmpty()) {
+        Frame f = frames.pop();
+        frames.popBack();
+        bool last = f.node->sibling == nullptr;
+        if (f.indent > 0) {
+            for (int i = 0; i < f.indent - 1; ++i) {
+                out << (indentVec[i] ? "│   " : "    ");
+            }
+            out << (last ? "└── " : "├── ");
+            indentVec[f.indent - 1] = !last;
         }
-        std::cout << (indentVec[indent - 1] ? "├── " : "└── ");
+        out << f.node->data << '\n';
+        while (indentVec.length() < size_t(f.indent) + 1)
+            indentVec.pushBack(0);
+        // The younger siblings wait until this member's family is drawn.
+        if (f.node->sibling)
+            frames.pushBack(Frame{f.node->sibling, f.indent});
+        if (f.node->firstChild)
+            frames.pushBack(Frame{f.node->firstChild, f.indent + 1});
     }
+}
 
-    if (!node) {
-        std::cout << ("(null)\n");
-        return;
+
+template<class Type, class Aggregate>
+void MultiTree<Type, Aggregate>::Node::buildJumps(Node *father) {
+    depth = father ? father->depth + 1 : 0;
+    int levels = 0;
+    while ((1 << levels) <= depth) {
+        ++levels;
+    }
+    delete[] jump;
+    jump = levels ? new Node *[levels] : nullptr;
+    if (levels) {
+        jump[0] = father;
+        for (int k = 1; k < levels; ++k) {
+            jump[k] = jump[k - 1]->jump[k - 1];
+        }
     }
-    std::cout << node->data << std::endl;
-    if (!node->firstChild && !node->sibling)
+}
+
+template<class Type, class Aggregate>
+void MultiTree<Type, Aggregate>::enableAncestorIndex() {
+    if (hasAncestorIndex())
         return;
+    // In preorder a node's binary parent is either its father or its
+    // elder sibling, and both have been indexed already.
+    for (PreorderIterator it(root, true); !it.isEnd(); ++it) {
+        Node *p = it->parent;
+        if (p == nullptr)
+            it->buildJumps(nullptr);
+        else if (p->firstChild == *it)
+            it->buildJumps(p);
+        else
+            it->buildJumps(p->depth > 0 ? p->jump[0] : nullptr);
+    }
+}
 
-    while (indentVec.length() < indent + 1)
-        indentVec.pushBack(0);
-    indentVec[indent] = 1;
-    showNode(node->firstChild, indent + 1);
-    indentVec[indent] = 0;
-    showNode(node->sibling, indent + 1);
+template<class Type, class Aggregate>
+bool MultiTree<Type, Aggregate>::hasAncestorIndex() const {
+    return root != nullptr && root->depth >= 0;
 }
 
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::Node *MultiTree<Type, Aggregate>::parentOf(Node *node) {
+    if (node->depth >= 0)
+        return node->depth > 0 ? node->jump[0] : nullptr;
+    while (node->parent && node->parent->firstChild != node) {
+        node = node->parent;
+    }
+    return node->parent;
+}
 
-template<class Type>
-typename MultiTree<Type>::Node *
-MultiTree<Type>::Node::insertChild(const Type &d) {
+template<class Type, class Aggregate>
+int MultiTree<Type, Aggregate>::depthOf(Node *node) {
+    if (node->depth >= 0)
+        return node->depth;
+    int d = 0;
+    for (Node *p = parentOf(node); p; p = parentOf(p)) {
+        ++d;
+    }
+    return d;
+}
+
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::Node *
+MultiTree<Type, Aggregate>::kthAncestor(Node *node, int k) {
+    if (node->depth < 0)
+        throw MultiTreeException("Ancestor index not enabled");
+    if (k < 0 || k > node->depth)
+        return nullptr;
+    for (int bit = 0; k > 0; ++bit, k >>= 1) {
+        if (k & 1)
+            node = node->jump[bit];
+    }
+    return node;
+}
+
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::Node *
+MultiTree<Type, Aggregate>::lowestCommonAncestor(Node *a, Node *b) {
+    if (a->depth < 0 || b->depth < 0)
+        throw MultiTreeException("Ancestor index not enabled");
+    if (a->depth < b->depth)
+        std::swap(a, b);
+    a = kthAncestor(a, a->depth - b->depth);
+    if (a == b)
+        return a;
+    // Climb together while the ancestors still differ.
+    for (int k = 30; k >= 0; --k) {
+        if ((1 << k) <= a->depth && a->jump[k] != b->jump[k]) {
+            a = a->jump[k];
+            b = b->jump[k];
+        }
+    }
+    // Different ancestors at the top level share no one.
+    return a->depth > 0 ? a->jump[0] : nullptr;
+}
+
+template<class Type, class Aggregate>
+bool MultiTree<Type, Aggregate>::isDescendantOf(Node *node, Node *ancestor) {
+    if (node->depth < 0 || ancestor->depth < 0)
+        throw MultiTreeException("Ancestor index not enabled");
+    return node->depth > ancestor->depth &&
+           kthAncestor(node, node->depth - ancestor->depth) == ancestor;
+}
+
+template<class Type, class Aggregate>
+void MultiTree<Type, Aggregate>::growAncestors(Node *father, Node *leaf) {
+    int h = leaf->height;
+    for (Node *a = father; a; a = parentOf(a)) {
+        ++a->descendants;
+        if (a->height < ++h)
+            a->height = h;
+        else
+            h = a->height;
+        a->summary = Aggregate::combine(a->summary, leaf->summary);
+    }
+}
+
+template<class Type, class Aggregate>
+void MultiTree<Type, Aggregate>::shrinkAncestors(Node *father, int removed) {
+    for (Node *a = father; a; a = parentOf(a)) {
+        a->descendants -= removed;
+        recompute(a);
+    }
+}
+
+// Height and summary of node from its children, which are up to date.
+template<class Type, class Aggregate>
+void MultiTree<Type, Aggregate>::recompute(Node *node) {
+    node->height = 0;
+    node->summary = Aggregate::of(node->data);
+    for (Node *c = node->firstChild; c; c = c->sibling) {
+        if (node->height < c->height + 1)
+            node->height = c->height + 1;
+        node->summary = Aggregate::combine(node->summary, c->summary);
+    }
+}
+
+template<class Type, class Aggregate>
+void MultiTree<Type, Aggregate>::setData(Node *node, const Type &d) {
+    node->data = d;
+    for (Node *a = node; a; a = parentOf(a)) {
+        recompute(a);
+    }
+}
+
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::Node *
+MultiTree<Type, Aggregate>::Node::insertChild(const Type &d) {
     if (firstChild != nullptr) {
         return nullptr;
     }
     auto node = new Node(d, this);
     firstChild = node;
+    if (depth >= 0)
+        node->buildJumps(this);
+    growAncestors(this, node);
     return node;
 }
 
-template<class Type>
-typename MultiTree<Type>::Node *
-MultiTree<Type>::Node::insertSibling(const Type &d) {
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::Node *
+MultiTree<Type, Aggregate>::Node::insertSibling(const Type &d) {
     if (sibling != nullptr) {
         return nullptr;
     }
     auto node = new Node(d, this);
     sibling = node;
+    if (depth >= 0)
+        node->buildJumps(depth > 0 ? jump[0] : nullptr);
+    growAncestors(parentOf(node), node);
     return node;
 }
 
-template<class Type>
-typename MultiTree<Type>::Node *MultiTree<Type>::Node::leftMostOf() {
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::Node *MultiTree<Type, Aggregate>::Node::leftMostOf() {
     auto p = this;
     while (p->firstChild) {
         p = p->firstChild;
@@ -502,8 +853,8 @@ typename MultiTree<Type>::Node *MultiTree<Type>::Node::leftMostOf() {
     return p;
 }
 
-template<class Type>
-typename MultiTree<Type>::Node *MultiTree<Type>::Node::rightMostOf() {
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::Node *MultiTree<Type, Aggregate>::Node::rightMostOf() {
     auto p = this;
     while (p->sibling) {
         p = p->sibling;
@@ -511,6 +862,563 @@ typename MultiTree<Type>::Node *MultiTree<Type>::Node::rightMostOf() {
     return p;
 }
 
+template<class Type, class Aggregate>
+MultiTree<Type, Aggregate>::PreorderIterator::PreorderIterator(Node *start,
+                                                    bool withSiblings) :
+        cur(start), top(start), siblings(withSiblings) { }
+
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::PreorderIterator &
+MultiTree<Type, Aggregate>::PreorderIterator::operator++() {
+    if (cur == nullptr)
+        return *this;
+    Node *next = (siblings || cur != top) ? cur->sibling : nullptr;
+    if (cur->firstChild) {
+        if (next)
+            pending.pushBack(next);
+        cur = cur->firstChild;
+    } else if (next) {
+        cur = next;
+    } else if (!pending.isEmpty()) {
+        cur = pending.pop();
+        pending.popBack();
+    } else {
+        cur = nullptr;
+    }
+    return *this;
+}
+
+template<class Type, class Aggregate>
+MultiTree<Type, Aggregate>::PostorderIterator::PostorderIterator(Node *start,
+                                                      bool withSiblings) :
+        cur(nullptr), top(start), siblings(withSiblings) {
+    pushLeft(start);
+    popNext();
+}
+
+template<class Type, class Aggregate>
+void MultiTree<Type, Aggregate>::PostorderIterator::pushLeft(Node *p) {
+    for (; p; p = p->firstChild) {
+        pending.pushBack(p);
+    }
+}
+
+template<class Type, class Aggregate>
+void MultiTree<Type, Aggregate>::PostorderIterator::popNext() {
+    if (pending.isEmpty()) {
+        cur = nullptr;
+    } else {
+        cur = pending.pop();
+        pending.popBack();
+    }
+}
+
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::PostorderIterator &
+MultiTree<Type, Aggregate>::PostorderIterator::operator++() {
+    if (cur == nullptr)
+        return *this;
+    // All children of cur are done; its younger siblings come next.
+    if (siblings || cur != top)
+        pushLeft(cur->sibling);
+    popNext();
+    return *this;
+}
+
+template<class Type, class Aggregate>
+MultiTree<Type, Aggregate>::LevelOrderIterator::LevelOrderIterator(Node *start,
+                                                        bool withSiblings) :
+        cur(start), pos(0) {
+    if (start == nullptr)
+        return;
+    level.pushBack(start);
+    if (withSiblings) {
+        for (Node *p = start->sibling; p; p = p->sibling) {
+            level.pushBack(p);
+        }
+    }
+}
+
+template<class Type, class Aggregate>
+typename MultiTree<Type, Aggregate>::LevelOrderIterator &
+MultiTree<Type, Aggregate>::LevelOrderIterator::operator++() {
+    if (cur == nullptr)
+        return *this;
+    for (Node *c = cur->firstChild; c; c = c->sibling) {
+        nextLevel.pushBack(c);
+    }
+    if (++pos == level.length()) {
+        level.swap(nextLevel);
+        nextLevel.clear();
+        pos = 0;
+    }
+    cur = pos < level.length() ? level[pos] : nullptr;
+    return *this;
+}
+
+
+
+///--------------------- PersistentMultiTree --------------------------------///
+
+/// Immutable multi-way tree. An update copies only the nodes on the path
+/// from the top to the change and shares everything else with the version
+/// it came from, so old versions stay valid and can be read from any thread
+/// without locks. The children of a node are kept in a persistent AVL tree
+/// ordered by position, so each level of the path copies O(log fan-out)
+/// links instead of the whole sibling list, and a version costs
+/// O(depth * log fan-out). Nodes and links are reference counted.
+template <class Type>
+class PersistentMultiTree {
+public:
+    struct Node;
+
+    // One child in the sibling tree of its parent, with the number of
+    // children and of members below this link.
+    struct Link {
+        Link(const Link *l, const Node *n, const Link *r);
+        Link(const Link &) = delete;
+        Link &operator=(const Link &) = delete;
+
+        const Node *node;
+        const Link *left;
+        const Link *right;
+        int count;
+        int members;
+        int height;
+        mutable std::atomic<int> refs;
+    };
+
+    struct Node {
+        explicit Node(const Type &d) : data(d), children(nullptr), size(1), refs(1) { }
+        Node(const Node &) = delete;
+        Node &operator=(const Node &) = delete;
+
+        int childCount() const { return countOf(children); }
+        // O(log fan-out)
+        const Node *child(int i) const;
+
+        Type data;
+        const Link *children;
+        int size;                       // nodes in this subtree
+        mutable std::atomic<int> refs;
+    };
+
+    // Child indices from the top level down; empty means "the top".
+    typedef Vector<int> Path;
+
+    PersistentMultiTree();
+    PersistentMultiTree(const PersistentMultiTree &another);
+    PersistentMultiTree &operator=(const PersistentMultiTree &another);
+    ~PersistentMultiTree();
+
+    // Each update returns the new version and leaves *this untouched.
+    PersistentMultiTree appendChild(const Path &parent, const Type &d) const;
+    PersistentMultiTree remove(const Path &path) const;
+    PersistentMultiTree setData(const Path &path, const Type &d) const;
+
+    bool find(const Type &d, Path &path) const;
+    const Node *nodeAt(const Path &path) const;
+    // Virtual node whose children are the top level ancestors.
+    const Node *getTop() const { return top; }
+    int size() const { return top->size - 1; }
+    std::ostream &show(std::ostream &os) const;
+
+private:
+    const Node *top;
+
+    explicit PersistentMultiTree(const Node *t) : top(t) { }
+    const Node *walk(const Path &path, int levels, Vector<const Node *> &chain) const;
+    static PersistentMultiTree copyPath(const Path &path, int levels,
+                                        Vector<const Node *> &chain,
+                                        const Node *replacement);
+    static Node *copyOf(const Node *node);
+    static void setChildren(Node *node, const Link *list);
+
+    // Sibling tree updates. Arguments are borrowed, results are owned by
+    // the caller.
+    static int countOf(const Link *t) { return t ? t->count : 0; }
+    static int membersOf(const Link *t) { return t ? t->members : 0; }
+    static int heightOf(const Link *t) { return t ? t->height : 0; }
+    static const Link *balance(const Link *l, const Node *n, const Link *r);
+    static const Link *insertAt(const Link *t, int i, const Node *n);
+    static const Link *eraseAt(const Link *t, int i);
+    static const Link *replaceAt(const Link *t, int i, const Node *n);
+
+    static void retain(const Node *node);
+    static void retain(const Link *link);
+    static void release(const Node *node);
+    static void release(const Link *link);
+    static void release(const Node *node, const Link *link);
+};
+
+template<class Type>
+PersistentMultiTree<Type>::Link::Link(const Link *l, const Node *n, const Link *r) :
+        node(n), left(l), right(r),
+        count(countOf(l) + 1 + countOf(r)),
+        members(membersOf(l) + n->size + membersOf(r)),
+        height(std::max(heightOf(l), heightOf(r)) + 1), refs(1) {
+    retain(l);
+    retain(n);
+    retain(r);
+}
+
+template<class Type>
+const typename PersistentMultiTree<Type>::Node *
+PersistentMultiTree<Type>::Node::child(int i) const {
+    const Link *t = children;
+    while (i != countOf(t->left)) {
+        if (i < countOf(t->left)) {
+            t = t->left;
+        } else {
+            i -= countOf(t->left) + 1;
+            t = t->right;
+        }
+    }
+    return t->node;
+}
+
+template<class Type>
+PersistentMultiTree<Type>::PersistentMultiTree() : top(new Node(Type())) { }
+
+template<class Type>
+PersistentMultiTree<Type>::PersistentMultiTree(const PersistentMultiTree &another) :
+        top(another.top) {
+    retain(top);
+}
+
+template<class Type>
+PersistentMultiTree<Type> &
+PersistentMultiTree<Type>::operator=(const PersistentMultiTree &another) {
+    if (&another == this)
+        return *this;
+    retain(another.top);
+    release(top);
+    top = another.top;
+    return *this;
+}
+
+template<class Type>
+PersistentMultiTree<Type>::~PersistentMultiTree() {
+    release(top);
+}
+
+template<class Type>
+void PersistentMultiTree<Type>::retain(const Node *node) {
+    if (node)
+        node->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+template<class Type>
+void PersistentMultiTree<Type>::retain(const Link *link) {
+    if (link)
+        link->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+template<class Type>
+void PersistentMultiTree<Type>::release(const Node *node) {
+    release(node, nullptr);
+}
+
+template<class Type>
+void PersistentMultiTree<Type>::release(const Link *link) {
+    release(nullptr, link);
+}
+
+// Frees every node and link nobody else refers to, without recursion.
+template<class Type>
+void PersistentMultiTree<Type>::release(const Node *node, const Link *link) {
+    Vector<const Node *> nodes;
+    Vector<const Link *> links;
+    auto dropNode = [&nodes](const Node *p) {
+        if (p && p->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            nodes.pushBack(p);
+    };
+    auto dropLink = [&links](const Link *t) {
+        if (t && t->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            links.pushBack(t);
+    };
+    dropNode(node);
+    dropLink(link);
+    while (!nodes.isEmpty() || !links.isEmpty()) {
+        if (!links.isEmpty()) {
+            const Link *t = links.pop();
+            links.popBack();
+            dropLink(t->left);
+            dropLink(t->right);
+            dropNode(t->node);
+            delete t;
+        } else {
+            const Node *p = nodes.pop();
+            nodes.popBack();
+            dropLink(p->children);
+            delete p;
+        }
+    }
+}
+
+// Joins l, n and r, whose heights differ by at most two, with at most
+// one single or double rotation.
+template<class Type>
+const typename PersistentMultiTree<Type>::Link *
+PersistentMultiTree<Type>::balance(const Link *l, const Node *n, const Link *r) {
+    if (heightOf(l) > heightOf(r) + 1) {
+        if (heightOf(l->left) >= heightOf(l->right)) {
+            const Link *inner = new Link(l->right, n, r);
+            const Link *result = new Link(l->left, l->node, inner);
+            release(inner);
+            return result;
+        }
+        const Link *a = new Link(l->left, l->node, l->right->left);
+        const Link *b = new Link(l->right->right, n, r);
+        const Link *result = new Link(a, l->right->node, b);
+        release(a);
+        release(b);
+        return result;
+    }
+    if (heightOf(r) > heightOf(l) + 1) {
+        if (heightOf(r->right) >= heightOf(r->left)) {
+            const Link *inner = new Link(l, n, r->left);
+            const Link *result = new Link(inner, r->node, r->right);
+            release(inner);
+            return result;
+        }
+        const Link *a = new Link(l, n, r->left->left);
+        const Link *b = new Link(r->left->right, r->node, r->right);
+        const Link *result = new Link(a, r->left->node, b);
+        release(a);
+        release(b);
+        return result;
+    }
+    return new Link(l, n, r);
+}
+
+template<class Type>
+const typename PersistentMultiTree<Type>::Link *
+PersistentMultiTree<Type>::insertAt(const Link *t, int i, const Node *n) {
+    if (!t)
+        return new Link(nullptr, n, nullptr);
+    const Link *part, *result;
+    if (i <= countOf(t->left)) {
+        part = insertAt(t->left, i, n);
+        result = balance(part, t->node, t->right);
+    } else {
+        part = insertAt(t->right, i - countOf(t->left) - 1, n);
+        result = balance(t->left, t->node, part);
+    }
+    release(part);
+    return result;
+}
+
+template<class Type>
+const typename PersistentMultiTree<Type>::Link *
+PersistentMultiTree<Type>::eraseAt(const Link *t, int i) {
+    const Link *part, *result;
+    const int before = countOf(t->left);
+    if (i < before) {
+        part = eraseAt(t->left, i);
+        result = balance(part, t->node, t->right);
+    } else if (i > before) {
+        part = eraseAt(t->right, i - before - 1);
+        result = balance(t->left, t->node, part);
+    } else if (!t->left || !t->right) {
+        result = t->left ? t->left : t->right;
+        retain(result);
+        return result;
+    } else {
+        // The next sibling takes this link's place.
+        const Link *next = t->right;
+        while (next->left) {
+            next = next->left;
+        }
+        part = eraseAt(t->right, 0);
+        result = balance(t->left, next->node, part);
+    }
+    release(part);
+    return result;
+}
+
+template<class Type>
+const typename PersistentMultiTree<Type>::Link *
+PersistentMultiTree<Type>::replaceAt(const Link *t, int i, const Node *n) {
+    const int before = countOf(t->left);
+    if (i == before)
+        return new Link(t->left, n, t->right);
+    const Link *part, *result;
+    if (i < before) {
+        part = replaceAt(t->left, i, n);
+        result = new Link(part, t->node, t->right);
+    } else {
+        part = replaceAt(t->right, i - before - 1, n);
+        result = new Link(t->left, t->node, part);
+    }
+    release(part);
+    return result;
+}
+
+// Shallow copy sharing (and retaining) the children.
+template<class Type>
+typename PersistentMultiTree<Type>::Node *
+PersistentMultiTree<Type>::copyOf(const Node *node) {
+    auto copy = new Node(node->data);
+    setChildren(copy, node->children);
+    return copy;
+}
+
+// Takes a reference to list; the size follows from its member count.
+template<class Type>
+void PersistentMultiTree<Type>::setChildren(Node *node, const Link *list) {
+    retain(list);
+    release(node->children);
+    node->children = list;
+    node->size = 1 + membersOf(list);
+}
+
+// chain[i] is the node reached after i steps of path.
+template<class Type>
+const typename PersistentMultiTree<Type>::Node *
+PersistentMultiTree<Type>::walk(const Path &path, int levels,
+                                Vector<const Node *> &chain) const {
+    const Node *p = top;
+    chain.pushBack(p);
+    for (int i = 0; i < levels; ++i) {
+        if (path[i] < 0 || path[i] >= p->childCount())
+            throw MultiTreeException("Path out of tree");
+        p = p->child(path[i]);
+        chain.pushBack(p);
+    }
+    return p;
+}
+
+// Rebuilds chain[0..levels-1] with chain[levels] swapped for replacement.
+// Takes over the caller's reference to replacement.
+template<class Type>
+PersistentMultiTree<Type>
+PersistentMultiTree<Type>::copyPath(const Path &path, int levels,
+                                    Vector<const Node *> &chain,
+                                    const Node *replacement) {
+    for (int i = levels - 1; i >= 0; --i) {
+        Node *copy = copyOf(chain[i]);
+        const Link *list = replaceAt(copy->children, path[i], replacement);
+        release(replacement);
+        setChildren(copy, list);
+        release(list);
+        replacement = copy;
+    }
+    return PersistentMultiTree(replacement);
+}
+
+template<class Type>
+PersistentMultiTree<Type>
+PersistentMultiTree<Type>::appendChild(const Path &parent, const Type &d) const {
+    Vector<const Node *> chain;
+    int levels = parent.length();
+    const Node *p = walk(parent, levels, chain);
+    Node *copy = copyOf(p);
+    const Node *leaf = new Node(d);
+    const Link *list = insertAt(copy->children, copy->childCount(), leaf);
+    release(leaf);
+    setChildren(copy, list);
+    release(list);
+    return copyPath(parent, levels, chain, copy);
+}
+
+template<class Type>
+PersistentMultiTree<Type>
+PersistentMultiTree<Type>::remove(const Path &path) const {
+    if (path.isEmpty())
+        throw MultiTreeException("Cannot remove the top");
+    Vector<const Node *> chain;
+    int levels = path.length();
+    walk(path, levels, chain);
+    // Drop the child from its parent, then copy the rest of the way up.
+    Node *copy = copyOf(chain[levels - 1]);
+    const Link *list = eraseAt(copy->children, path[levels - 1]);
+    setChildren(copy, list);
+    release(list);
+    return copyPath(path, levels - 1, chain, copy);
+}
+
+template<class Type>
+PersistentMultiTree<Type>
+PersistentMultiTree<Type>::setData(const Path &path, const Type &d) const {
+    Vector<const Node *> chain;
+    int levels = path.length();
+    const Node *p = walk(path, levels, chain);
+    Node *copy = copyOf(p);
+    copy->data = d;
+    return copyPath(path, levels, chain, copy);
+}
+
+template<class Type>
+const typename PersistentMultiTree<Type>::Node *
+PersistentMultiTree<Type>::nodeAt(const Path &path) const {
+    Vector<const Node *> chain;
+    return walk(path, path.length(), chain);
+}
+
+// Depth first; path holds the index of the next child at each open level.
+template<class Type>
+bool PersistentMultiTree<Type>::find(const Type &d, Path &path) const {
+    Vector<const Node *> open;
+    path.clear();
+    open.pushBack(top);
+    path.pushBack(0);
+    while (!open.isEmpty()) {
+        const Node *p = open.pop();
+        int i = path.pop();
+        if (i == p->childCount()) {
+            open.popBack();
+            path.popBack();
+            continue;
+        }
+        path[path.length() - 1] = i + 1;
+        const Node *child = p->child(i);
+        if (child->data == d) {
+            for (size_t j = 0; j < path.length(); ++j) {
+                --path[j];
+            }
+            return true;
+        }
+        open.pushBack(child);
+        path.pushBack(0);
+    }
+    return false;
+}
+
+template<class Type>
+std::ostream &PersistentMultiTree<Type>::show(std::ostream &os) const {
+    struct Frame {
+        const Node *node;
+        int indent;
+        bool last;
+    };
+    BufferedWriter out(os);
+    Vector<Frame> frames;
+    Vector<int> rails;
+    for (int i = top->childCount() - 1; i >= 0; --i) {
+        frames.pushBack(Frame{top->child(i), 0, i == top->childCount() - 1});
+    }
+    while (!frames.isEmpty()) {
+        Frame f = frames.pop();
+        frames.popBack();
+        if (f.indent > 0) {
+            for (int i = 0; i < f.indent - 1; ++i) {
+                out << (rails[i] ? "│   " : "    ");
+            }
+            out << (f.last ? "└── " : "├── ");
+            rails[f.indent - 1] = !f.last;
+        }
+        out << f.node->data << '\n';
+        while (rails.length() < size_t(f.indent) + 1)
+            rails.pushBack(0);
+        int n = f.node->childCount();
+        for (int i = n - 1; i >= 0; --i) {
+            frames.pushBack(Frame{f.node->child(i), f.indent + 1, i == n - 1});
+        }
+    }
+    return os;
+}
+
 
 
 ///---------------------------- HashTable -----------------------------------///
@@ -874,6 +1782,7 @@ public:
     bool hasKey(const string &s) { return ht.hasKey(s); }
     size_t erase(const string& key) { return ht.erase(key); }
     void resize(size_t hint) { ht.resize(hint); }
+    void clear() { ht.clear(); }
     inline void insert(const string& s, const Value& val);
     inline void insert(const MapPair& pair);
 
@@ -918,7 +1827,8 @@ using std::getline;
 class GenealogyTreeSystem {
 public:
 
-    GenealogyTreeSystem() : tree("") { }
+    GenealogyTreeSystem() : tree("") { tree.enableAncestorIndex(); }
+    ~GenealogyTreeSystem();
 
     void run();
     bool parseCommand(char c);
@@ -926,21 +1836,59 @@ public:
     void addChild();
     void dismissSubFamily();
     void rename();
+    void queryKinship();
+    void showFamilySize();
+    void showHistory();
+    void undo();
     static void showMenu();
 
 private:
     typedef MultiTree<string> TreeType;
     typedef TreeType::Node NodeType;
+    // A person as a version saves them: the name shown and the key they are
+    // registered under, which differ once a rename collided.
+    struct Member {
+        string name;
+        string key;
+        bool operator==(const Member &m) const { return key == m.key; }
+        friend BufferedWriter &operator<<(BufferedWriter &out, const Member &m) {
+            return out << m.name;
+        }
+    };
+    typedef PersistentMultiTree<Member> VersionType;
     TreeType tree;
     StringHashMap<NodeType *> regMap;
     StringHashMap<int> collisionCount;
 
+    // Every change leaves a version behind; they share unchanged branches.
+    struct Snapshot {
+        Snapshot(const VersionType &v, const string &a, Snapshot *p) :
+                version(v), action(a), prev(p),
+                number(p ? p->number + 1 : 0) { }
+        VersionType version;
+        string action;
+        Snapshot *prev;
+        int number;
+    };
+    Snapshot *history = nullptr;
+
 private:
     static std::istream &clearInput(std::istream &is);
     static void notValidCommand(const string &s);
     string collisionHandle(const string &name);
+    void record(const VersionType &v, const string &action);
+    static void pathOf(NodeType *node, VersionType::Path &path);
+    void rebuild(const VersionType &v);
 };
 
+GenealogyTreeSystem::~GenealogyTreeSystem() {
+    while (history) {
+        Snapshot *p = history->prev;
+        delete history;
+        history = p;
+    }
+}
+
 bool GenealogyTreeSystem::parseCommand(char c) {
     switch (c - '0') {
         case 0:
@@ -960,6 +1908,18 @@ bool GenealogyTreeSystem::parseCommand(char c) {
         case 5:
             tree.show(cout);
             break;
+        case 6:
+            queryKinship();
+            break;
+        case 7:
+            showFamilySize();
+            break;
+        case 8:
+            showHistory();
+            break;
+        case 9:
+            undo();
+            break;
         default:
             notValidCommand(std::string());
     }
@@ -978,6 +1938,8 @@ void GenealogyTreeSystem::addAncestor() {
     }
     auto node = TreeType::insertSibling(tree.getRoot(), name);
     regMap.insert(name, node);
+    VersionType::Path top;
+    record(history->version.appendChild(top, Member{name, name}), "Add ancestor " + name);
     cout << name << " added!" << endl;
 }
 
@@ -994,6 +1956,11 @@ void GenealogyTreeSystem::addChild() {
     if (regMap.hasKey(name)) {
         string childName;
         NodeType* node = regMap.find(name).second;
+        // the newest child is the end of the sibling chain, so later ones
+        // are hung after it instead of walking the whole family again
+        NodeType* last = nullptr;
+        VersionType::Path path;
+        pathOf(node, path);
         cout << "Input the amount of children to be added: ";
         int n, cnt = 0;
         cin >> n;
@@ -1016,8 +1983,12 @@ void GenealogyTreeSystem::addChild() {
             if (regMap.hasKey(childName)) {
                 childName = collisionHandle(childName);
             }
-            auto child = TreeType::insertChild(node, childName);
+            auto child = last ? TreeType::insertSibling(last, childName)
+                              : TreeType::insertChild(node, childName);
+            last = child;
             regMap.insert(childName, child);
+            record(history->version.appendChild(path, Member{childName, childName}),
+                   "Add " + childName + " as a child of " + name);
             cout << childName << " added!" << endl;
             cnt++;
         }
@@ -1041,6 +2012,8 @@ void GenealogyTreeSystem::dismissSubFamily() {
     if (regMap.hasKey(name)) {
         Vector<string> member;
         NodeType* ancestor = regMap[name];
+        VersionType::Path path;
+        pathOf(ancestor, path);
         try {
             tree.dismissSubTree(ancestor, member);
         } catch (MultiTreeException& e) {
@@ -1052,6 +2025,7 @@ void GenealogyTreeSystem::dismissSubFamily() {
             cout << member[i] << endl;
             regMap.erase(member[i]);
         }
+        record(history->version.remove(path), "Dismiss the family of " + name);
         cout << n << (n>1 ? " members" : " member") << " removed." << endl;
     } else {
         cout << "Person not found, cannot dismiss subtree!" << endl;
@@ -1079,18 +2053,178 @@ void GenealogyTreeSystem::rename() {
             clearInput(cin);
         }
         auto p = regMap[name];
-        p->data = nName;
+        VersionType::Path path;
+        pathOf(p, path);
+        TreeType::setData(p, nName);
         regMap.erase(name);
         if (regMap.hasKey(nName)){
             nName = collisionHandle(nName);
         }
         regMap.insert(nName, p);
+        record(history->version.setData(path, Member{p->data, nName}),
+               "Rename " + name + " to " + nName);
         cout << name << " renamed to " << nName << endl;
     } else {
         cout << "Person not found." << endl;
     }
 }
 
+void GenealogyTreeSystem::queryKinship() {
+    cout << "Enter the names of two persons, each end with Return/Enter.\n"
+            "Empty string to back-out: ";
+    string first, second;
+    getline(cin, first);
+    clearInput(cin);
+    if (first.empty())
+        return;
+    getline(cin, second);
+    clearInput(cin);
+    if (second.empty())
+        return;
+    if (!regMap.hasKey(first) || !regMap.hasKey(second)) {
+        cout << "Person not found." << endl;
+        return;
+    }
+    NodeType *a = regMap[first], *b = regMap[second];
+    NodeType *common = TreeType::lowestCommonAncestor(a, b);
+    if (a == b) {
+        cout << "They are the same person." << endl;
+    } else if (common == nullptr) {
+        cout << first << " and " << second
+             << " have no common ancestor." << endl;
+    } else {
+        int up1 = TreeType::depthOf(a) - TreeType::depthOf(common);
+        int up2 = TreeType::depthOf(b) - TreeType::depthOf(common);
+        if (up2 == 0) {
+            cout << second << " is " << first << "'s ancestor, "
+                 << up1 << (up1 > 1 ? " generations" : " generation")
+                 << " above." << endl;
+        } else if (up1 == 0) {
+            cout << first << " is " << second << "'s ancestor, "
+                 << up2 << (up2 > 1 ? " generations" : " generation")
+                 << " above." << endl;
+        } else if (up1 == 1 && up2 == 1) {
+            cout << first << " and " << second << " are siblings." << endl;
+        } else {
+            cout << "Closest common ancestor is " << common->data << ", "
+                 << up1 << " generation(s) above " << first << " and "
+                 << up2 << " above " << second << "." << endl;
+        }
+    }
+}
+
+void GenealogyTreeSystem::showFamilySize() {
+    cout << "Enter the name of the head of family, end with Return/Enter.\n"
+            "Empty string to back-out: ";
+    string name;
+    getline(cin, name);
+    clearInput(cin);
+    if (name.empty())
+        return;
+    if (!regMap.hasKey(name)) {
+        cout << "Person not found." << endl;
+        return;
+    }
+    NodeType *p = regMap[name];
+    int n = TreeType::descendantCount(p);
+    int h = TreeType::heightOf(p);
+    cout << name << " has " << n << (n == 1 ? " descendant" : " descendants");
+    if (h > 0)
+        cout << " over " << h << (h == 1 ? " generation" : " generations");
+    cout << "." << endl;
+}
+
+void GenealogyTreeSystem::record(const VersionType &v, const string &action) {
+    history = new Snapshot(v, action, history);
+}
+
+// Child indices from the top level down to node, counted on the live tree,
+// which keeps children in the same order as the versions do.
+void GenealogyTreeSystem::pathOf(NodeType *node, VersionType::Path &path) {
+    path.clear();
+    for (NodeType *p = node; p; ) {
+        int index = 0;
+        while (p->parent && p->parent->firstChild != p) {
+            p = p->parent;
+            ++index;
+        }
+        path.pushBack(index);
+        p = p->parent;
+    }
+    for (size_t i = 0, j = path.length() - 1; i < j; ++i, --j) {
+        int temp = path[i];
+        path[i] = path[j];
+        path[j] = temp;
+    }
+}
+
+void GenealogyTreeSystem::showHistory() {
+    for (Snapshot *p = history; p; p = p->prev) {
+        int n = p->version.size();
+        cout << "#" << p->number << ": " << p->action << " ("
+             << n << (n > 1 ? " members)\n" : " member)\n");
+    }
+    cout << "Enter a version number to display it, empty to back-out: ";
+    string line;
+    getline(cin, line);
+    clearInput(cin);
+    if (line.empty())
+        return;
+    int number = std::atoi(line.c_str());
+    for (Snapshot *p = history; p; p = p->prev) {
+        if (p->number == number && std::to_string(number) == line) {
+            p->version.show(cout);
+            return;
+        }
+    }
+    cout << "No such version." << endl;
+}
+
+void GenealogyTreeSystem::undo() {
+    if (history->prev == nullptr) {
+        cout << "Nothing to undo." << endl;
+        return;
+    }
+    Snapshot *last = history;
+    history = last->prev;
+    rebuild(history->version);
+    cout << "Undone: " << last->action << endl;
+    delete last;
+}
+
+// Replaces the live tree and the name register with a saved version,
+// registering everyone under the key saved with them. Rebuilds all of it,
+// O(n) for n members.
+void GenealogyTreeSystem::rebuild(const VersionType &v) {
+    struct Pending {
+        const VersionType::Node *saved;
+        NodeType *live;
+    };
+    const VersionType::Node *top = v.getTop();
+    Vector<Pending> pending;
+    regMap.clear();
+    tree.reset(top->child(0)->data.name);
+    NodeType *live = tree.getRoot();
+    for (int i = 0; i < top->childCount(); ++i) {
+        const VersionType::Node *ancestor = top->child(i);
+        if (i > 0)
+            live = TreeType::insertSibling(live, ancestor->data.name);
+        pending.pushBack(Pending{ancestor, live});
+    }
+    while (!pending.isEmpty()) {
+        Pending p = pending.pop();
+        pending.popBack();
+        regMap.insert(p.saved->data.key, p.live);
+        NodeType *last = nullptr;
+        for (int i = 0; i < p.saved->childCount(); ++i) {
+            const VersionType::Node *child = p.saved->child(i);
+            last = last ? TreeType::insertSibling(last, child->data.name)
+                        : TreeType::insertChild(p.live, child->data.name);
+            pending.pushBack(Pending{child, last});
+        }
+    }
+}
+
 std::istream &GenealogyTreeSystem::clearInput(std::istream &is) {
     if (!is.good()) {
         is.clear();
@@ -1135,8 +2269,11 @@ void GenealogyTreeSystem::run() {
         getline(cin, ancestor);
         clearInput(cin);
     }
-    tree.getRoot()->data = ancestor;
+    TreeType::setData(tree.getRoot(), ancestor);
     regMap.insert(ancestor, tree.getRoot());
+    VersionType::Path top;
+    record(VersionType().appendChild(top, Member{ancestor, ancestor}),
+           "Start with " + ancestor);
     string command;
     while (true) {
         showMenu();
@@ -1159,6 +2296,10 @@ void GenealogyTreeSystem::showMenu() {
             "\t\t* 3. Dismiss someone's family *\n"
             "\t\t* 4. Rename a person          *\n"
             "\t\t* 5. Display Tree             *\n"
+            "\t\t* 6. Query kinship            *\n"
+            "\t\t* 7. Show family size         *\n"
+            "\t\t* 8. Show history             *\n"
+            "\t\t* 9. Undo last change         *\n"
             "\t\t* 0. Quit                     *\n"
             "\t\t-------------------------------\n";
     cout << "To use these commands, type the (single) "
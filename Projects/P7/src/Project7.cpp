@@ -1,7 +1,10 @@
 #include <cstring>
 #include <exception>
 #include <iostream>
+#include <limits>
 #include <string>
+#include <vector>
+#include <cstdint>
 #include <sstream>
 #include <algorithm>
 
@@ -93,7 +96,7 @@ Vector<ElemType> &Vector<ElemType>::operator=(Vector<ElemType> const &another) {
     }
     size = another.size;
     if (size > 0) {
-        memcpy(data, another.data, sizeof(ElemType) * size);
+        std::copy(another.data, another.data + size, data);
     }
     return *this;
 }
@@ -122,12 +125,12 @@ void Vector<ElemType>::reallocate(size_t new_size) {
     auto new_data = new ElemType[new_size];
     if (new_size > capacity) {
         if (!isEmpty())
-            memcpy(new_data, data, sizeof(ElemType) * size);
+            std::copy(data, data + size, new_data);
     } else {
         if (new_size < size) {
             size = new_size;
         }
-        memcpy(new_data, data, sizeof(ElemType) * size);
+        std::copy(data, data + size, new_data);
     }
     delete[] data;
     data = new_data;
@@ -387,53 +390,129 @@ public:
 class BigInteger {
     friend std::ostream &operator <<(std::ostream &, const BigInteger &);
 public:
-    explicit BigInteger(const string& i = "") :
-            integer(check(i)) { }
+    explicit BigInteger(const string& i = "") { parse(check(i)); }
+    BigInteger(const BigInteger &other) = default;
+    BigInteger(BigInteger &&other) noexcept;
     BigInteger &operator=(string s);
+    BigInteger &operator=(BigInteger &&other) noexcept;
 
     bool operator>(const BigInteger &other) const;
     bool operator<(const BigInteger &other) const;
     BigInteger &operator=(const BigInteger& other);
     bool operator==(const BigInteger &other) const;
     BigInteger operator+(const BigInteger &bi) const;
+    // Adds in place, allocating only when the limbs outgrow their capacity.
+    BigInteger &operator+=(const BigInteger &bi);
 
     static string check(const string &s);
 
 protected:
-    string integer = "";
+    // Base 10^9 limbs, least significant first; zero has none.
+    static constexpr uint32_t Base = 1000000000;
+    static constexpr int BaseDigits = 9;
+    // Values below 2^64 live in small with big false and no limbs; only
+    // larger ones use limbs.
+    std::vector<uint32_t> limbs;
+    uint64_t small = 0;
+    bool big = false;
+
+    void parse(const string &digits);
+    int compare(const BigInteger &other) const;
+    static void toLimbs(uint64_t u, std::vector<uint32_t> &r);
+    static void addSmall(std::vector<uint32_t> &a, uint64_t u);
 };
 
+BigInteger::BigInteger(BigInteger &&other) noexcept :
+        limbs(std::move(other.limbs)), small(other.small), big(other.big) {
+    other.limbs.clear();
+    other.small = 0;
+    other.big = false;
+}
+
+BigInteger &BigInteger::operator=(BigInteger &&other) noexcept {
+    if (&other == this)
+        return *this;
+    limbs.swap(other.limbs);
+    small = other.small;
+    big = other.big;
+    other.limbs.clear();
+    other.small = 0;
+    other.big = false;
+    return *this;
+}
+
 BigInteger &BigInteger::operator=(string s) {
-    this->integer = std::move(s);
+    parse(check(s));
     return *this;
 }
 
-bool BigInteger::operator>(const BigInteger &other) const {
-    if (integer.length() > other.integer.length()) return true;
-    if (integer.length() < other.integer.length()) return false;
-    for (int i = 0; i < (int)integer.length(); ++i) {
-        if (integer[i] > other.integer[i]) return true;
-        if (integer[i] < other.integer[i]) return false;
+// digits has no leading zeros.
+void BigInteger::parse(const string &digits) {
+    limbs.clear();
+    small = 0;
+    big = false;
+    // Up to 19 digits always fit in 64 bits.
+    if (digits.length() <= 19) {
+        for (size_t i = 0; i < digits.length(); ++i) {
+            small = small * 10 + (digits[i] - '0');
+        }
+        return;
+    }
+    for (long end = long(digits.length()); end > 0; end -= BaseDigits) {
+        long beg = std::max(0L, end - BaseDigits);
+        uint32_t limb = 0;
+        for (long i = beg; i < end; ++i) {
+            limb = limb * 10 + (digits[i] - '0');
+        }
+        limbs.push_back(limb);
+    }
+    big = true;
+    // 20 digits may still be below 2^64.
+    if (limbs.size() == 3) {
+        unsigned __int128 v = (unsigned __int128) limbs[2] * Base * Base +
+                              uint64_t(limbs[1]) * Base + limbs[0];
+        if (v <= UINT64_MAX) {
+            small = uint64_t(v);
+            big = false;
+            limbs.clear();
+        }
     }
-    return false;
 }
 
-bool BigInteger::operator<(const BigInteger &other) const {
-    if (integer.length() < other.integer.length()) return true;
-    if (integer.length() > other.integer.length()) return false;
-    for (int i = 0; i < (int)integer.length(); ++i) {
-        if (integer[i] < other.integer[i]) return true;
-        if (integer[i] > other.integer[i]) return false;
+void BigInteger::toLimbs(uint64_t u, std::vector<uint32_t> &r) {
+    r.clear();
+    while (u) {
+        r.push_back(uint32_t(u % Base));
+        u /= Base;
     }
-    return false;
 }
 
-bool BigInteger::operator==(const BigInteger &other) const {
-    if (integer.length() != other.integer.length()) return false;
-    for (int i = 0; i < (int)integer.length(); ++i) {
-        if (integer[i] != other.integer[i]) return false;
+int BigInteger::compare(const BigInteger &other) const {
+    if (!big || !other.big) {
+        // A big value is larger than every small one.
+        if (big != other.big)
+            return big ? 1 : -1;
+        return (small > other.small) - (small < other.small);
     }
-    return true;
+    if (limbs.size() != other.limbs.size())
+        return limbs.size() < other.limbs.size() ? -1 : 1;
+    for (size_t i = limbs.size(); i > 0; --i) {
+        if (limbs[i - 1] != other.limbs[i - 1])
+            return limbs[i - 1] < other.limbs[i - 1] ? -1 : 1;
+    }
+    return 0;
+}
+
+bool BigInteger::operator>(const BigInteger &other) const {
+    return compare(other) > 0;
+}
+
+bool BigInteger::operator<(const BigInteger &other) const {
+    return compare(other) < 0;
+}
+
+bool BigInteger::operator==(const BigInteger &other) const {
+    return compare(other) == 0;
 }
 
 string BigInteger::check(const string &s) {
@@ -450,56 +529,79 @@ string BigInteger::check(const string &s) {
 }
 
 std::ostream &operator<<(std::ostream &os, const BigInteger &bi) {
-    os << bi.integer;
+    if (!bi.big)
+        return os << bi.small;
+    os << bi.limbs.back();
+    char chunk[BigInteger::BaseDigits + 1] = {0};
+    for (size_t i = bi.limbs.size() - 1; i > 0; --i) {
+        uint32_t limb = bi.limbs[i - 1];
+        for (int j = BigInteger::BaseDigits - 1; j >= 0; --j) {
+            chunk[j] = char('0' + limb % 10);
+            limb /= 10;
+        }
+        os << chunk;
+    }
     return os;
 }
 
 BigInteger BigInteger::operator+(const BigInteger &bi) const {
-    using std::reverse;
-    BigInteger result;
-    string lhs = integer, rhs = bi.integer;
-    reverse(lhs.begin(), lhs.end());
-    reverse(rhs.begin(), rhs.end());
-
-    // Adding
-    result.integer = "";
-    unsigned long length = std::min(lhs.length(), rhs.length());
-    int i = 0;
-    for (; i < length; i++) {
-        // Roughly adding each digit, not caring carrying.
-        result.integer.push_back(lhs[i] - '0' + rhs[i]);
-    }
+    BigInteger result(*this);
+    result += bi;
+    return result;
+}
 
-    if (length < lhs.length()) {
-        result.integer += lhs.substr(i);
-    } else if (length < rhs.length()) {
-        result.integer += rhs.substr(i);
+void BigInteger::addSmall(std::vector<uint32_t> &a, uint64_t u) {
+    for (size_t i = 0; u; ++i) {
+        if (i == a.size())
+            a.push_back(0);
+        uint64_t sum = a[i] + u % Base;
+        u /= Base;
+        if (sum >= Base) {
+            sum -= Base;
+            ++u;
+        }
+        a[i] = uint32_t(sum);
     }
+}
 
-    int carry = 0;
-    for (auto &c : result.integer) {
-        int temp = c + carry - '0';
-        carry = temp / 10;
-        temp %= 10;
-        c = temp + '0';
+// The sum is never smaller than either operand, so once an addition
+// overflows into limbs the result stays big.
+BigInteger &BigInteger::operator+=(const BigInteger &bi) {
+    uint64_t sum;
+    if (!big && !bi.big && !__builtin_add_overflow(small, bi.small, &sum)) {
+        small = sum;
+        return *this;
     }
-    if (carry != 0) {
-        result.integer.push_back('1');
+    // Read bi first, it may be *this.
+    uint64_t u = bi.small;
+    bool otherBig = bi.big;
+    if (!big)
+        toLimbs(small, limbs);
+    small = 0;
+    big = true;
+    if (!otherBig) {
+        addSmall(limbs, u);
+        return *this;
     }
-
-    reverse(result.integer.begin(), result.integer.end());
-    auto valid = result.integer.find_first_not_of('0');
-    if (valid == string::npos) {
-        return BigInteger("0");
+    size_t n = std::max(limbs.size(), bi.limbs.size()), m = bi.limbs.size();
+    limbs.resize(n);
+    uint32_t carry = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t sum = limbs[i] + carry + (i < m ? bi.limbs[i] : 0);
+        carry = sum >= Base;
+        limbs[i] = carry ? sum - Base : sum;
     }
-    result.integer = result.integer.substr(valid);
-    return result;
+    if (carry)
+        limbs.push_back(carry);
+    return *this;
 }
 
 BigInteger &BigInteger::operator=(const BigInteger &other) {
     if (&other == this)
         return *this;
-    this->integer = other.integer;
+    this->limbs = other.limbs;
+    this->small = other.small;
+    this->big = other.big;
     return *this;
 }
 
@@ -557,9 +659,9 @@ BigInteger WoodCutter::calculateCost() {
         while (heap.size() > 1) {
             BigInteger temp = heap.peek();
             heap.pop();
-            temp = temp + heap.peek();
+            temp += heap.peek();
             heap.pop();
-            cost = cost + temp;
+            cost += temp;
             heap.push(temp);
         }
     }